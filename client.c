@@ -276,6 +276,7 @@ client_main(int argc, char **argv, int flags)
 		cmddata.argc = argc;
 		if (cmd_pack_argv(
 		    argc, argv, cmddata.argv, sizeof cmddata.argv) != 0) {
+			setblocking(STDOUT_FILENO, 1);
 			fprintf(stderr, "command too long\n");
 			return (1);
 		}
@@ -288,7 +289,11 @@ client_main(int argc, char **argv, int flags)
 	client_update_event();
 	event_dispatch();
 
-	/* Print the exit message, if any, and exit. */
+	/*
+	 * Print the exit message, if any, and exit. The server may have made
+	 * stdout nonblocking if it was writing to it directly.
+	 */
+	setblocking(STDOUT_FILENO, 1);
 	if (client_attached) {
 		if (client_exitreason != CLIENT_EXIT_NONE && !login_shell)
 			printf("[%s]\n", client_exit_message());
@@ -328,6 +333,11 @@ client_send_identify(int flags)
 	    strlcpy(data.term, term, sizeof data.term) >= sizeof data.term)
 		*data.term = '\0';
 
+	if ((fd = dup(STDOUT_FILENO)) == -1)
+		fatal("dup failed");
+	imsg_compose(&client_ibuf,
+	    MSG_IDENTIFY_STDOUT, PROTOCOL_VERSION, -1, fd, NULL, 0);
+
 	if ((fd = dup(STDIN_FILENO)) == -1)
 		fatal("dup failed");
 	imsg_compose(&client_ibuf,
@@ -456,15 +466,18 @@ lost_server:
 void
 client_stdin_callback(unused int fd, unused short events, unused void *data1)
 {
-	struct msg_stdin_data	data;
+	char	buf[STDIO_DATA_SIZE];
+	ssize_t	n;
 
-	data.size = read(STDIN_FILENO, data.data, sizeof data.data);
-	if (data.size < 0 && (errno == EINTR || errno == EAGAIN))
+	n = read(STDIN_FILENO, buf, sizeof buf);
+	if (n < 0 && (errno == EINTR || errno == EAGAIN))
 		return;
 
-	client_write_server(MSG_STDIN, &data, sizeof data);
-	if (data.size <= 0)
+	if (n <= 0) {
+		client_write_server(MSG_STDIN, NULL, 0);
 		event_del(&client_stdin);
+	} else
+		client_write_server(MSG_STDIN, buf, n);
 	client_update_event();
 }
 
@@ -494,8 +507,6 @@ client_dispatch_wait(void *data)
 	ssize_t			n, datalen;
 	struct msg_shell_data	shelldata;
 	struct msg_exit_data	exitdata;
-	struct msg_stdout_data	stdoutdata;
-	struct msg_stderr_data	stderrdata;
 	const char             *shellcmd = data;
 
 	for (;;) {
@@ -533,18 +544,16 @@ client_dispatch_wait(void *data)
 			event_add(&client_stdin, NULL);
 			break;
 		case MSG_STDOUT:
-			if (datalen != sizeof stdoutdata)
+			if ((size_t)datalen > STDIO_DATA_SIZE)
 				fatalx("bad MSG_STDOUT");
-			memcpy(&stdoutdata, imsg.data, sizeof stdoutdata);
 
-			client_write(STDOUT_FILENO, stdoutdata.data, stdoutdata.size);
+			client_write(STDOUT_FILENO, imsg.data, datalen);
 			break;
 		case MSG_STDERR:
-			if (datalen != sizeof stderrdata)
+			if ((size_t)datalen > STDIO_DATA_SIZE)
 				fatalx("bad MSG_STDERR");
-			memcpy(&stderrdata, imsg.data, sizeof stderrdata);
 
-			client_write(STDERR_FILENO, stderrdata.data, stderrdata.size);
+			client_write(STDERR_FILENO, imsg.data, datalen);
 			break;
 		case MSG_VERSION:
 			if (datalen != 0)
@@ -74,7 +74,7 @@ cmd_attach_session(struct cmd_q *cmdq, const char* tflag, int dflag, int rflag)
 			}
 		}
 
-		cmdq->client->session = s;
+		server_client_set_session(cmdq->client, s);
 		notify_attached_session_changed(cmdq->client);
 		session_update_activity(s);
 		server_redraw_client(cmdq->client);
@@ -95,7 +95,7 @@ cmd_attach_session(struct cmd_q *cmdq, const char* tflag, int dflag, int rflag)
 		update = options_get_string(&s->options, "update-environment");
 		environ_update(update, &cmdq->client->environ, &s->environ);
 
-		cmdq->client->session = s;
+		server_client_set_session(cmdq->client, s);
 		notify_attached_session_changed(cmdq->client);
 		session_update_activity(s);
 		server_redraw_client(cmdq->client);
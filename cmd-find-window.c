@@ -19,6 +19,7 @@
 #include <sys/types.h>
 
 #include <fnmatch.h>
+#include <regex.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -31,6 +32,7 @@
 enum cmd_retval	 cmd_find_window_exec(struct cmd *, struct cmd_q *);
 
 void	cmd_find_window_callback(struct window_choose_data *);
+void	cmd_find_window_history_callback(struct window_choose_data *);
 
 /* Flags for determining matching behavior. */
 #define CMD_FIND_WINDOW_BY_TITLE   0x1
@@ -42,10 +44,13 @@ void	cmd_find_window_callback(struct window_choose_data *);
 	 CMD_FIND_WINDOW_BY_CONTENT |	\
 	 CMD_FIND_WINDOW_BY_NAME)
 
+/* Lines searched by find-window -H before returning to the event loop. */
+#define CMD_FIND_WINDOW_LINES 5000
+
 const struct cmd_entry cmd_find_window_entry = {
 	"find-window", "findw",
-	"F:CNt:T", 1, 4,
-	"[-CNT] [-F format] " CMD_TARGET_WINDOW_USAGE " match-string",
+	"F:CHNt:T", 1, 4,
+	"[-CHNT] [-F format] " CMD_TARGET_WINDOW_USAGE " match-string",
 	0,
 	NULL,
 	NULL,
@@ -59,9 +64,52 @@ struct cmd_find_window_data {
 };
 ARRAY_DECL(cmd_find_window_data_list, struct cmd_find_window_data);
 
+/* A pane with matches in its history. */
+struct cmd_find_window_result {
+	u_int		 pane;
+	u_int		 line;
+	u_int		 matches;
+	char		*excerpt;
+};
+
+/* State of a find-window -H search of every pane. */
+struct cmd_find_window_history {
+	struct cmd_q	*cmdq;
+	struct client	*c;
+	u_int		 target; /* pane to show the results in */
+
+	char		*str;
+	char		*searchstr;
+	int		 glob; /* str has pattern characters */
+	int		 isre; /* re is used rather than str */
+	regex_t		 re;
+	char		*template;
+
+	ARRAY_DECL(, u_int) panes;
+	u_int		 pane; /* index into panes */
+	u_int		 line; /* next line, counting up from the bottom */
+	struct cmd_find_window_result result;
+	struct grid_text text;
+
+	ARRAY_DECL(, struct cmd_find_window_result) results;
+	struct event	 timer;
+};
+
 u_int	cmd_find_window_match_flags(struct args *);
 void	cmd_find_window_match(struct cmd_find_window_data_list *, int,
+	    struct winlink *, const char *, const char *, regex_t *);
+enum cmd_retval cmd_find_window_history_start(struct cmd_q *, struct client *,
 	    struct winlink *, const char *, const char *);
+void	cmd_find_window_history_timer(int, short, void *);
+int	cmd_find_window_history_line(struct cmd_find_window_history *);
+void	cmd_find_window_history_next(struct cmd_find_window_history *);
+int	cmd_find_window_history_cmp(const void *, const void *);
+struct winlink *cmd_find_window_history_winlink(struct client *,
+	    struct window_pane *, struct session **);
+void	cmd_find_window_history_select(struct client *, struct session *,
+	    struct winlink *, struct window_pane *);
+void	cmd_find_window_history_done(struct cmd_find_window_history *);
+void	cmd_find_window_history_free(struct cmd_find_window_history *);
 
 u_int
 cmd_find_window_match_flags(struct args *args)
@@ -85,7 +133,8 @@ cmd_find_window_match_flags(struct args *args)
 
 void
 cmd_find_window_match(struct cmd_find_window_data_list *find_list,
-    int match_flags, struct winlink *wl, const char *str, const char *searchstr)
+    int match_flags, struct winlink *wl, const char *str, const char *searchstr,
+    regex_t *re)
 {
 	struct cmd_find_window_data	 find_data;
 	struct window_pane		*wp;
@@ -112,7 +161,7 @@ cmd_find_window_match(struct cmd_find_window_data_list *find_list,
 		}
 
 		if (match_flags & CMD_FIND_WINDOW_BY_CONTENT &&
-		    (sres = window_pane_search(wp, str, &line)) != NULL) {
+		    (sres = window_pane_search(wp, str, re, &line)) != NULL) {
 			xasprintf(&find_data.list_ctx,
 			    "pane %u line %u: \"%s\"", i - 1, line + 1, sres);
 			free(sres);
@@ -138,6 +187,8 @@ cmd_find_window_exec(struct cmd *self, struct cmd_q *cmdq)
 	char				*str, *searchstr;
 	const char			*template;
 	u_int				 i, match_flags;
+	regex_t				 re;
+	int				 flags, isre;
 
 	if ((c = cmd_current_client(cmdq)) == NULL) {
 		cmdq_error(cmdq, "no client available");
@@ -154,12 +205,25 @@ cmd_find_window_exec(struct cmd *self, struct cmd_q *cmdq)
 	match_flags = cmd_find_window_match_flags(args);
 	str = args->argv[0];
 
+	if (args_has(args, 'H')) {
+		return (cmd_find_window_history_start(cmdq, c, wl, str,
+		    template));
+	}
+
 	ARRAY_INIT(&find_list);
 
+	/* Content is matched following the target window's search options. */
+	flags = window_search_flags(wl->window, str);
+	isre = (window_search_compile(&re, str, flags) != 0);
+
 	xasprintf(&searchstr, "*%s*", str);
-	RB_FOREACH(wm, winlinks, &s->windows)
-	    cmd_find_window_match (&find_list, match_flags, wm, str, searchstr);
+	RB_FOREACH(wm, winlinks, &s->windows) {
+		cmd_find_window_match(&find_list, match_flags, wm, str,
+		    searchstr, isre ? &re : NULL);
+	}
 	free(searchstr);
+	if (isre)
+		regfree(&re);
 
 	if (ARRAY_LENGTH(&find_list) == 0) {
 		cmdq_error(cmdq, "no windows matching: %s", str);
@@ -226,3 +290,323 @@ cmd_find_window_callback(struct window_choose_data *cdata)
 		recalculate_sizes();
 	}
 }
+
+/*
+ * Start searching the history of every pane in every session. This is done a
+ * few thousand lines at a time from a timer, so the command waits and other
+ * clients carry on as normal until it is finished.
+ */
+enum cmd_retval
+cmd_find_window_history_start(struct cmd_q *cmdq, struct client *c,
+    struct winlink *wl, const char *str, const char *template)
+{
+	struct cmd_find_window_history	*fh;
+	struct window_pane		*wp;
+	struct timeval			 tv;
+
+	fh = xcalloc(1, sizeof *fh);
+	fh->cmdq = cmdq;
+	cmdq->references++;
+	fh->c = c;
+	c->references++;
+	fh->target = wl->window->active->id;
+
+	fh->str = xstrdup(str);
+	xasprintf(&fh->searchstr, "*%s*", str);
+	fh->glob = (strpbrk(str, "*?[\\") != NULL);
+	fh->isre = (window_search_compile(&fh->re, str,
+	    window_search_flags(wl->window, str)) != 0);
+	fh->template = xstrdup(template);
+
+	ARRAY_INIT(&fh->panes);
+	RB_FOREACH(wp, window_pane_tree, &all_window_panes)
+		ARRAY_ADD(&fh->panes, wp->id);
+	ARRAY_INIT(&fh->results);
+
+	evtimer_set(&fh->timer, cmd_find_window_history_timer, fh);
+	memset(&tv, 0, sizeof tv);
+	evtimer_add(&fh->timer, &tv);
+
+	return (CMD_RETURN_WAIT);
+}
+
+/* Search the next CMD_FIND_WINDOW_LINES lines. */
+void
+cmd_find_window_history_timer(unused int fd, unused short events, void *arg)
+{
+	struct cmd_find_window_history	*fh = arg;
+	struct window_pane		*wp;
+	struct grid			*gd;
+	struct timeval			 tv;
+	u_int				 n, py, total;
+
+	if (fh->cmdq->dead) {
+		cmd_find_window_history_free(fh);
+		return;
+	}
+
+	n = 0;
+	while (fh->pane < ARRAY_LENGTH(&fh->panes)) {
+		wp = window_pane_find_by_id(ARRAY_ITEM(&fh->panes, fh->pane));
+		if (wp == NULL) {
+			cmd_find_window_history_next(fh);
+			continue;
+		}
+		gd = wp->base.grid;
+		total = gd->hsize + gd->sy;
+
+		for (; n < CMD_FIND_WINDOW_LINES && fh->line < total; n++) {
+			py = total - 1 - fh->line++;
+			grid_get_text(gd, py, &fh->text);
+			if (!cmd_find_window_history_line(fh))
+				continue;
+			if (fh->result.matches++ == 0) {
+				fh->result.line = py;
+				fh->result.excerpt = xstrdup(fh->text.text);
+			}
+		}
+		if (n == CMD_FIND_WINDOW_LINES) {
+			memset(&tv, 0, sizeof tv);
+			evtimer_add(&fh->timer, &tv);
+			return;
+		}
+		cmd_find_window_history_next(fh);
+	}
+
+	cmd_find_window_history_done(fh);
+	cmd_find_window_history_free(fh);
+}
+
+/*
+ * Check if the current line matches. A string compiled following the search
+ * options uses the expression, and plain strings are found with strstr
+ * rather than fnmatch.
+ */
+int
+cmd_find_window_history_line(struct cmd_find_window_history *fh)
+{
+	struct grid_text	*gt = &fh->text;
+
+	while (gt->len > 0 && gt->text[gt->len - 1] == ' ')
+		gt->len--;
+	gt->text[gt->len] = '\0';
+
+	if (fh->isre)
+		return (regexec(&fh->re, gt->text, 0, NULL, 0) == 0);
+	if (fh->glob)
+		return (fnmatch(fh->searchstr, gt->text, 0) == 0);
+	return (strstr(gt->text, fh->str) != NULL);
+}
+
+/* Finish the current pane and move to the next. */
+void
+cmd_find_window_history_next(struct cmd_find_window_history *fh)
+{
+	if (fh->result.matches != 0) {
+		fh->result.pane = ARRAY_ITEM(&fh->panes, fh->pane);
+		ARRAY_ADD(&fh->results, fh->result);
+	}
+	memset(&fh->result, 0, sizeof fh->result);
+
+	fh->pane++;
+	fh->line = 0;
+}
+
+/* Sort results with the most matches first. */
+int
+cmd_find_window_history_cmp(const void *a, const void *b)
+{
+	const struct cmd_find_window_result	*ra = a, *rb = b;
+
+	if (ra->matches != rb->matches)
+		return (ra->matches > rb->matches ? -1 : 1);
+	if (ra->pane != rb->pane)
+		return (ra->pane < rb->pane ? -1 : 1);
+	return (0);
+}
+
+/*
+ * Find a winlink for a pane, in the client's session if the window is in it,
+ * otherwise in the first session that has it.
+ */
+struct winlink *
+cmd_find_window_history_winlink(struct client *c, struct window_pane *wp,
+    struct session **sp)
+{
+	struct session	*s;
+	struct winlink	*wl;
+
+	if (c->session != NULL &&
+	    (wl = session_has(c->session, wp->window)) != NULL) {
+		*sp = c->session;
+		return (wl);
+	}
+	RB_FOREACH(s, sessions, &sessions) {
+		if ((wl = session_has(s, wp->window)) != NULL) {
+			*sp = s;
+			return (wl);
+		}
+	}
+	return (NULL);
+}
+
+/* Switch a client to a pane. */
+void
+cmd_find_window_history_select(struct client *c, struct session *s,
+    struct winlink *wl, struct window_pane *wp)
+{
+	int	changed = 0;
+
+	if (window_pane_visible(wp))
+		window_set_active_pane(wl->window, wp);
+
+	if (c->session != s) {
+		if (c->session != NULL)
+			c->last_session = c->session;
+		server_client_set_session(c, s);
+		session_update_activity(s);
+		server_check_unattached();
+		changed = 1;
+	}
+	session_select(s, wl->idx);
+	server_redraw_session(s);
+	server_redraw_client(c);
+	recalculate_sizes();
+	if (changed)
+		notify_attached_session_changed(c);
+}
+
+/* Show the results of the search. */
+void
+cmd_find_window_history_done(struct cmd_find_window_history *fh)
+{
+	struct client			*c = fh->c;
+	struct cmd_find_window_result	*fr;
+	struct window_choose_data	*cdata;
+	struct window_pane		*wp, *target;
+	struct session			*s;
+	struct winlink			*wl;
+	u_int				 i, idx, line;
+
+	if (c->flags & CLIENT_DEAD || c->session == NULL)
+		return;
+
+	/* Drop panes that have gone away. */
+	i = 0;
+	while (i < ARRAY_LENGTH(&fh->results)) {
+		fr = &ARRAY_ITEM(&fh->results, i);
+		if ((wp = window_pane_find_by_id(fr->pane)) == NULL ||
+		    cmd_find_window_history_winlink(c, wp, &s) == NULL) {
+			free(fr->excerpt);
+			ARRAY_REMOVE(&fh->results, i);
+			continue;
+		}
+		i++;
+	}
+	if (ARRAY_LENGTH(&fh->results) == 0) {
+		cmdq_error(fh->cmdq, "no windows matching: %s", fh->str);
+		return;
+	}
+	qsort(ARRAY_DATA(&fh->results), ARRAY_LENGTH(&fh->results),
+	    sizeof *ARRAY_DATA(&fh->results), cmd_find_window_history_cmp);
+
+	if (ARRAY_LENGTH(&fh->results) == 1) {
+		wp = window_pane_find_by_id(ARRAY_FIRST(&fh->results).pane);
+		wl = cmd_find_window_history_winlink(c, wp, &s);
+		cmd_find_window_history_select(c, s, wl, wp);
+		return;
+	}
+
+	target = window_pane_find_by_id(fh->target);
+	if (target == NULL) {
+		cmdq_error(fh->cmdq, "window no longer exists");
+		return;
+	}
+	if (window_pane_set_mode(target, &window_choose_mode) != 0)
+		return;
+
+	for (i = 0; i < ARRAY_LENGTH(&fh->results); i++) {
+		fr = &ARRAY_ITEM(&fh->results, i);
+		wp = window_pane_find_by_id(fr->pane);
+		wl = cmd_find_window_history_winlink(c, wp, &s);
+		if (window_pane_index(wp, &idx) != 0)
+			idx = 0;
+		line = fr->line + 1;
+
+		cdata = window_choose_data_create(TREE_OTHER, c, c->session);
+		cdata->idx = s->id;
+		cdata->wl = wl;
+
+		cdata->ft_template = xstrdup(fh->template);
+		cdata->pane_id = wp->id;
+
+		format_add(cdata->ft, "line", "%u", i);
+		format_add(cdata->ft, "window_find_matches",
+		    "%s:%d.%u line %u (%u matches): \"%s\"", s->name, wl->idx,
+		    idx, line, fr->matches, fr->excerpt);
+		format_session(cdata->ft, s);
+		format_winlink(cdata->ft, s, wl);
+		format_window_pane(cdata->ft, wp);
+
+		window_choose_add(target, cdata);
+	}
+
+	window_choose_ready(target, 0, cmd_find_window_history_callback);
+}
+
+/* Free search state and let the command queue carry on. */
+void
+cmd_find_window_history_free(struct cmd_find_window_history *fh)
+{
+	u_int	i;
+
+	evtimer_del(&fh->timer);
+
+	for (i = 0; i < ARRAY_LENGTH(&fh->results); i++)
+		free(ARRAY_ITEM(&fh->results, i).excerpt);
+	ARRAY_FREE(&fh->results);
+	free(fh->result.excerpt);
+	ARRAY_FREE(&fh->panes);
+
+	free(fh->text.text);
+	free(fh->text.cells);
+
+	free(fh->str);
+	free(fh->searchstr);
+	if (fh->isre)
+		regfree(&fh->re);
+	free(fh->template);
+
+	fh->c->references--;
+	if (!cmdq_free(fh->cmdq))
+		cmdq_continue(fh->cmdq);
+	free(fh);
+}
+
+/*
+ * Choose callback for find-window -H, where idx is the session ID and pane_id
+ * the pane ID.
+ */
+void
+cmd_find_window_history_callback(struct window_choose_data *cdata)
+{
+	struct client		*c;
+	struct session		*s;
+	struct winlink		*wl;
+	struct window_pane	*wp;
+
+	if (cdata == NULL)
+		return;
+
+	c = cdata->start_client;
+	if (c->flags & CLIENT_DEAD)
+		return;
+	if ((s = session_find_by_id(cdata->idx)) == NULL)
+		return;
+
+	if ((wp = window_pane_find_by_id(cdata->pane_id)) == NULL)
+		return;
+	if ((wl = session_has(s, wp->window)) == NULL)
+		return;
+	cmd_find_window_history_select(c, s, wl, wp);
+}
@@ -219,7 +219,7 @@ cmd_new_session_exec(struct cmd *self, struct cmd_q *cmdq)
 			server_write_ready(c);
 		else if (c->session != NULL)
 			c->last_session = c->session;
-		c->session = s;
+		server_client_set_session(c, s);
 		notify_attached_session_changed(c);
 		session_update_activity(s);
 		server_redraw_client(c);
@@ -33,8 +33,6 @@
 
 enum cmd_retval	 cmd_pipe_pane_exec(struct cmd *, struct cmd_q *);
 
-void	cmd_pipe_pane_error_callback(struct bufferevent *, short, void *);
-
 const struct cmd_entry cmd_pipe_pane_entry = {
 	"pipe-pane", "pipep",
 	"ot:", 0, 1,
@@ -60,11 +58,7 @@ cmd_pipe_pane_exec(struct cmd *self, struct cmd_q *cmdq)
 
 	/* Destroy the old pipe. */
 	old_fd = wp->pipe_fd;
-	if (wp->pipe_fd != -1) {
-		bufferevent_free(wp->pipe_event);
-		close(wp->pipe_fd);
-		wp->pipe_fd = -1;
-	}
+	window_pane_pipe_close(wp);
 
 	/* If no pipe command, that is enough. */
 	if (args->argc == 0 || *args->argv[0] == '\0')
@@ -118,25 +112,7 @@ cmd_pipe_pane_exec(struct cmd *self, struct cmd_q *cmdq)
 		/* Parent process. */
 		close(pipe_fd[1]);
 
-		wp->pipe_fd = pipe_fd[0];
-		wp->pipe_off = EVBUFFER_LENGTH(wp->event->input);
-
-		wp->pipe_event = bufferevent_new(wp->pipe_fd,
-		    NULL, NULL, cmd_pipe_pane_error_callback, wp);
-		bufferevent_enable(wp->pipe_event, EV_WRITE);
-
-		setblocking(wp->pipe_fd, 0);
+		window_pane_pipe_open(wp, pipe_fd[0]);
 		return (CMD_RETURN_NORMAL);
 	}
 }
-
-void
-cmd_pipe_pane_error_callback(
-    unused struct bufferevent *bufev, unused short what, void *data)
-{
-	struct window_pane	*wp = data;
-
-	bufferevent_free(wp->pipe_event);
-	close(wp->pipe_fd);
-	wp->pipe_fd = -1;
-}
@@ -18,6 +18,9 @@
 
 #include <sys/types.h>
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "tmux.h"
 
 /*
@@ -26,10 +29,13 @@
 
 enum cmd_retval	 cmd_refresh_client_exec(struct cmd *, struct cmd_q *);
 
+int	cmd_refresh_client_flags(struct cmd_q *, struct client *, const char *);
+int	cmd_refresh_client_pane(struct cmd_q *, struct client *, const char *);
+
 const struct cmd_entry cmd_refresh_client_entry = {
 	"refresh-client", "refresh",
-	"C:St:", 0, 0,
-	"[-S] [-C size]" CMD_TARGET_CLIENT_USAGE,
+	"A:C:f:St:", 0, 0,
+	"[-S] [-A pane:state] [-C size] [-f flags] " CMD_TARGET_CLIENT_USAGE,
 	0,
 	NULL,
 	NULL,
@@ -47,7 +53,18 @@ cmd_refresh_client_exec(struct cmd *self, struct cmd_q *cmdq)
 	if ((c = cmd_find_client(cmdq, args_get(args, 't'), 0)) == NULL)
 		return (CMD_RETURN_ERROR);
 
-	if (args_has(args, 'C')) {
+	if (args_has(args, 'A') || args_has(args, 'f')) {
+		if (!(c->flags & CLIENT_CONTROL)) {
+			cmdq_error(cmdq, "not a control client");
+			return (CMD_RETURN_ERROR);
+		}
+		if (args_has(args, 'f') &&
+		    cmd_refresh_client_flags(cmdq, c, args_get(args, 'f')) != 0)
+			return (CMD_RETURN_ERROR);
+		if (args_has(args, 'A') &&
+		    cmd_refresh_client_pane(cmdq, c, args_get(args, 'A')) != 0)
+			return (CMD_RETURN_ERROR);
+	} else if (args_has(args, 'C')) {
 		if ((size = args_get(args, 'C')) == NULL) {
 			cmdq_error(cmdq, "missing size");
 			return (CMD_RETURN_ERROR);
@@ -68,10 +85,59 @@ cmd_refresh_client_exec(struct cmd *self, struct cmd_q *cmdq)
 		if (tty_set_size(&c->tty, w, h))
 			recalculate_sizes();
 	} else if (args_has(args, 'S')) {
-		status_update_jobs(c);
+		status_update_jobs();
 		server_status_client(c);
-	} else
+	} else {
+		tty_invalidate(&c->tty);
 		server_redraw_client(c);
+	}
 
 	return (CMD_RETURN_NORMAL);
 }
+
+/* Set control mode flags. */
+int
+cmd_refresh_client_flags(struct cmd_q *cmdq, struct client *c,
+    const char *flags)
+{
+	char	*cause;
+
+	if (control_set_flags(c, flags, &cause) != 0) {
+		cmdq_error(cmdq, "%s", cause);
+		free(cause);
+		return (-1);
+	}
+	return (0);
+}
+
+/* Pause or continue output from a pane, given as pane:state. */
+int
+cmd_refresh_client_pane(struct cmd_q *cmdq, struct client *c, const char *arg)
+{
+	struct window_pane	*wp;
+	char			*copy, *state;
+	int			 retval = -1;
+
+	copy = xstrdup(arg);
+	if ((state = strrchr(copy, ':')) == NULL) {
+		cmdq_error(cmdq, "bad pane argument: %s", arg);
+		goto out;
+	}
+	*state++ = '\0';
+
+	if (cmd_find_pane(cmdq, copy, NULL, &wp) == NULL)
+		goto out;
+	if (strcmp(state, "pause") == 0)
+		control_pause_pane(c, wp);
+	else if (strcmp(state, "continue") == 0)
+		control_continue_pane(c, wp);
+	else {
+		cmdq_error(cmdq, "bad pane state: %s", state);
+		goto out;
+	}
+	retval = 0;
+
+out:
+	free(copy);
+	return (retval);
+}
@@ -55,8 +55,10 @@ cmd_server_info_exec(unused struct cmd *self, struct cmd_q *cmdq)
 	const struct tty_term_code_entry	*ent;
 	struct utsname				 un;
 	struct job				*job;
+	struct status_job			*sj;
+	unsigned long long			 msec;
 	struct grid				*gd;
-	struct grid_line			*gl;
+	const struct grid_line			*gl;
 	u_int		 			 i, j, k, lines;
 	size_t					 size;
 	char					 out[80];
@@ -114,13 +116,21 @@ cmd_server_info_exec(unused struct cmd *self, struct cmd_q *cmdq)
 			TAILQ_FOREACH(wp, &w->panes, entry) {
 				lines = size = 0;
 				gd = wp->base.grid;
-				for (k = 0; k < gd->hsize + gd->sy; k++) {
-					gl = &gd->linedata[k];
+				for (k = gd->ssize;
+				    k < gd->hsize + gd->sy; k++) {
+					gl = grid_peek_line(gd, k);
+					if (gl->flags & GRID_LINE_PACKED) {
+						lines++;
+						size += gl->packsize;
+						continue;
+					}
 					if (gl->celldata == NULL)
 						continue;
 					lines++;
 					size += gl->cellsize *
 					    sizeof *gl->celldata;
+					size += gl->extdsize *
+					    sizeof *gl->extddata;
 				}
 				cmdq_print(cmdq,
 				    "%6u: %s %lu %d %u/%u, %zu bytes", j,
@@ -169,6 +179,21 @@ cmd_server_info_exec(unused struct cmd *self, struct cmd_q *cmdq)
 		cmdq_print(cmdq, "%s [fd=%d, pid=%d, status=%d]",
 		    job->cmd, job->fd, job->pid, job->status);
 	}
+	cmdq_print(cmdq, "%s", "");
+
+	cmdq_print(cmdq, "Status jobs:");
+	RB_FOREACH(sj, status_jobs, &status_jobs) {
+		msec = 0;
+		if (sj->runs != 0) {
+			msec = sj->total.tv_sec * 1000ULL;
+			msec = (msec + sj->total.tv_usec / 1000) / sj->runs;
+		}
+		cmdq_print(cmdq, "%s [runs=%u, hits=%u, average=%llums, "
+		    "longest=%llums%s]", sj->cmd, sj->runs, sj->hits, msec,
+		    (unsigned long long) sj->longest.tv_sec * 1000 +
+		    sj->longest.tv_usec / 1000,
+		    sj->job != NULL ? ", running" : "");
+	}
 
 	return (CMD_RETURN_NORMAL);
 }
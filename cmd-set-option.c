@@ -161,7 +161,7 @@ cmd_set_option_exec(struct cmd *self, struct cmd_q *cmdq)
 			return (CMD_RETURN_ERROR);
 	}
 
-	/* Start or stop timers when automatic-rename changed. */
+	/* Start checking names when automatic-rename changed. */
 	if (strcmp(oe->name, "automatic-rename") == 0) {
 		for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
 			if ((w = ARRAY_ITEM(&windows, i)) == NULL)
@@ -171,8 +171,6 @@ cmd_set_option_exec(struct cmd *self, struct cmd_q *cmdq)
 				if (wp->automatic_rename && options_get_number(&w->options,
 									"automatic-rename"))
 					queue_window_pane_name(wp);
-				else if (event_initialized(&wp->name_timer))
-					evtimer_del(&wp->name_timer);
 			}
 		}
 	}
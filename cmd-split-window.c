@@ -122,6 +122,8 @@ cmd_split_window_exec(struct cmd *self, struct cmd_q *cmdq)
 		goto error;
 	}
 	new_wp = window_add_pane(w, hlimit);
+	window_pane_spill_history(new_wp,
+	    options_get_number(&s->options, "history-file-limit"));
 	if (window_pane_spawn(
 	    new_wp, cmd, shell, cwd, &env, s->tio, &cause) != 0)
 		goto error;
@@ -102,7 +102,7 @@ cmd_switch_client_exec(struct cmd *self, struct cmd_q *cmdq)
 
 	if (c->session != NULL)
 		c->last_session = c->session;
-	c->session = s;
+	server_client_set_session(c, s);
 	session_update_activity(s);
 
 	recalculate_sizes();
@@ -738,14 +738,13 @@ cmd_lookup_windowid(const char *arg)
 struct session *
 cmd_window_session(struct cmd_q *cmdq, struct window *w, struct winlink **wlp)
 {
-	struct session		*s;
-	struct sessionslist	 ss;
+	struct session		*s, *sbest;
 	struct winlink		*wl;
 
 	/* If this window is in the current session, return that winlink. */
 	s = cmd_current_session(cmdq, 0);
 	if (s != NULL) {
-		wl = winlink_find_by_window(&s->windows, w);
+		wl = session_has(s, w);
 		if (wl != NULL) {
 			if (wlp != NULL)
 				*wlp = wl;
@@ -753,17 +752,22 @@ cmd_window_session(struct cmd_q *cmdq, struct window *w, struct winlink **wlp)
 		}
 	}
 
-	/* Otherwise choose from all sessions with this window. */
-	ARRAY_INIT(&ss);
-	RB_FOREACH(s, sessions, &sessions) {
-		if (winlink_find_by_window(&s->windows, w) != NULL)
-			ARRAY_ADD(&ss, s);
+	/*
+	 * Otherwise choose the most recently used of the sessions with this
+	 * window, found from its links. Ties go to the first session by name.
+	 */
+	sbest = NULL;
+	TAILQ_FOREACH(wl, &w->winlinks, wentry) {
+		s = wl->session;
+		if (sbest == NULL ||
+		    timercmp(&s->activity_time, &sbest->activity_time, >) ||
+		    (timercmp(&s->activity_time, &sbest->activity_time, ==) &&
+		    session_cmp(s, sbest) < 0))
+			sbest = s;
 	}
-	s = cmd_choose_session_list(&ss);
-	ARRAY_FREE(&ss);
 	if (wlp != NULL)
-		*wlp = winlink_find_by_window(&s->windows, w);
-	return (s);
+		*wlp = session_has(sbest, w);
+	return (sbest);
 }
 
 /* Find the target session or report an error and return NULL. */
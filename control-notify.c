@@ -26,35 +26,61 @@
 
 void
 control_notify_input(struct client *c, struct window_pane *wp,
-    struct evbuffer *input)
+    const u_char *buf, size_t len)
 {
-	u_char		*buf;
-	size_t		 len;
-	struct evbuffer *message;
-	u_int		 i;
+	struct evbuffer		*out = c->stdout_data;
+	struct control_pane	*cp;
+	size_t			 i, start, pending;
+	char			 tmp[5];
 
 	if (c->session == NULL)
 	    return;
 
-	buf = EVBUFFER_DATA(input);
-	len = EVBUFFER_LENGTH(input);
-
 	/*
 	 * Only write input if the window pane is linked to a window belonging
 	 * to the client's session.
 	 */
-	if (winlink_find_by_window(&c->session->windows, wp->window) != NULL) {
-		message = evbuffer_new();
-		evbuffer_add_printf(message, "%%output %%%u ", wp->id);
-		for (i = 0; i < len; i++) {
-			if (buf[i] < ' ' || buf[i] == '\\')
-			    evbuffer_add_printf(message, "\\%03o", buf[i]);
-			else
-			    evbuffer_add_printf(message, "%c", buf[i]);
+	if (winlink_find_by_window(&c->session->windows, wp->window) == NULL)
+		return;
+
+	/*
+	 * Drop output for paused panes. If the client is not reading fast
+	 * enough, pause the pane rather than buffering any more. Output still
+	 * to be written to stdout directly is counted exactly; if it goes
+	 * through the client instead, each message queued is counted as full.
+	 */
+	cp = control_get_pane(c, wp);
+	if (cp != NULL && cp->flags & CONTROL_PANE_PAUSED)
+		return;
+	pending = EVBUFFER_LENGTH(out);
+	if (c->stdout_event != NULL)
+		pending += EVBUFFER_LENGTH(c->stdout_event->output);
+	else
+		pending += c->ibuf.w.queued * STDIO_DATA_SIZE;
+	if (c->control_high_water != 0 && pending > c->control_high_water) {
+		control_pause_pane(c, wp);
+		control_write(c, "%%pause %%%u", wp->id);
+		return;
+	}
+
+	if (c->control_flags & CONTROL_BINARY_OUTPUT) {
+		evbuffer_add_printf(out, "%%binary-output %%%u %zu\n", wp->id,
+		    len);
+		evbuffer_add(out, buf, len);
+	} else {
+		evbuffer_add_printf(out, "%%output %%%u ", wp->id);
+		for (start = i = 0; i < len; i++) {
+			if (buf[i] >= ' ' && buf[i] != '\\')
+				continue;
+			evbuffer_add(out, buf + start, i - start);
+			xsnprintf(tmp, sizeof tmp, "\\%03o", buf[i]);
+			evbuffer_add(out, tmp, 4);
+			start = i + 1;
 		}
-		control_write_buffer(c, message);
-		evbuffer_free(message);
+		evbuffer_add(out, buf + start, len - start);
 	}
+	evbuffer_add(out, "\n", 1);
+	server_push_stdout(c);
 }
 
 void
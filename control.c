@@ -20,12 +20,25 @@
 #include <sys/types.h>
 
 #include <event.h>
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 #include "tmux.h"
 
+RB_GENERATE(control_panes, control_pane, entry, control_pane_cmp);
+
+int
+control_pane_cmp(struct control_pane *cp1, struct control_pane *cp2)
+{
+	if (cp1->pane < cp2->pane)
+		return (-1);
+	if (cp1->pane > cp2->pane)
+		return (1);
+	return (0);
+}
+
 /* Write a line. */
 void printflike2
 control_write(struct client *c, const char *fmt, ...)
@@ -49,6 +62,98 @@ control_write_buffer(struct client *c, struct evbuffer *buffer)
 	server_push_stdout(c);
 }
 
+/*
+ * Set control mode flags from a comma-separated list. binary-output sends
+ * pane output as %binary-output with a length rather than escaped; high-water
+ * is the size of pending output above which a pane is paused.
+ */
+int
+control_set_flags(struct client *c, const char *flags, char **cause)
+{
+	char		*copy, *next, *s;
+	const char	*errstr;
+	long long	 n;
+	int		 retval = -1;
+
+	copy = next = xstrdup(flags);
+	while ((s = strsep(&next, ",")) != NULL) {
+		if (*s == '\0')
+			continue;
+		if (strcmp(s, "binary-output") == 0)
+			c->control_flags |= CONTROL_BINARY_OUTPUT;
+		else if (strcmp(s, "no-binary-output") == 0)
+			c->control_flags &= ~CONTROL_BINARY_OUTPUT;
+		else if (strncmp(s, "high-water=", 11) == 0) {
+			n = strtonum(s + 11, 0, INT_MAX, &errstr);
+			if (errstr != NULL) {
+				xasprintf(cause, "high-water %s", errstr);
+				goto out;
+			}
+			c->control_high_water = n;
+		} else {
+			xasprintf(cause, "unknown flag: %s", s);
+			goto out;
+		}
+	}
+	retval = 0;
+
+out:
+	free(copy);
+	return (retval);
+}
+
+/* Get the state of a pane for a client. */
+struct control_pane *
+control_get_pane(struct client *c, struct window_pane *wp)
+{
+	struct control_pane	cp;
+
+	cp.pane = wp->id;
+	return (RB_FIND(control_panes, &c->control_panes, &cp));
+}
+
+/* Stop sending output from a pane. */
+void
+control_pause_pane(struct client *c, struct window_pane *wp)
+{
+	struct control_pane	*cp;
+
+	if ((cp = control_get_pane(c, wp)) == NULL) {
+		cp = xcalloc(1, sizeof *cp);
+		cp->pane = wp->id;
+		RB_INSERT(control_panes, &c->control_panes, cp);
+	}
+	cp->flags |= CONTROL_PANE_PAUSED;
+}
+
+/*
+ * Start sending output from a pane again. Output while it was paused is lost,
+ * so the client must ask for the pane contents.
+ */
+void
+control_continue_pane(struct client *c, struct window_pane *wp)
+{
+	struct control_pane	*cp;
+
+	if ((cp = control_get_pane(c, wp)) == NULL)
+		return;
+	RB_REMOVE(control_panes, &c->control_panes, cp);
+	free(cp);
+}
+
+/* Free pane states. */
+void
+control_free_panes(struct client *c)
+{
+	struct control_pane	*cp;
+
+	while (!RB_EMPTY(&c->control_panes)) {
+		cp = RB_ROOT(&c->control_panes);
+		RB_REMOVE(control_panes, &c->control_panes, cp);
+		free(cp);
+	}
+}
+
 /* Control input callback. Read lines and fire commands. */
 void
 control_callback(struct client *c, int closed, unused void *data)
@@ -32,9 +32,20 @@
  * string.
  */
 
-int	format_replace(struct format_tree *, const char *, size_t, char **,
-	    size_t *, size_t *);
-void	format_window_pane_tabs(struct format_tree *, struct window_pane *);
+void	format_add_entry(struct format_tree *, const char *, char *,
+	    char *(*)(void *), void *);
+struct format_op *format_add_op(struct format_template *, int);
+void	format_compile_text(struct format_template *, const char *,
+	    const char *);
+int	format_compile_key(struct format_template *, char *, char *);
+struct format_template *format_compile(const char *);
+void	format_free_template(struct format_template *);
+struct format_template *format_get_template(const char *);
+char	*format_cb_host(void *);
+char	*format_cb_window_layout(void *);
+char	*format_cb_pane_tabs(void *);
+char	*format_cb_pane_current_path(void *);
+char	*format_cb_pane_current_command(void *);
 
 /* Format key-value replacement entry. */
 RB_GENERATE(format_tree, format_entry, entry, format_cmp);
@@ -46,6 +57,26 @@ format_cmp(struct format_entry *fe1, struct format_entry *fe2)
 	return (strcmp(fe1->key, fe2->key));
 }
 
+/*
+ * Templates are compiled into a list of operations the first time they are
+ * expanded, and the most recently used are kept.
+ */
+#define FORMAT_TEMPLATES_MAX 64
+
+RB_GENERATE(format_templates, format_template, entry, format_template_cmp);
+
+struct format_templates	format_templates = RB_INITIALIZER(&format_templates);
+u_int			format_templates_count;
+u_int			format_templates_used;
+
+/* Format template comparison function. */
+int
+format_template_cmp(struct format_template *ftp1,
+    struct format_template *ftp2)
+{
+	return (strcmp(ftp1->fmt, ftp2->fmt));
+}
+
 /* Single-character aliases. */
 const char *format_aliases[26] = {
 	NULL,		/* A */
@@ -81,13 +112,11 @@ struct format_tree *
 format_create(void)
 {
 	struct format_tree	*ft;
-	char			 host[MAXHOSTNAMELEN];
 
 	ft = xmalloc(sizeof *ft);
 	RB_INIT(ft);
 
-	if (gethostname(host, sizeof host) == 0)
-		format_add(ft, "host", "%s", host);
+	format_add_cb(ft, "host", format_cb_host, NULL);
 
 	return (ft);
 }
@@ -112,30 +141,59 @@ format_free(struct format_tree *ft)
 	free (ft);
 }
 
-/* Add a key-value pair. */
+/* Add an entry, replacing any existing with the same key. */
 void
-format_add(struct format_tree *ft, const char *key, const char *fmt, ...)
+format_add_entry(struct format_tree *ft, const char *key, char *value,
+    char *(*cb)(void *), void *arg)
 {
 	struct format_entry	*fe;
 	struct format_entry	*fe_now;
-	va_list			 ap;
 
 	fe = xmalloc(sizeof *fe);
 	fe->key = xstrdup(key);
-
-	va_start(ap, fmt);
-	xvasprintf(&fe->value, fmt, ap);
-	va_end(ap);
+	fe->value = value;
+	fe->cb = cb;
+	fe->arg = arg;
 
 	fe_now = RB_INSERT(format_tree, ft, fe);
 	if (fe_now != NULL) {
 		free(fe_now->value);
 		fe_now->value = fe->value;
+		fe_now->cb = fe->cb;
+		fe_now->arg = fe->arg;
 		free(fe->key);
 		free(fe);
 	}
 }
 
+/* Add a key-value pair. */
+void
+format_add(struct format_tree *ft, const char *key, const char *fmt, ...)
+{
+	char	*value;
+	va_list	 ap;
+
+	va_start(ap, fmt);
+	xvasprintf(&value, fmt, ap);
+	va_end(ap);
+
+	format_add_entry(ft, key, value, NULL, NULL);
+}
+
+/*
+ * Add a key whose value is found by calling a function the first time it is
+ * looked up, so keys which are expensive to work out cost nothing unless they
+ * are used. The function returns an allocated string, or NULL if the key
+ * should be treated as missing. The tree must be expanded while arg is still
+ * valid.
+ */
+void
+format_add_cb(struct format_tree *ft, const char *key, char *(*cb)(void *),
+    void *arg)
+{
+	format_add_entry(ft, key, NULL, cb, arg);
+}
+
 /* Find a format entry. */
 const char *
 format_find(struct format_tree *ft, const char *key)
@@ -146,129 +204,227 @@ format_find(struct format_tree *ft, const char *key)
 	fe = RB_FIND(format_tree, ft, &fe_find);
 	if (fe == NULL)
 		return (NULL);
+	if (fe->cb != NULL) {
+		fe->value = fe->cb(fe->arg);
+		fe->cb = NULL;
+	}
 	return (fe->value);
 }
 
+/* Add an operation to a template. */
+struct format_op *
+format_add_op(struct format_template *ftp, int type)
+{
+	struct format_op	*op;
+
+	ftp->ops = xrealloc(ftp->ops, ftp->nops + 1, sizeof *ftp->ops);
+	op = &ftp->ops[ftp->nops++];
+	memset(op, 0, sizeof *op);
+	op->type = type;
+	return (op);
+}
+
+/* Add text to a template, joining it to the last operation if possible. */
+void
+format_compile_text(struct format_template *ftp, const char *start,
+    const char *end)
+{
+	struct format_op	*op;
+
+	if (end == start)
+		return;
+
+	if (ftp->nops != 0) {
+		op = &ftp->ops[ftp->nops - 1];
+		if (op->type == FORMAT_TEXT && op->text + op->textlen == start) {
+			op->textlen += end - start;
+			return;
+		}
+	}
+	op = format_add_op(ftp, FORMAT_TEXT);
+	op->text = start;
+	op->textlen = end - start;
+}
+
 /*
- * Replace a key/value pair in buffer. #{blah} is expanded directly,
- * #{?blah,a,b} is replace with a if blah exists and is nonzero else b.
+ * Compile a #{} entry, from key to end (the closing brace). #{blah} is
+ * expanded directly, #{?blah,a,b} is replaced with a if blah exists and is
+ * nonzero else b.
  */
 int
-format_replace(struct format_tree *ft,
-    const char *key, size_t keylen, char **buf, size_t *len, size_t *off)
+format_compile_key(struct format_template *ftp, char *key, char *end)
 {
-	char		*copy, *ptr;
-	const char	*value;
-	size_t		 valuelen;
-
-	/* Make a copy of the key. */
-	copy = xmalloc(keylen + 1);
-	memcpy(copy, key, keylen);
-	copy[keylen] = '\0';
-
-	/*
-	 * Is this a conditional? If so, check it exists and extract either the
-	 * first or second element. If not, look up the key directly.
-	 */
-	if (*copy == '?') {
-		ptr = strchr(copy, ',');
-		if (ptr == NULL)
-			goto fail;
-		*ptr = '\0';
-
-		value = format_find(ft, copy + 1);
-		if (value != NULL && (value[0] != '0' || value[1] != '\0')) {
-			value = ptr + 1;
-			ptr = strchr(value, ',');
-			if (ptr == NULL)
-				goto fail;
-			*ptr = '\0';
-		} else {
-			ptr = strchr(ptr + 1, ',');
-			if (ptr == NULL)
-				goto fail;
-			value = ptr + 1;
-		}
-	} else {
-		value = format_find(ft, copy);
-		if (value == NULL)
-			value = "";
-	}
-	valuelen = strlen(value);
+	struct format_op	*op;
+	char			*ptr, *other;
+
+	*end = '\0';
 
-	/* Expand the buffer and copy in the value. */
-	while (*len - *off < valuelen + 1) {
-		*buf = xrealloc(*buf, 2, *len);
-		*len *= 2;
+	if (*key != '?') {
+		op = format_add_op(ftp, FORMAT_KEY);
+		op->key = key;
+		return (0);
 	}
-	memcpy(*buf + *off, value, valuelen);
-	*off += valuelen;
 
-	free(copy);
+	if ((ptr = strchr(key, ',')) == NULL)
+		return (-1);
+	*ptr++ = '\0';
+	if ((other = strchr(ptr, ',')) == NULL)
+		return (-1);
+	other++;
+
+	op = format_add_op(ftp, FORMAT_CONDITION);
+	op->key = key + 1;
+	op->text = ptr;
+	op->textlen = other - 1 - ptr;
+	op->other = other;
+	op->otherlen = end - other;
 	return (0);
+}
+
+/*
+ * Compile a template. The keys and text in the operations point into a copy
+ * of the template. Anything after a bad #{} entry is ignored.
+ */
+struct format_template *
+format_compile(const char *fmt)
+{
+	struct format_template	*ftp;
+	struct format_op	*op;
+	char			*ptr, *start, *end;
+	int			 ch;
+
+	ftp = xcalloc(1, sizeof *ftp);
+	ftp->fmt = xstrdup(fmt);
+	ftp->buf = xstrdup(fmt);
+
+	start = ptr = ftp->buf;
+	while (*ptr != '\0') {
+		if (*ptr != '#') {
+			ptr++;
+			continue;
+		}
+
+		ch = (u_char) ptr[1];
+		if (ch == '{') {
+			format_compile_text(ftp, start, ptr);
+			ptr += 2;
+
+			end = strchr(ptr, '}');
+			if (end == NULL || format_compile_key(ftp, ptr, end) != 0)
+				return (ftp);
+			start = ptr = end + 1;
+			continue;
+		}
+		if (ch >= 'A' && ch <= 'Z' && format_aliases[ch - 'A'] != NULL) {
+			format_compile_text(ftp, start, ptr);
+
+			op = format_add_op(ftp, FORMAT_KEY);
+			op->key = format_aliases[ch - 'A'];
+			start = ptr = ptr + 2;
+			continue;
+		}
+
+		/* Not a key, keep the # and the following character. */
+		ptr++;
+		if (*ptr != '\0')
+			ptr++;
+	}
+	format_compile_text(ftp, start, ptr);
+
+	return (ftp);
+}
+
+/* Free a compiled template. */
+void
+format_free_template(struct format_template *ftp)
+{
+	free(ftp->ops);
+	free(ftp->buf);
+	free(ftp->fmt);
+	free(ftp);
+}
+
+/*
+ * Get the compiled template for a string, compiling it if it isn't cached. If
+ * the cache is full, the least recently used template is removed.
+ */
+struct format_template *
+format_get_template(const char *fmt)
+{
+	struct format_template	*ftp, *ftp_last, ftp_find;
+
+	ftp_find.fmt = (char *) fmt;
+	ftp = RB_FIND(format_templates, &format_templates, &ftp_find);
+	if (ftp == NULL) {
+		if (format_templates_count == FORMAT_TEMPLATES_MAX) {
+			ftp_last = NULL;
+			RB_FOREACH(ftp, format_templates, &format_templates) {
+				if (ftp_last == NULL || ftp->used < ftp_last->used)
+					ftp_last = ftp;
+			}
+			RB_REMOVE(format_templates, &format_templates, ftp_last);
+			format_free_template(ftp_last);
+			format_templates_count--;
+		}
 
-fail:
-	free(copy);
-	return (-1);
+		ftp = format_compile(fmt);
+		RB_INSERT(format_templates, &format_templates, ftp);
+		format_templates_count++;
+	}
+	ftp->used = ++format_templates_used;
+
+	return (ftp);
 }
 
 /* Expand keys in a template. */
 char *
 format_expand(struct format_tree *ft, const char *fmt)
 {
-	char		*buf, *ptr;
-	const char	*s;
-	size_t		 off, len, n;
-	int     	 ch;
+	struct format_template	*ftp;
+	struct format_op	*op;
+	char			*buf;
+	const char		*value;
+	size_t			 off, len, valuelen;
+	u_int			 i;
+
+	ftp = format_get_template(fmt);
 
 	len = 64;
 	buf = xmalloc(len);
 	off = 0;
 
-	while (*fmt != '\0') {
-		if (*fmt != '#') {
-			while (len - off < 2) {
-				buf = xrealloc(buf, 2, len);
-				len *= 2;
+	for (i = 0; i < ftp->nops; i++) {
+		op = &ftp->ops[i];
+		switch (op->type) {
+		case FORMAT_TEXT:
+			value = op->text;
+			valuelen = op->textlen;
+			break;
+		case FORMAT_KEY:
+			value = format_find(ft, op->key);
+			if (value == NULL)
+				value = "";
+			valuelen = strlen(value);
+			break;
+		case FORMAT_CONDITION:
+			value = format_find(ft, op->key);
+			if (value != NULL &&
+			    (value[0] != '0' || value[1] != '\0')) {
+				value = op->text;
+				valuelen = op->textlen;
+			} else {
+				value = op->other;
+				valuelen = op->otherlen;
 			}
-			buf[off++] = *fmt++;
-			continue;
-		}
-		fmt++;
-
-		ch = (u_char) *fmt++;
-		switch (ch) {
-		case '{':
-			ptr = strchr(fmt, '}');
-			if (ptr == NULL)
-				break;
-			n = ptr - fmt;
-
-			if (format_replace(ft, fmt, n, &buf, &len, &off) != 0)
-				break;
-			fmt += n + 1;
-			continue;
-		default:
-			if (ch >= 'A' && ch <= 'Z') {
-				s = format_aliases[ch - 'A'];
-				if (s != NULL) {
-					n = strlen(s);
-					if (format_replace (
-					    ft, s, n, &buf, &len, &off) != 0)
-						break;
-					continue;
-				}
-			}
-			while (len - off < 3) {
-				buf = xrealloc(buf, 2, len);
-				len *= 2;
-			}
-			buf[off++] = '#';
-			buf[off++] = ch;
-			continue;
+			break;
 		}
 
-		break;
+		while (len - off < valuelen + 1) {
+			buf = xrealloc(buf, 2, len);
+			len *= 2;
+		}
+		memcpy(buf + off, value, valuelen);
+		off += valuelen;
 	}
 	buf[off] = '\0';
 
@@ -357,9 +513,8 @@ void
 format_winlink(struct format_tree *ft, struct session *s, struct winlink *wl)
 {
 	struct window	*w = wl->window;
-	char		*layout, *flags;
+	char		*flags;
 
-	layout = layout_dump(w);
 	flags = window_printable_flags(s, wl);
 
 	format_add(ft, "window_id", "@%u", w->id);
@@ -368,20 +523,41 @@ format_winlink(struct format_tree *ft, struct session *s, struct winlink *wl)
 	format_add(ft, "window_width", "%u", w->sx);
 	format_add(ft, "window_height", "%u", w->sy);
 	format_add(ft, "window_flags", "%s", flags);
-	format_add(ft, "window_layout", "%s", layout);
+	format_add_cb(ft, "window_layout", format_cb_window_layout, w);
 	format_add(ft, "window_active", "%d", wl == s->curw);
 	format_add(ft, "window_panes", "%u", window_count_panes(w));
 
 	free(flags);
-	free(layout);
 }
 
-/* Add window pane tabs. */
-void
-format_window_pane_tabs(struct format_tree *ft, struct window_pane *wp)
+/* Callback for host. */
+char *
+format_cb_host(unused void *arg)
+{
+	char	host[MAXHOSTNAMELEN];
+
+	if (gethostname(host, sizeof host) != 0)
+		return (NULL);
+	return (xstrdup(host));
+}
+
+/* Callback for window_layout. */
+char *
+format_cb_window_layout(void *arg)
 {
-	struct evbuffer	*buffer;
-	u_int		 i;
+	struct window	*w = arg;
+
+	return (layout_dump(w));
+}
+
+/* Callback for pane_tabs. */
+char *
+format_cb_pane_tabs(void *arg)
+{
+	struct window_pane	*wp = arg;
+	struct evbuffer		*buffer;
+	char			*value;
+	u_int			 i;
 
 	buffer = evbuffer_new();
 	for (i = 0; i < wp->base.grid->sx; i++) {
@@ -393,31 +569,44 @@ format_window_pane_tabs(struct format_tree *ft, struct window_pane *wp)
 		evbuffer_add_printf(buffer, "%d", i);
 	}
 
-	format_add(ft, "pane_tabs", "%.*s", (int) EVBUFFER_LENGTH(buffer),
+	xasprintf(&value, "%.*s", (int) EVBUFFER_LENGTH(buffer),
 	    EVBUFFER_DATA(buffer));
 	evbuffer_free(buffer);
+	return (value);
+}
+
+/* Callback for pane_current_path. */
+char *
+format_cb_pane_current_path(void *arg)
+{
+	struct window_pane	*wp = arg;
+	const char		*cwd;
+
+	if ((cwd = osdep_get_cwd(wp->fd)) == NULL)
+		return (NULL);
+	return (xstrdup(cwd));
+}
+
+/* Callback for pane_current_command. */
+char *
+format_cb_pane_current_command(void *arg)
+{
+	struct window_pane	*wp = arg;
+
+	return (osdep_get_name(wp->fd, wp->tty));
 }
 
 /* Set default format keys for a window pane. */
 void
 format_window_pane(struct format_tree *ft, struct window_pane *wp)
 {
-	struct grid		*gd = wp->base.grid;
-	struct grid_line	*gl;
-	unsigned long long	 size;
-	u_int			 i, idx;
-	const char		*cwd;
-	char			*cmd;
+	struct grid	*gd = wp->base.grid;
+	u_int		 idx;
 
-	size = 0;
-	for (i = 0; i < gd->hsize; i++) {
-		gl = &gd->linedata[i];
-		size += gl->cellsize * sizeof *gl->celldata;
-	}
-	size += gd->hsize * sizeof *gd->linedata;
 	format_add(ft, "history_size", "%u", gd->hsize);
 	format_add(ft, "history_limit", "%u", gd->hlimit);
-	format_add(ft, "history_bytes", "%llu", size);
+	format_add(ft, "history_bytes", "%zu", gd->hbytes);
+	format_add(ft, "history_file_size", "%u", gd->ssize);
 
 	if (window_pane_index(wp, &idx) != 0)
 		fatalx("index not found");
@@ -440,12 +629,9 @@ format_window_pane(struct format_tree *ft, struct window_pane *wp)
 		format_add(ft, "pane_start_command", "%s", wp->cmd);
 	if (wp->cwd != NULL)
 		format_add(ft, "pane_start_path", "%s", wp->cwd);
-	if ((cwd = osdep_get_cwd(wp->fd)) != NULL)
-		format_add(ft, "pane_current_path", "%s", cwd);
-	if ((cmd = osdep_get_name(wp->fd, wp->tty)) != NULL) {
-		format_add(ft, "pane_current_command", "%s", cmd);
-		free(cmd);
-	}
+	format_add_cb(ft, "pane_current_path", format_cb_pane_current_path, wp);
+	format_add_cb(ft, "pane_current_command", format_cb_pane_current_command,
+	    wp);
 
 	format_add(ft, "cursor_x", "%d", wp->base.cx);
 	format_add(ft, "cursor_y", "%d", wp->base.cy);
@@ -478,7 +664,7 @@ format_window_pane(struct format_tree *ft, struct window_pane *wp)
 	format_add(ft, "mouse_utf8_flag", "%d",
 	    !!(wp->base.mode & MODE_MOUSE_UTF8));
 
-	format_window_pane_tabs(ft, wp);
+	format_add_cb(ft, "pane_tabs", format_cb_pane_tabs, wp);
 }
 
 /* Set default format keys for paste buffer. */
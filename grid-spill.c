@@ -0,0 +1,416 @@
+/* $Id$ */
+
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF MIND, USE, DATA OR PROFITS, WHETHER
+ * IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING
+ * OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tmux.h"
+
+/*
+ * History spilled to a file. When a grid with a spill collects history, the
+ * oldest lines are packed and appended to the data file (with their offsets
+ * appended to the index) rather than freed. They are read back by mapping the
+ * files, and a few are kept unpacked in a cache so they can be returned like
+ * lines in the grid.
+ *
+ * Lines dropped from the front of the file are just skipped until they make
+ * up more than the limit, then the wanted lines are copied into new files.
+ */
+
+/* Number of lines kept unpacked and amount of data buffered before writing. */
+#define GRID_SPILL_CACHE 64
+#define GRID_SPILL_BUFFER 65536
+
+int	grid_spill_open(struct grid_spill *);
+void	grid_spill_close(struct grid_spill *);
+void	grid_spill_fail(struct grid_spill *, const char *);
+int	grid_spill_write(int, const u_char *, size_t);
+int	grid_spill_flush(struct grid_spill *);
+int	grid_spill_map(struct grid_spill *);
+void	grid_spill_unmap(struct grid_spill *);
+void	grid_spill_compact(struct grid_spill *);
+
+/* Create spill for a file path. The files are not opened until needed. */
+struct grid_spill *
+grid_spill_create(const char *path, u_int limit)
+{
+	struct grid_spill	*sp;
+
+	sp = xcalloc(1, sizeof *sp);
+	sp->path = xstrdup(path);
+	xasprintf(&sp->ipath, "%s.index", path);
+	sp->fd = sp->ifd = -1;
+
+	sp->limit = limit;
+
+	sp->cache = xcalloc(GRID_SPILL_CACHE, sizeof *sp->cache);
+	sp->cachekey = xcalloc(GRID_SPILL_CACHE, sizeof *sp->cachekey);
+
+	return (sp);
+}
+
+/* Destroy spill and remove the files. */
+void
+grid_spill_destroy(struct grid_spill *sp)
+{
+	u_int	i;
+
+	grid_spill_close(sp);
+	unlink(sp->path);
+	unlink(sp->ipath);
+
+	for (i = 0; i < GRID_SPILL_CACHE; i++) {
+		free(sp->cache[i].celldata);
+		free(sp->cache[i].extddata);
+	}
+	free(sp->cache);
+	free(sp->cachekey);
+
+	free(sp->buf);
+	free(sp->ibuf);
+
+	free(sp->path);
+	free(sp->ipath);
+	free(sp);
+}
+
+/* Open the files. */
+int
+grid_spill_open(struct grid_spill *sp)
+{
+	sp->fd = open(sp->path, O_RDWR|O_CREAT|O_TRUNC, 0600);
+	if (sp->fd == -1) {
+		grid_spill_fail(sp, "open");
+		return (-1);
+	}
+	sp->ifd = open(sp->ipath, O_RDWR|O_CREAT|O_TRUNC, 0600);
+	if (sp->ifd == -1) {
+		grid_spill_fail(sp, "open");
+		return (-1);
+	}
+
+	sp->buf = xmalloc(GRID_SPILL_BUFFER);
+	sp->ibuf = xmalloc(GRID_SPILL_BUFFER);
+	return (0);
+}
+
+/* Unmap and close the files. */
+void
+grid_spill_close(struct grid_spill *sp)
+{
+	grid_spill_unmap(sp);
+
+	if (sp->fd != -1)
+		close(sp->fd);
+	sp->fd = -1;
+	if (sp->ifd != -1)
+		close(sp->ifd);
+	sp->ifd = -1;
+}
+
+/*
+ * Give up on the files after an error. Lines already in them read as empty
+ * and no more are added.
+ */
+void
+grid_spill_fail(struct grid_spill *sp, const char *what)
+{
+	log_debug("%s: %s failed: %s", sp->path, what, strerror(errno));
+
+	grid_spill_close(sp);
+	sp->failed = 1;
+}
+
+/* Write all of a buffer. */
+int
+grid_spill_write(int fd, const u_char *buf, size_t len)
+{
+	ssize_t	n;
+
+	while (len > 0) {
+		n = write(fd, buf, len);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+		buf += n;
+		len -= n;
+	}
+	return (0);
+}
+
+/* Write out any buffered data. */
+int
+grid_spill_flush(struct grid_spill *sp)
+{
+	if (sp->failed)
+		return (-1);
+
+	if (sp->buflen != 0) {
+		if (grid_spill_write(sp->fd, sp->buf, sp->buflen) != 0) {
+			grid_spill_fail(sp, "write");
+			return (-1);
+		}
+		sp->buflen = 0;
+	}
+	if (sp->ibuflen != 0) {
+		if (grid_spill_write(sp->ifd, sp->ibuf, sp->ibuflen) != 0) {
+			grid_spill_fail(sp, "write");
+			return (-1);
+		}
+		sp->ibuflen = 0;
+	}
+	return (0);
+}
+
+/* Map the files, mapping them again if they have grown. */
+int
+grid_spill_map(struct grid_spill *sp)
+{
+	size_t	isize;
+
+	if (grid_spill_flush(sp) != 0)
+		return (-1);
+
+	isize = sp->total * sizeof (uint64_t);
+	if (sp->mapsize == (size_t) sp->size && sp->imapsize == isize)
+		return (0);
+	grid_spill_unmap(sp);
+
+	sp->map = mmap(NULL, sp->size, PROT_READ, MAP_SHARED, sp->fd, 0);
+	if (sp->map == MAP_FAILED) {
+		sp->map = NULL;
+		grid_spill_fail(sp, "mmap");
+		return (-1);
+	}
+	sp->mapsize = sp->size;
+
+	sp->imap = mmap(NULL, isize, PROT_READ, MAP_SHARED, sp->ifd, 0);
+	if (sp->imap == MAP_FAILED) {
+		sp->imap = NULL;
+		grid_spill_fail(sp, "mmap");
+		return (-1);
+	}
+	sp->imapsize = isize;
+
+	return (0);
+}
+
+/* Unmap the files. */
+void
+grid_spill_unmap(struct grid_spill *sp)
+{
+	if (sp->map != NULL)
+		munmap(sp->map, sp->mapsize);
+	sp->map = NULL;
+	sp->mapsize = 0;
+
+	if (sp->imap != NULL)
+		munmap(sp->imap, sp->imapsize);
+	sp->imap = NULL;
+	sp->imapsize = 0;
+}
+
+/*
+ * Append a line. It is packed to be written so the caller must free it
+ * afterwards. Returns -1 if it could not be added.
+ */
+int
+grid_spill_add(struct grid_spill *sp, struct grid_line *gl)
+{
+	struct grid_spill_entry	 entry;
+	uint64_t		 offset;
+	size_t			 len;
+
+	if (sp->failed)
+		return (-1);
+	if (sp->fd == -1 && grid_spill_open(sp) != 0)
+		return (-1);
+
+	grid_pack_line(gl);
+
+	entry.cellsize = gl->cellsize;
+	entry.packsize = gl->packsize;
+	entry.flags = gl->flags & ~GRID_LINE_PACKED;
+	len = sizeof entry + entry.packsize;
+
+	if (sp->buflen + len > GRID_SPILL_BUFFER ||
+	    sp->ibuflen + sizeof offset > GRID_SPILL_BUFFER) {
+		if (grid_spill_flush(sp) != 0)
+			return (-1);
+	}
+
+	offset = sp->size;
+	memcpy(sp->ibuf + sp->ibuflen, &offset, sizeof offset);
+	sp->ibuflen += sizeof offset;
+
+	if (len > GRID_SPILL_BUFFER) {
+		if (grid_spill_write(sp->fd, (u_char *) &entry,
+		    sizeof entry) != 0 ||
+		    grid_spill_write(sp->fd, gl->packdata, gl->packsize) != 0) {
+			grid_spill_fail(sp, "write");
+			return (-1);
+		}
+	} else {
+		memcpy(sp->buf + sp->buflen, &entry, sizeof entry);
+		if (entry.packsize != 0) {
+			memcpy(sp->buf + sp->buflen + sizeof entry,
+			    gl->packdata, entry.packsize);
+		}
+		sp->buflen += len;
+	}
+
+	sp->size += len;
+	sp->total++;
+	return (0);
+}
+
+/* Drop the oldest line. */
+void
+grid_spill_drop(struct grid_spill *sp)
+{
+	if (sp->first == sp->total)
+		return;
+	sp->first++;
+	sp->dropped++;
+
+	if (sp->first > sp->limit)
+		grid_spill_compact(sp);
+}
+
+/* Copy the wanted lines into new files and replace the old ones. */
+void
+grid_spill_compact(struct grid_spill *sp)
+{
+	char		*path, *ipath;
+	int		 fd, ifd;
+	uint64_t	 base, offset;
+	u_int		 i;
+
+	if (grid_spill_map(sp) != 0)
+		return;
+
+	xasprintf(&path, "%s.new", sp->path);
+	xasprintf(&ipath, "%s.new", sp->ipath);
+	fd = open(path, O_RDWR|O_CREAT|O_TRUNC, 0600);
+	ifd = open(ipath, O_RDWR|O_CREAT|O_TRUNC, 0600);
+	if (fd == -1 || ifd == -1)
+		goto fail;
+
+	memcpy(&base, sp->imap + sp->first * sizeof base, sizeof base);
+	if (grid_spill_write(fd, sp->map + base, sp->size - base) != 0)
+		goto fail;
+
+	sp->ibuflen = 0;
+	for (i = sp->first; i < sp->total; i++) {
+		memcpy(&offset, sp->imap + i * sizeof offset, sizeof offset);
+		offset -= base;
+		memcpy(sp->ibuf + sp->ibuflen, &offset, sizeof offset);
+		sp->ibuflen += sizeof offset;
+
+		if (sp->ibuflen == GRID_SPILL_BUFFER) {
+			if (grid_spill_write(ifd, sp->ibuf, sp->ibuflen) != 0)
+				goto fail;
+			sp->ibuflen = 0;
+		}
+	}
+	if (grid_spill_write(ifd, sp->ibuf, sp->ibuflen) != 0)
+		goto fail;
+	sp->ibuflen = 0;
+
+	if (rename(path, sp->path) != 0 || rename(ipath, sp->ipath) != 0)
+		goto fail;
+	free(path);
+	free(ipath);
+
+	grid_spill_close(sp);
+	sp->fd = fd;
+	sp->ifd = ifd;
+
+	sp->size -= base;
+	sp->total -= sp->first;
+	sp->first = 0;
+	return;
+
+fail:
+	grid_spill_fail(sp, "compact");
+	if (fd != -1) {
+		close(fd);
+		unlink(path);
+	}
+	if (ifd != -1) {
+		close(ifd);
+		unlink(ipath);
+	}
+	free(path);
+	free(ipath);
+}
+
+/*
+ * Get a line, where 0 is the oldest line. The line is only valid until a few
+ * more lines are read.
+ */
+struct grid_line *
+grid_spill_get(struct grid_spill *sp, u_int n)
+{
+	struct grid_spill_entry	 entry;
+	struct grid_line	*gl;
+	uint64_t		 offset;
+	u_int			 key, i;
+
+	/* Lines are named by the number of lines before them ever spilled. */
+	key = sp->dropped + n + 1;
+	for (i = 0; i < GRID_SPILL_CACHE; i++) {
+		if (sp->cachekey[i] == key)
+			return (&sp->cache[i]);
+	}
+
+	i = sp->cachenext++ % GRID_SPILL_CACHE;
+	gl = &sp->cache[i];
+	free(gl->celldata);
+	free(gl->extddata);
+	memset(gl, 0, sizeof *gl);
+	sp->cachekey[i] = key;
+
+	if (n >= sp->total - sp->first || grid_spill_map(sp) != 0)
+		return (gl);
+
+	memcpy(&offset, sp->imap + (sp->first + n) * sizeof offset,
+	    sizeof offset);
+	memcpy(&entry, sp->map + offset, sizeof entry);
+
+	gl->cellsize = entry.cellsize;
+	gl->flags = entry.flags;
+	if (entry.packsize != 0) {
+		gl->packdata = xmalloc(entry.packsize);
+		memcpy(gl->packdata, sp->map + offset + sizeof entry,
+		    entry.packsize);
+		gl->packsize = entry.packsize;
+		gl->flags |= GRID_LINE_PACKED;
+		grid_unpack_line(gl);
+	}
+	return (gl);
+}
@@ -33,22 +33,77 @@
  * (hsize - 1); from hsize to hsize + (sy - 1) is the viewable data. All
  * functions in this file work on absolute coordinates, grid-view.c has
  * functions which work on the screen data.
+ *
+ * Lines hold a struct grid_cell_entry for each cell rather than a full struct
+ * grid_cell. The attribute, flags and colours of each cell are interned into
+ * a table of styles shared by every grid, and the entry holds the index into
+ * it along with the character. Cells that don't fit this - UTF-8 characters,
+ * or any cell once the table is full - are kept whole in an extended array on
+ * the line.
+ *
+ * Lines more than GRID_HOT_LINES into the history are packed: the entries are
+ * run-length encoded into a single buffer and the cells freed. They are
+ * unpacked again when something asks for the line with grid_get_line and
+ * packed again once enough other old lines have been unpacked after them.
+ *
+ * If the grid has a spill, lines collected from the history are written to a
+ * file rather than freed (see grid-spill.c). They are still counted in hsize
+ * and are lines 0 to ssize - 1; the ring starts at line ssize.
  */
 
 /* Default grid cell data. */
 const struct grid_cell grid_default_cell = { 0, 0, 8, 8, (1 << 4) | 1, " " };
 const struct grid_cell grid_marker_cell = { 0, 0, 8, 8, (1 << 4) | 1, "_" };
 
-#define grid_put_cell(gd, px, py, gc) do {			\
-	memcpy(&gd->linedata[py].celldata[px], 			\
-	    gc, sizeof gd->linedata[py].celldata[px]);		\
-} while (0)
-#define grid_put_utf8(gd, px, py, gc) do {			\
-	memcpy(&gd->linedata[py].utf8data[px], 			\
-	    gc, sizeof gd->linedata[py].utf8data[px]);		\
-} while (0)
+/* Entry for a default cell. The default style is always first in the table. */
+const struct grid_cell_entry grid_default_entry = { 0, ' ' };
+
+/*
+ * Interned styles. Each is stored as a key made from the attribute, flags and
+ * colours. The hash table holds the index plus one, or zero if empty, and is
+ * twice the maximum number of styles so it never fills.
+ */
+#define GRID_STYLE_BITS 17
+#define GRID_STYLE_HASH_SIZE (1 << GRID_STYLE_BITS)
+#define GRID_STYLE_FLAGS (GRID_FLAG_FG256|GRID_FLAG_BG256|GRID_FLAG_PADDING)
+#define grid_style_key(gc) \
+	((gc)->attr | ((gc)->flags & GRID_STYLE_FLAGS) << 8 | \
+	(gc)->fg << 16 | (u_int) (gc)->bg << 24)
+
+/* Number of history lines kept unpacked and how many may be unpacked. */
+#define GRID_HOT_LINES 2000
+#define GRID_UNPACKED_MAX 256
+
+/* Get a line from the ring without unpacking it. */
+#define grid_ring_index(gd, py) \
+	(((gd)->lineoff + (py) - (gd)->ssize) & ((gd)->linesize - 1))
+#define grid_ring_line(gd, py) (&(gd)->linedata[grid_ring_index(gd, py)])
+
+/*
+ * Packed lines are a set of runs, each a style and count (both u_short) then
+ * the data. If the top bit of the count is set, the run is a single character
+ * repeated; otherwise it is count characters, or count whole struct grid_cell
+ * for GRID_STYLE_EXTENDED.
+ */
+#define GRID_PACK_REPEAT 0x8000
+#define GRID_PACK_MAX 0x7fff
+
+u_int	*grid_styles;
+u_int	 grid_nstyles;
+u_short	*grid_style_hash;
 
 int	grid_check_y(struct grid *, u_int);
+u_short	grid_style_intern(const struct grid_cell *);
+void	grid_get_cell1(const struct grid_line *, u_int, struct grid_cell *);
+void	grid_set_cell1(struct grid_line *, u_int, const struct grid_cell *);
+void	grid_compact_line(struct grid_line *);
+void	grid_copy_cells(struct grid_line *, u_int, struct grid_line *, u_int,
+	    u_int);
+void	grid_pack_line(struct grid_line *);
+void	grid_unpack_line(struct grid_line *);
+void	grid_unpack(struct grid *, u_int);
+void	grid_pack_history(struct grid *);
+size_t	grid_line_bytes(const struct grid_line *);
 
 #ifdef DEBUG
 int
@@ -70,14 +125,414 @@ grid_check_y(struct grid *gd, u_int py)
 }
 #endif
 
-void	grid_reflow_join(struct grid *, u_int *, struct grid_line *, u_int);
-void	grid_reflow_split(struct grid *, u_int *, struct grid_line *, u_int,
-	    u_int);
-void	grid_reflow_move(struct grid *, u_int *, struct grid_line *);
+/* Find or add a style to the table. */
+u_short
+grid_style_intern(const struct grid_cell *gc)
+{
+	static u_int	last_key = UINT_MAX;
+	static u_short	last_style;
+	u_int		key, slot, idx;
+
+	key = grid_style_key(gc);
+	if (key == last_key)
+		return (last_style);
+
+	if (grid_style_hash == NULL) {
+		grid_style_hash = xcalloc(GRID_STYLE_HASH_SIZE,
+		    sizeof *grid_style_hash);
+		grid_styles = xcalloc(GRID_STYLE_EXTENDED, sizeof *grid_styles);
+
+		/* The default style goes first so lines can be filled fast. */
+		grid_nstyles = 0;
+		grid_styles[grid_nstyles++] =
+		    grid_style_key(&grid_default_cell);
+		slot = (grid_styles[0] * 2654435761U) >> (32 - GRID_STYLE_BITS);
+		grid_style_hash[slot] = 1;
+	}
+
+	slot = (key * 2654435761U) >> (32 - GRID_STYLE_BITS);
+	for (;;) {
+		idx = grid_style_hash[slot];
+		if (idx == 0)
+			break;
+		if (grid_styles[idx - 1] == key)
+			goto found;
+		slot = (slot + 1) & (GRID_STYLE_HASH_SIZE - 1);
+	}
+
+	/* Not present, so add it if there is space. */
+	if (grid_nstyles == GRID_STYLE_EXTENDED)
+		return (GRID_STYLE_EXTENDED);
+	grid_styles[grid_nstyles++] = key;
+	idx = grid_nstyles;
+	grid_style_hash[slot] = idx;
+
+found:
+	last_key = key;
+	last_style = idx - 1;
+	return (last_style);
+}
+
+/* Get a cell from a line. */
+void
+grid_get_cell1(const struct grid_line *gl, u_int px, struct grid_cell *gc)
+{
+	const struct grid_cell_entry	*gce = &gl->celldata[px];
+	u_int				 key;
+
+	if (gce->style == GRID_STYLE_EXTENDED) {
+		memcpy(gc, &gl->extddata[gce->data], sizeof *gc);
+		return;
+	}
+
+	key = grid_styles[gce->style];
+	gc->attr = key & 0xff;
+	gc->flags = (key >> 8) & 0xff;
+	gc->fg = (key >> 16) & 0xff;
+	gc->bg = key >> 24;
+	grid_cell_one(gc, gce->data);
+}
+
+/* Set a cell in a line. The line must be large enough. */
+void
+grid_set_cell1(struct grid_line *gl, u_int px, const struct grid_cell *gc)
+{
+	struct grid_cell_entry	*gce = &gl->celldata[px];
+	u_short			 style;
+
+	if (gc->xstate == ((1 << 4) | 1)) {
+		style = grid_style_intern(gc);
+		if (style != GRID_STYLE_EXTENDED) {
+			gce->style = style;
+			gce->data = *gc->xdata;
+			return;
+		}
+	}
+
+	/* Reuse the extended cell if there is one, otherwise add one. */
+	if (gce->style != GRID_STYLE_EXTENDED) {
+		if (gl->extdsize >= gl->cellsize * 2 ||
+		    gl->extdsize >= GRID_STYLE_EXTENDED)
+			grid_compact_line(gl);
+		gl->extddata = xrealloc(gl->extddata, gl->extdsize + 1,
+		    sizeof *gl->extddata);
+		gce->style = GRID_STYLE_EXTENDED;
+		gce->data = gl->extdsize++;
+	}
+	memcpy(&gl->extddata[gce->data], gc, sizeof *gl->extddata);
+}
+
+/* Drop extended cells which are no longer used by any cell in a line. */
+void
+grid_compact_line(struct grid_line *gl)
+{
+	struct grid_cell_entry	*gce;
+	struct grid_cell	*extddata;
+	u_int			 xx, n;
+
+	n = 0;
+	for (xx = 0; xx < gl->cellsize; xx++) {
+		if (gl->celldata[xx].style == GRID_STYLE_EXTENDED)
+			n++;
+	}
+
+	extddata = NULL;
+	if (n != 0)
+		extddata = xcalloc(n, sizeof *extddata);
+	n = 0;
+	for (xx = 0; xx < gl->cellsize; xx++) {
+		gce = &gl->celldata[xx];
+		if (gce->style != GRID_STYLE_EXTENDED)
+			continue;
+		memcpy(&extddata[n], &gl->extddata[gce->data],
+		    sizeof *extddata);
+		gce->data = n++;
+	}
+
+	free(gl->extddata);
+	gl->extddata = extddata;
+	gl->extdsize = n;
+}
+
+/* Copy cells between lines. The destination must be large enough. */
+void
+grid_copy_cells(struct grid_line *dst_gl, u_int dx, struct grid_line *src_gl,
+    u_int sx, u_int nx)
+{
+	struct grid_cell_entry	*gce;
+	u_int			 xx;
+
+	if (src_gl->extdsize == 0) {
+		memcpy(&dst_gl->celldata[dx], &src_gl->celldata[sx],
+		    nx * sizeof *dst_gl->celldata);
+		return;
+	}
+
+	/*
+	 * Extended cells must be added to the destination line. Clear the
+	 * cells first in case the line is compacted while doing so.
+	 */
+	for (xx = 0; xx < nx; xx++)
+		dst_gl->celldata[dx + xx] = grid_default_entry;
+	for (xx = 0; xx < nx; xx++) {
+		gce = &src_gl->celldata[sx + xx];
+		if (gce->style != GRID_STYLE_EXTENDED)
+			dst_gl->celldata[dx + xx] = *gce;
+		else {
+			grid_set_cell1(dst_gl, dx + xx,
+			    &src_gl->extddata[gce->data]);
+		}
+	}
+}
+
+/* Pack a line. */
+void
+grid_pack_line(struct grid_line *gl)
+{
+	static u_char		*buf;
+	static size_t		 bufsize;
+	struct grid_cell_entry	*gce;
+	size_t			 len, need;
+	u_short			 style, count;
+	u_int			 xx, end, run;
+
+	if (gl->flags & GRID_LINE_PACKED || gl->cellsize == 0)
+		return;
+
+	len = 0;
+	for (xx = 0; xx < gl->cellsize; xx = end) {
+		gce = &gl->celldata[xx];
+		style = gce->style;
+
+		/* Find the end of the run. */
+		end = xx + 1;
+		while (end < gl->cellsize && end - xx < GRID_PACK_MAX) {
+			if (gl->celldata[end].style != style)
+				break;
+			if (style != GRID_STYLE_EXTENDED &&
+			    gl->celldata[end].data != gce->data)
+				break;
+			end++;
+		}
+		run = end - xx;
+
+		/* Use a repeat for four or more, otherwise collect literals. */
+		if (style != GRID_STYLE_EXTENDED && run >= 4)
+			count = run | GRID_PACK_REPEAT;
+		else if (style == GRID_STYLE_EXTENDED)
+			count = run;
+		else {
+			end = xx + 1;
+			while (end < gl->cellsize && end - xx < GRID_PACK_MAX) {
+				if (gl->celldata[end].style != style)
+					break;
+				if (end + 3 < gl->cellsize &&
+				    memcmp(&gl->celldata[end],
+				    &gl->celldata[end + 1], sizeof *gce) == 0 &&
+				    memcmp(&gl->celldata[end],
+				    &gl->celldata[end + 2], sizeof *gce) == 0 &&
+				    memcmp(&gl->celldata[end],
+				    &gl->celldata[end + 3], sizeof *gce) == 0)
+					break;
+				end++;
+			}
+			count = end - xx;
+		}
+
+		need = len + sizeof style + sizeof count;
+		if (count & GRID_PACK_REPEAT)
+			need++;
+		else if (style == GRID_STYLE_EXTENDED)
+			need += count * sizeof *gl->extddata;
+		else
+			need += count;
+		if (need > bufsize) {
+			bufsize = need * 2;
+			buf = xrealloc(buf, 1, bufsize);
+		}
+
+		memcpy(buf + len, &style, sizeof style);
+		len += sizeof style;
+		memcpy(buf + len, &count, sizeof count);
+		len += sizeof count;
+		if (count & GRID_PACK_REPEAT)
+			buf[len++] = gce->data;
+		else if (style == GRID_STYLE_EXTENDED) {
+			for (; xx < end; xx++) {
+				memcpy(buf + len,
+				    &gl->extddata[gl->celldata[xx].data],
+				    sizeof *gl->extddata);
+				len += sizeof *gl->extddata;
+			}
+		} else {
+			for (; xx < end; xx++)
+				buf[len++] = gl->celldata[xx].data;
+		}
+	}
+
+	free(gl->celldata);
+	gl->celldata = NULL;
+	free(gl->extddata);
+	gl->extddata = NULL;
+	gl->extdsize = 0;
+
+	gl->packdata = xmalloc(len);
+	memcpy(gl->packdata, buf, len);
+	gl->packsize = len;
+	gl->flags |= GRID_LINE_PACKED;
+}
+
+/* Unpack a line. */
+void
+grid_unpack_line(struct grid_line *gl)
+{
+	struct grid_cell_entry	*gce;
+	u_char			*ptr, *end;
+	u_short			 style, count;
+	u_int			 xx, n;
+
+	if (!(gl->flags & GRID_LINE_PACKED))
+		return;
+
+	gl->celldata = xcalloc(gl->cellsize, sizeof *gl->celldata);
+
+	/* Count the extended cells first so they can be allocated once. */
+	for (n = 0, ptr = gl->packdata, end = ptr + gl->packsize; ptr < end;) {
+		memcpy(&style, ptr, sizeof style);
+		memcpy(&count, ptr + sizeof style, sizeof count);
+		ptr += sizeof style + sizeof count;
+		if (count & GRID_PACK_REPEAT)
+			ptr++;
+		else if (style == GRID_STYLE_EXTENDED) {
+			n += count;
+			ptr += count * sizeof *gl->extddata;
+		} else
+			ptr += count;
+	}
+	if (n != 0)
+		gl->extddata = xcalloc(n, sizeof *gl->extddata);
+	gl->extdsize = n;
+
+	xx = n = 0;
+	for (ptr = gl->packdata; ptr < end;) {
+		memcpy(&style, ptr, sizeof style);
+		memcpy(&count, ptr + sizeof style, sizeof count);
+		ptr += sizeof style + sizeof count;
+		if (count & GRID_PACK_REPEAT) {
+			count &= ~GRID_PACK_REPEAT;
+			for (; count > 0; count--, xx++) {
+				gce = &gl->celldata[xx];
+				gce->style = style;
+				gce->data = *ptr;
+			}
+			ptr++;
+		} else if (style == GRID_STYLE_EXTENDED) {
+			for (; count > 0; count--, xx++) {
+				memcpy(&gl->extddata[n], ptr,
+				    sizeof *gl->extddata);
+				ptr += sizeof *gl->extddata;
+				gce = &gl->celldata[xx];
+				gce->style = style;
+				gce->data = n++;
+			}
+		} else {
+			for (; count > 0; count--, xx++) {
+				gce = &gl->celldata[xx];
+				gce->style = style;
+				gce->data = *ptr++;
+			}
+		}
+	}
+
+	free(gl->packdata);
+	gl->packdata = NULL;
+	gl->packsize = 0;
+	gl->flags &= ~GRID_LINE_PACKED;
+}
+
+/*
+ * Unpack a line in a grid. If it is an old line, remember it and pack the
+ * least recently unpacked line if there are too many.
+ */
+void
+grid_unpack(struct grid *gd, u_int py)
+{
+	struct grid_line	*gl;
+	u_int			 slot, yy;
+
+	gl = grid_ring_line(gd, py);
+	if (py >= gd->hsize) {
+		grid_unpack_line(gl);
+		return;
+	}
+	gd->hbytes -= grid_line_bytes(gl);
+	grid_unpack_line(gl);
+	gd->hbytes += grid_line_bytes(gl);
+	if (py + GRID_HOT_LINES >= gd->hsize)
+		return;
+	yy = gd->ssize;
+
+	if (gd->unpacked == NULL) {
+		gd->unpacked = xcalloc(GRID_UNPACKED_MAX,
+		    sizeof *gd->unpacked);
+	}
+	slot = gd->nunpacked % GRID_UNPACKED_MAX;
+	if (gd->nunpacked >= GRID_UNPACKED_MAX) {
+		/* The line may have been freed or moved out of the history. */
+		yy += (gd->unpacked[slot] - gd->lineoff) & (gd->linesize - 1);
+		if (yy + GRID_HOT_LINES < gd->hsize) {
+			gl = &gd->linedata[gd->unpacked[slot]];
+			gd->hbytes -= grid_line_bytes(gl);
+			grid_pack_line(gl);
+			gd->hbytes += grid_line_bytes(gl);
+		}
+	}
+	gd->unpacked[slot] = grid_ring_index(gd, py);
+	gd->nunpacked++;
+}
+
+/* Pack the line which has just got old enough, if there is one. */
+void
+grid_pack_history(struct grid *gd)
+{
+	struct grid_line	*gl;
+
+	if (gd->hsize - gd->ssize <= GRID_HOT_LINES)
+		return;
+	gl = grid_ring_line(gd, gd->hsize - 1 - GRID_HOT_LINES);
+
+	gd->hbytes -= grid_line_bytes(gl);
+	grid_pack_line(gl);
+	gd->hbytes += grid_line_bytes(gl);
+}
+
+/* Bytes used by a line, including its entry in the ring. */
+size_t
+grid_line_bytes(const struct grid_line *gl)
+{
+	size_t	size;
+
+	size = sizeof *gl;
+	if (gl->flags & GRID_LINE_PACKED)
+		size += gl->packsize;
+	else {
+		size += gl->cellsize * sizeof *gl->celldata;
+		size += gl->extdsize * sizeof *gl->extddata;
+	}
+	return (size);
+}
+
+u_int	grid_reflow_count(struct grid *, u_int, u_int *);
+void	grid_reflow_move(struct grid *, u_int, struct grid_line *);
+void	grid_reflow_copy(struct grid *, u_int, struct grid *, u_int, u_int,
+	    u_int, u_int);
 size_t	grid_string_cells_fg(const struct grid_cell *, int *);
 size_t	grid_string_cells_bg(const struct grid_cell *, int *);
 void	grid_string_cells_code(const struct grid_cell *,
 	    const struct grid_cell *, char *, size_t, int);
+void	grid_text_add(struct grid_text *, u_int, u_short, u_char,
+	    const struct grid_cell *);
+void	grid_text_end(struct grid_text *, u_int);
 
 /* Create a new grid. */
 struct grid *
@@ -94,7 +549,17 @@ grid_create(u_int sx, u_int sy, u_int hlimit)
 	gd->hsize = 0;
 	gd->hlimit = hlimit;
 
-	gd->linedata = xcalloc(gd->sy, sizeof *gd->linedata);
+	gd->unpacked = NULL;
+	gd->nunpacked = 0;
+
+	gd->spill = NULL;
+	gd->ssize = 0;
+
+	gd->hbytes = 0;
+
+	gd->linedata = NULL;
+	gd->linesize = gd->lineoff = 0;
+	grid_reserve_lines(gd, gd->sy);
 
 	return (gd);
 }
@@ -106,12 +571,18 @@ grid_destroy(struct grid *gd)
 	struct grid_line	*gl;
 	u_int			 yy;
 
-	for (yy = 0; yy < gd->hsize + gd->sy; yy++) {
-		gl = &gd->linedata[yy];
+	for (yy = gd->ssize; yy < gd->hsize + gd->sy; yy++) {
+		gl = grid_ring_line(gd, yy);
 		free(gl->celldata);
+		free(gl->extddata);
+		free(gl->packdata);
 	}
 
 	free(gd->linedata);
+	free(gd->unpacked);
+
+	if (gd->spill != NULL)
+		grid_spill_destroy(gd->spill);
 
 	free(gd);
 }
@@ -121,21 +592,21 @@ int
 grid_compare(struct grid *ga, struct grid *gb)
 {
 	struct grid_line	*gla, *glb;
-	struct grid_cell	*gca, *gcb;
+	struct grid_cell	 gca, gcb;
 	u_int			 xx, yy;
 
 	if (ga->sx != gb->sx || ga->sy != ga->sy)
 		return (1);
 
 	for (yy = 0; yy < ga->sy; yy++) {
-		gla = &ga->linedata[yy];
-		glb = &gb->linedata[yy];
+		gla = grid_get_line(ga, yy);
+		glb = grid_get_line(gb, yy);
 		if (gla->cellsize != glb->cellsize)
 			return (1);
-		for (xx = 0; xx < ga->sx; xx++) {
-			gca = &gla->celldata[xx];
-			gcb = &glb->celldata[xx];
-			if (memcmp(gca, gcb, sizeof (struct grid_cell)) != 0)
+		for (xx = 0; xx < gla->cellsize; xx++) {
+			grid_get_cell1(gla, xx, &gca);
+			grid_get_cell1(glb, xx, &gcb);
+			if (memcmp(&gca, &gcb, sizeof gca) != 0)
 				return (1);
 		}
 	}
@@ -144,30 +615,114 @@ grid_compare(struct grid *ga, struct grid *gb)
 }
 
 /*
- * Collect lines from the history if at the limit. Free the top (oldest) 10%
- * and shift up.
+ * Make sure there is space for lines up to ny. When the ring is full, it is
+ * doubled in size and the lines put back in order at the start.
+ */
+void
+grid_reserve_lines(struct grid *gd, u_int ny)
+{
+	struct grid_line	*linedata;
+	u_int			 linesize, yy, idx;
+
+	ny -= gd->ssize;
+	if (ny <= gd->linesize)
+		return;
+
+	linesize = gd->linesize;
+	if (linesize == 0)
+		linesize = 1;
+	while (linesize < ny)
+		linesize *= 2;
+
+	linedata = xcalloc(linesize, sizeof *linedata);
+	for (yy = 0; yy < gd->linesize; yy++) {
+		idx = (gd->lineoff + yy) & (gd->linesize - 1);
+		memcpy(&linedata[yy], &gd->linedata[idx], sizeof *linedata);
+	}
+	free(gd->linedata);
+
+	/* Lines are now in order from the start. */
+	if (gd->unpacked != NULL) {
+		for (yy = 0; yy < GRID_UNPACKED_MAX; yy++) {
+			gd->unpacked[yy] = (gd->unpacked[yy] - gd->lineoff) &
+			    (gd->linesize - 1);
+		}
+	}
+
+	gd->linedata = linedata;
+	gd->linesize = linesize;
+	gd->lineoff = 0;
+}
+
+/*
+ * Collect lines from the history if at the limit. The oldest lines are
+ * spilled or freed and the start of the ring moved over them.
  */
 void
 grid_collect_history(struct grid *gd)
 {
-	u_int	yy;
+	struct grid_spill	*sp = gd->spill;
+	int			 spilled;
 
 	GRID_DEBUG(gd, "");
 
-	if (gd->hsize < gd->hlimit)
-		return;
+	while (gd->hsize - gd->ssize >= gd->hlimit && gd->hsize != gd->ssize) {
+		gd->hbytes -= grid_line_bytes(grid_ring_line(gd, gd->ssize));
+
+		spilled = 0;
+		if (sp != NULL)
+			spilled = grid_spill_add(sp,
+			    grid_ring_line(gd, gd->ssize));
+		grid_clear_lines(gd, gd->ssize, 1);
+		gd->lineoff = (gd->lineoff + 1) & (gd->linesize - 1);
+
+		if (sp == NULL || spilled != 0) {
+			gd->hsize--;
+			continue;
+		}
+		gd->ssize++;
+		if (gd->ssize > sp->limit) {
+			grid_spill_drop(sp);
+			gd->ssize--;
+			gd->hsize--;
+		}
+	}
+}
 
-	yy = gd->hlimit / 10;
-	if (yy < 1)
-		yy = 1;
+/* Clear the history, including any lines spilled. */
+void
+grid_clear_history(struct grid *gd)
+{
+	char	*path;
+	u_int	 limit;
+
+	if (gd->spill != NULL) {
+		path = xstrdup(gd->spill->path);
+		limit = gd->spill->limit;
+		grid_spill_destroy(gd->spill);
+		gd->spill = grid_spill_create(path, limit);
+		free(path);
+	}
+	gd->hsize -= gd->ssize;
+	gd->ssize = 0;
 
-	grid_move_lines(gd, 0, yy, gd->hsize + gd->sy - yy);
-	gd->hsize -= yy;
+	grid_move_lines(gd, 0, gd->hsize, gd->sy);
+	gd->hsize = 0;
+	gd->hbytes = 0;
+}
+
+/* Spill lines collected from the history to a file, up to a limit. */
+void
+grid_set_spill(struct grid *gd, const char *path, u_int limit)
+{
+	if (gd->spill != NULL)
+		return;
+	gd->spill = grid_spill_create(path, limit);
 }
 
 /*
  * Scroll the entire visible screen, moving one line into the history. Just
- * allocate a new line at the bottom and move the history size indicator.
+ * add a new line at the bottom and move the history size indicator.
  */
 void
 grid_scroll_history(struct grid *gd)
@@ -177,10 +732,12 @@ grid_scroll_history(struct grid *gd)
 	GRID_DEBUG(gd, "");
 
 	yy = gd->hsize + gd->sy;
-	gd->linedata = xrealloc(gd->linedata, yy + 1, sizeof *gd->linedata);
-	memset(&gd->linedata[yy], 0, sizeof gd->linedata[yy]);
+	grid_reserve_lines(gd, yy + 1);
+	memset(grid_ring_line(gd, yy), 0, sizeof *gd->linedata);
 
+	gd->hbytes += grid_line_bytes(grid_ring_line(gd, gd->hsize));
 	gd->hsize++;
+	grid_pack_history(gd);
 }
 
 /* Scroll a region up, moving the top line into the history. */
@@ -188,33 +745,59 @@ void
 grid_scroll_history_region(struct grid *gd, u_int upper, u_int lower)
 {
 	struct grid_line	*gl_history, *gl_upper, *gl_lower;
+	struct grid_line	 gl;
 	u_int			 yy;
 
 	GRID_DEBUG(gd, "upper=%u, lower=%u", upper, lower);
 
 	/* Create a space for a new line. */
 	yy = gd->hsize + gd->sy;
-	gd->linedata = xrealloc(gd->linedata, yy + 1, sizeof *gd->linedata);
+	grid_reserve_lines(gd, yy + 1);
+
+	/* Take the line out of the region and move the region up. */
+	gl_upper = grid_ring_line(gd, upper);
+	memcpy(&gl, gl_upper, sizeof gl);
+	for (yy = upper; yy < lower; yy++) {
+		memcpy(grid_ring_line(gd, yy), grid_ring_line(gd, yy + 1),
+		    sizeof gl);
+	}
+	gl_lower = grid_ring_line(gd, lower);
+	memset(gl_lower, 0, sizeof *gl_lower);
 
 	/* Move the entire screen down to free a space for this line. */
-	gl_history = &gd->linedata[gd->hsize];
-	memmove(gl_history + 1, gl_history, gd->sy * sizeof *gl_history);
-
-	/* Adjust the region and find its start and end. */
-	upper++;
-	gl_upper = &gd->linedata[upper];
-	lower++;
-	gl_lower = &gd->linedata[lower];
-
-	/* Move the line into the history. */
-	memcpy(gl_history, gl_upper, sizeof *gl_history);
+	for (yy = gd->hsize + gd->sy; yy > gd->hsize; yy--) {
+		memcpy(grid_ring_line(gd, yy), grid_ring_line(gd, yy - 1),
+		    sizeof gl);
+	}
 
-	/* Then move the region up and clear the bottom line. */
-	memmove(gl_upper, gl_upper + 1, (lower - upper) * sizeof *gl_upper);
-	memset(gl_lower, 0, sizeof *gl_lower);
+	/* Then put the line into the history. */
+	gl_history = grid_ring_line(gd, gd->hsize);
+	memcpy(gl_history, &gl, sizeof *gl_history);
 
 	/* Move the history offset down over the line. */
+	gd->hbytes += grid_line_bytes(gl_history);
 	gd->hsize++;
+	grid_pack_history(gd);
+}
+
+/* Move lines from the top of the screen into the history. */
+void
+grid_grow_history(struct grid *gd, u_int ny)
+{
+	for (; ny > 0; ny--) {
+		gd->hbytes += grid_line_bytes(grid_ring_line(gd, gd->hsize));
+		gd->hsize++;
+	}
+}
+
+/* Move lines from the end of the history back onto the screen. */
+void
+grid_shrink_history(struct grid *gd, u_int ny)
+{
+	for (; ny > 0; ny--) {
+		gd->hsize--;
+		gd->hbytes -= grid_line_bytes(grid_ring_line(gd, gd->hsize));
+	}
 }
 
 /* Expand line to fit to cell. */
@@ -224,65 +807,112 @@ grid_expand_line(struct grid *gd, u_int py, u_int sx)
 	struct grid_line	*gl;
 	u_int			 xx;
 
-	gl = &gd->linedata[py];
+	gl = grid_get_line(gd, py);
 	if (sx <= gl->cellsize)
 		return;
 
 	gl->celldata = xrealloc(gl->celldata, sx, sizeof *gl->celldata);
 	for (xx = gl->cellsize; xx < sx; xx++)
-		grid_put_cell(gd, xx, py, &grid_default_cell);
+		gl->celldata[xx] = grid_default_entry;
 	gl->cellsize = sx;
 }
 
-/* Peek at grid line. */
+/* Get grid line, unpacking it if necessary. */
+struct grid_line *
+grid_get_line(struct grid *gd, u_int py)
+{
+	struct grid_line	*gl;
+
+	if (py < gd->ssize)
+		return (grid_spill_get(gd->spill, py));
+
+	gl = grid_ring_line(gd, py);
+	if (gl->flags & GRID_LINE_PACKED)
+		grid_unpack(gd, py);
+	return (gl);
+}
+
+/* Peek at grid line. The cells may be packed, only the size is certain. */
 const struct grid_line *
 grid_peek_line(struct grid *gd, u_int py)
 {
 	if (grid_check_y(gd, py) != 0)
 		return (NULL);
-	return (&gd->linedata[py]);
+	if (py < gd->ssize)
+		return (grid_spill_get(gd->spill, py));
+	return (grid_ring_line(gd, py));
 }
 
-/* Get cell for reading. */
-const struct grid_cell *
-grid_peek_cell(struct grid *gd, u_int px, u_int py)
+/* Get cell at absolute position. */
+void
+grid_get_cell(struct grid *gd, u_int px, u_int py, struct grid_cell *gc)
 {
-	if (grid_check_y(gd, py) != 0)
-		return (&grid_default_cell);
+	struct grid_line	*gl;
 
-	if (px >= gd->linedata[py].cellsize)
-		return (&grid_default_cell);
-	return (&gd->linedata[py].celldata[px]);
+	if (grid_check_y(gd, py) != 0) {
+		memcpy(gc, &grid_default_cell, sizeof *gc);
+		return;
+	}
+	gl = grid_get_line(gd, py);
+	if (px >= gl->cellsize) {
+		memcpy(gc, &grid_default_cell, sizeof *gc);
+		return;
+	}
+	grid_get_cell1(gl, px, gc);
 }
 
-/* Get cell at relative position (for writing). */
-struct grid_cell *
-grid_get_cell(struct grid *gd, u_int px, u_int py)
+/* Set cell at absolute position. */
+void
+grid_set_cell(
+    struct grid *gd, u_int px, u_int py, const struct grid_cell *gc)
 {
 	if (grid_check_y(gd, py) != 0)
-		return (NULL);
+		return;
 
 	grid_expand_line(gd, py, px + 1);
-	return (&gd->linedata[py].celldata[px]);
+	grid_set_cell1(grid_get_line(gd, py), px, gc);
 }
 
-/* Set cell at relative position. */
+/* Set a run of cells with the same attributes from a string of ASCII. */
 void
-grid_set_cell(
-    struct grid *gd, u_int px, u_int py, const struct grid_cell *gc)
+grid_set_cells(struct grid *gd, u_int px, u_int py, const struct grid_cell *gc,
+    const u_char *s, u_int len)
 {
+	struct grid_line	*gl;
+	struct grid_cell_entry	*gce;
+	struct grid_cell	 tmpgc;
+	u_short			 style;
+	u_int			 xx;
+
 	if (grid_check_y(gd, py) != 0)
 		return;
 
-	grid_expand_line(gd, py, px + 1);
-	grid_put_cell(gd, px, py, gc);
+	grid_expand_line(gd, py, px + len);
+	gl = grid_get_line(gd, py);
+
+	style = grid_style_intern(gc);
+	if (style == GRID_STYLE_EXTENDED) {
+		memcpy(&tmpgc, gc, sizeof tmpgc);
+		for (xx = 0; xx < len; xx++) {
+			grid_cell_one(&tmpgc, s[xx]);
+			grid_set_cell1(gl, px + xx, &tmpgc);
+		}
+		return;
+	}
+
+	gce = &gl->celldata[px];
+	for (xx = 0; xx < len; xx++) {
+		gce[xx].style = style;
+		gce[xx].data = s[xx];
+	}
 }
 
 /* Clear area. */
 void
 grid_clear(struct grid *gd, u_int px, u_int py, u_int nx, u_int ny)
 {
-	u_int	xx, yy;
+	struct grid_line	*gl;
+	u_int			 xx, yy;
 
 	GRID_DEBUG(gd, "px=%u, py=%u, nx=%u, ny=%u", px, py, nx, ny);
 
@@ -300,16 +930,17 @@ grid_clear(struct grid *gd, u_int px, u_int py, u_int nx, u_int ny)
 		return;
 
 	for (yy = py; yy < py + ny; yy++) {
-		if (px >= gd->linedata[yy].cellsize)
+		gl = grid_get_line(gd, yy);
+		if (px >= gl->cellsize)
 			continue;
-		if (px + nx >= gd->linedata[yy].cellsize) {
-			gd->linedata[yy].cellsize = px;
+		if (px + nx >= gl->cellsize) {
+			gl->cellsize = px;
 			continue;
 		}
 		for (xx = px; xx < px + nx; xx++) {
-			if (xx >= gd->linedata[yy].cellsize)
+			if (xx >= gl->cellsize)
 				break;
-			grid_put_cell(gd, xx, yy, &grid_default_cell);
+			gl->celldata[xx] = grid_default_entry;
 		}
 	}
 }
@@ -332,8 +963,10 @@ grid_clear_lines(struct grid *gd, u_int py, u_int ny)
 		return;
 
 	for (yy = py; yy < py + ny; yy++) {
-		gl = &gd->linedata[yy];
+		gl = grid_ring_line(gd, yy);
 		free(gl->celldata);
+		free(gl->extddata);
+		free(gl->packdata);
 		memset(gl, 0, sizeof *gl);
 	}
 }
@@ -365,14 +998,25 @@ grid_move_lines(struct grid *gd, u_int dy, u_int py, u_int ny)
 		grid_clear_lines(gd, yy, 1);
 	}
 
-	memmove(
-	    &gd->linedata[dy], &gd->linedata[py], ny * (sizeof *gd->linedata));
+	/* Move the lines, in the right order if they overlap. */
+	if (dy < py) {
+		for (yy = 0; yy < ny; yy++) {
+			memcpy(grid_ring_line(gd, dy + yy),
+			    grid_ring_line(gd, py + yy), sizeof *gd->linedata);
+		}
+	} else {
+		for (yy = ny; yy > 0; yy--) {
+			memcpy(grid_ring_line(gd, dy + yy - 1),
+			    grid_ring_line(gd, py + yy - 1),
+			    sizeof *gd->linedata);
+		}
+	}
 
 	/* Wipe any lines that have been moved (without freeing them). */
 	for (yy = py; yy < py + ny; yy++) {
 		if (yy >= dy && yy < dy + ny)
 			continue;
-		memset(&gd->linedata[yy], 0, sizeof gd->linedata[yy]);
+		memset(grid_ring_line(gd, yy), 0, sizeof *gd->linedata);
 	}
 }
 
@@ -390,7 +1034,7 @@ grid_move_cells(struct grid *gd, u_int dx, u_int px, u_int py, u_int nx)
 
 	if (grid_check_y(gd, py) != 0)
 		return;
-	gl = &gd->linedata[py];
+	gl = grid_get_line(gd, py);
 
 	grid_expand_line(gd, py, px + nx);
 	grid_expand_line(gd, py, dx + nx);
@@ -401,7 +1045,7 @@ grid_move_cells(struct grid *gd, u_int dx, u_int px, u_int py, u_int nx)
 	for (xx = px; xx < px + nx; xx++) {
 		if (xx >= dx && xx < dx + nx)
 			continue;
-		grid_put_cell(gd, xx, py, &grid_default_cell);
+		gl->celldata[xx] = grid_default_entry;
 	}
 }
 
@@ -580,12 +1224,127 @@ grid_string_cells_code(const struct grid_cell *lastgc,
 	}
 }
 
+/*
+ * Add a cell to line text. Simple cells are the style and a single character,
+ * otherwise gc is the extended cell. Padding cells are left out.
+ */
+void
+grid_text_add(struct grid_text *gt, u_int px, u_short style, u_char data,
+    const struct grid_cell *gc)
+{
+	struct utf8_data	ud;
+	u_int			i;
+
+	if (gt->len + UTF8_SIZE >= gt->size) {
+		gt->size = (gt->len + UTF8_SIZE) * 2;
+		gt->text = xrealloc(gt->text, 1, gt->size);
+		gt->cells = xrealloc(gt->cells, gt->size, sizeof *gt->cells);
+	}
+
+	if (style != GRID_STYLE_EXTENDED) {
+		if ((grid_styles[style] >> 8) & GRID_FLAG_PADDING)
+			return;
+		gt->cells[gt->len] = px;
+		gt->text[gt->len++] = data;
+		return;
+	}
+
+	if (gc->flags & GRID_FLAG_PADDING)
+		return;
+	grid_cell_get(gc, &ud);
+	for (i = 0; i < ud.size; i++) {
+		gt->cells[gt->len] = px;
+		gt->text[gt->len++] = ud.data[i];
+	}
+}
+
+/*
+ * Terminate line text. The text is followed by a NUL and the cells by the
+ * width, so the cell after any byte can be looked up.
+ */
+void
+grid_text_end(struct grid_text *gt, u_int sx)
+{
+	if (gt->len >= gt->size) {
+		gt->size = gt->len + 1;
+		gt->text = xrealloc(gt->text, 1, gt->size);
+		gt->cells = xrealloc(gt->cells, gt->size, sizeof *gt->cells);
+	}
+	gt->text[gt->len] = '\0';
+	gt->cells[gt->len] = sx;
+}
+
+/*
+ * Get the text of a line up to the width of the grid, with cells past the end
+ * of the line as spaces. Packed lines are read without unpacking them.
+ */
+void
+grid_get_text(struct grid *gd, u_int py, struct grid_text *gt)
+{
+	const struct grid_line	*gl;
+	const struct grid_cell_entry *gce;
+	struct grid_cell	 gc;
+	const u_char		*ptr, *end;
+	u_short			 style, count;
+	u_int			 xx;
+
+	gt->len = 0;
+	if ((gl = grid_peek_line(gd, py)) == NULL) {
+		grid_text_end(gt, gd->sx);
+		return;
+	}
+
+	xx = 0;
+	if (gl->flags & GRID_LINE_PACKED) {
+		ptr = gl->packdata;
+		end = ptr + gl->packsize;
+		while (ptr < end && xx < gd->sx) {
+			memcpy(&style, ptr, sizeof style);
+			memcpy(&count, ptr + sizeof style, sizeof count);
+			ptr += sizeof style + sizeof count;
+
+			if (count & GRID_PACK_REPEAT) {
+				count &= ~GRID_PACK_REPEAT;
+				for (; count > 0 && xx < gd->sx; count--)
+					grid_text_add(gt, xx++, style, *ptr, NULL);
+				ptr++;
+			} else if (style == GRID_STYLE_EXTENDED) {
+				for (; count > 0; count--) {
+					memcpy(&gc, ptr, sizeof gc);
+					ptr += sizeof gc;
+					if (xx < gd->sx)
+						grid_text_add(gt, xx++, style, 0, &gc);
+				}
+			} else {
+				for (; count > 0; count--) {
+					if (xx < gd->sx)
+						grid_text_add(gt, xx++, style, *ptr, NULL);
+					ptr++;
+				}
+			}
+		}
+	} else {
+		for (; xx < gl->cellsize && xx < gd->sx; xx++) {
+			gce = &gl->celldata[xx];
+			if (gce->style == GRID_STYLE_EXTENDED) {
+				grid_text_add(gt, xx, gce->style, 0,
+				    &gl->extddata[gce->data]);
+			} else
+				grid_text_add(gt, xx, gce->style, gce->data, NULL);
+		}
+	}
+
+	for (; xx < gd->sx; xx++)
+		grid_text_add(gt, xx, GRID_STYLE_EXTENDED, 0, &grid_default_cell);
+	grid_text_end(gt, gd->sx);
+}
+
 /* Convert cells into a string. */
 char *
 grid_string_cells(struct grid *gd, u_int px, u_int py, u_int nx,
     struct grid_cell **lastgc, int with_codes, int escape_c0, int trim)
 {
-	const struct grid_cell	*gc;
+	struct grid_cell	 gc;
 	static struct grid_cell	 lastgc1;
 	struct utf8_data	 ud;
 	const char*		 data;
@@ -605,16 +1364,16 @@ grid_string_cells(struct grid *gd, u_int px, u_int py, u_int nx,
 	off = 0;
 
 	for (xx = px; xx < px + nx; xx++) {
-		gc = grid_peek_cell(gd, xx, py);
-		if (gc->flags & GRID_FLAG_PADDING)
+		grid_get_cell(gd, xx, py, &gc);
+		if (gc.flags & GRID_FLAG_PADDING)
 			continue;
-		grid_cell_get(gc, &ud);
+		grid_cell_get(&gc, &ud);
 
 		if (with_codes) {
-			grid_string_cells_code(*lastgc, gc, code, sizeof code,
+			grid_string_cells_code(*lastgc, &gc, code, sizeof code,
 			    escape_c0);
 			codelen = strlen(code);
-			memcpy(*lastgc, gc, sizeof *gc);
+			memcpy(*lastgc, &gc, sizeof gc);
 		} else
 			codelen = 0;
 
@@ -668,8 +1427,8 @@ grid_duplicate_lines(
 	grid_clear_lines(dst, dy, ny);
 
 	for (yy = 0; yy < ny; yy++) {
-		srcl = &src->linedata[sy];
-		dstl = &dst->linedata[dy];
+		srcl = grid_get_line(src, sy);
+		dstl = grid_ring_line(dst, dy);
 
 		memcpy(dstl, srcl, sizeof *dstl);
 		if (srcl->cellsize != 0) {
@@ -678,140 +1437,156 @@ grid_duplicate_lines(
 			memcpy(dstl->celldata, srcl->celldata,
 			    srcl->cellsize * sizeof *dstl->celldata);
 		}
+		if (srcl->extdsize != 0) {
+			dstl->extddata = xcalloc(
+			    srcl->extdsize, sizeof *dstl->extddata);
+			memcpy(dstl->extddata, srcl->extddata,
+			    srcl->extdsize * sizeof *dstl->extddata);
+		}
 
 		sy++;
 		dy++;
 	}
 }
 
-/* Join line data. */
-void
-grid_reflow_join(struct grid *dst, u_int *py, struct grid_line *src_gl,
-    u_int new_x)
-{
-	struct grid_line	*dst_gl = &dst->linedata[(*py) - 1];
-	u_int			 left, to_copy, ox, nx;
-
-	/* How much is left on the old line? */
-	left = new_x - dst_gl->cellsize;
-
-	/* Work out how much to append. */
-	to_copy = src_gl->cellsize;
-	if (to_copy > left)
-		to_copy = left;
-	ox = dst_gl->cellsize;
-	nx = ox + to_copy;
-
-	/* Resize the destination line. */
-	dst_gl->celldata = xrealloc(dst_gl->celldata, nx,
-	    sizeof *dst_gl->celldata);
-	dst_gl->cellsize = nx;
-
-	/* Append as much as possible. */
-	memcpy(&dst_gl->celldata[ox], &src_gl->celldata[0],
-	    to_copy * sizeof src_gl->celldata[0]);
-
-	/* If there is any left in the source, split it. */
-	if (src_gl->cellsize > to_copy) {
-		dst_gl->flags |= GRID_LINE_WRAPPED;
-
-		src_gl->cellsize -= to_copy;
-		grid_reflow_split(dst, py, src_gl, new_x, to_copy);
-	}
-}
-
-/* Split line data. */
-void
-grid_reflow_split(struct grid *dst, u_int *py, struct grid_line *src_gl,
-    u_int new_x, u_int offset)
+/*
+ * Find the end of the logical line starting at line: it continues over every
+ * wrapped line. Returns the line after it and sets the number of cells.
+ */
+u_int
+grid_reflow_count(struct grid *src, u_int line, u_int *cells)
 {
-	struct grid_line	*dst_gl = NULL;
-	u_int			 to_copy;
-
-	/* Loop and copy sections of the source line. */
-	while (src_gl->cellsize > 0) {
-		/* Create new line. */
-		if (*py >= dst->hsize + dst->sy)
-			grid_scroll_history(dst);
-		dst_gl = &dst->linedata[*py];
-		(*py)++;
-
-		/* How much should we copy? */
-		to_copy = new_x;
-		if (to_copy > src_gl->cellsize)
-			to_copy = src_gl->cellsize;
-
-		/* Expand destination line. */
-		dst_gl->celldata = xmalloc(to_copy * sizeof *dst_gl->celldata);
-		dst_gl->cellsize = to_copy;
-		dst_gl->flags |= GRID_LINE_WRAPPED;
-
-		/* Copy the data. */
-		memcpy (&dst_gl->celldata[0], &src_gl->celldata[offset],
-		    to_copy * sizeof dst_gl->celldata[0]);
-
-		/* Move offset and reduce old line size. */
-		offset += to_copy;
-		src_gl->cellsize -= to_copy;
-	}
+	struct grid_line	*src_gl;
 
-	/* Last line is not wrapped. */
-	if (dst_gl != NULL)
-		dst_gl->flags &= ~GRID_LINE_WRAPPED;
+	*cells = 0;
+	do {
+		src_gl = grid_ring_line(src, line++);
+		*cells += src_gl->cellsize;
+	} while (src_gl->flags & GRID_LINE_WRAPPED &&
+	    line < src->hsize + src->sy);
+	return (line);
 }
 
 /* Move line data. */
 void
-grid_reflow_move(struct grid *dst, u_int *py, struct grid_line *src_gl)
+grid_reflow_move(struct grid *dst, u_int py, struct grid_line *src_gl)
 {
-	struct grid_line	*dst_gl;
-
-	/* Create new line. */
-	if (*py >= dst->hsize + dst->sy)
-		grid_scroll_history(dst);
-	dst_gl = &dst->linedata[*py];
-	(*py)++;
+	struct grid_line	*dst_gl = grid_ring_line(dst, py);
 
 	/* Copy the old line. */
 	memcpy(dst_gl, src_gl, sizeof *dst_gl);
 	dst_gl->flags &= ~GRID_LINE_WRAPPED;
 
-	/* Clear old line. */
+	/* Clear old line. Packed lines stay packed. */
 	src_gl->celldata = NULL;
+	src_gl->extddata = NULL;
+	src_gl->packdata = NULL;
+}
+
+/*
+ * Copy a logical line of cells from source lines line to end into destination
+ * lines from py, new_x cells to a line. Each destination line is allocated
+ * once at its final size and packed as soon as it is full if it is old enough.
+ */
+void
+grid_reflow_copy(struct grid *dst, u_int py, struct grid *src, u_int line,
+    u_int end, u_int cells, u_int new_x)
+{
+	struct grid_line	*dst_gl, *src_gl;
+	u_int			 dx, sx, to_copy;
+
+	dst_gl = NULL;
+	dx = new_x;
+	for (; line < end; line++) {
+		src_gl = grid_ring_line(src, line);
+		grid_unpack_line(src_gl);
+
+		for (sx = 0; sx < src_gl->cellsize; sx += to_copy) {
+			/* Start a new line if this one is full. */
+			if (dx == new_x) {
+				if (dst_gl != NULL &&
+				    py + GRID_HOT_LINES <= dst->hsize)
+					grid_pack_line(dst_gl);
+				dst_gl = grid_ring_line(dst, py++);
+				to_copy = new_x;
+				if (to_copy > cells)
+					to_copy = cells;
+				dst_gl->celldata = xmalloc(
+				    to_copy * sizeof *dst_gl->celldata);
+				dst_gl->cellsize = to_copy;
+				if (cells > new_x)
+					dst_gl->flags |= GRID_LINE_WRAPPED;
+				cells -= to_copy;
+				dx = 0;
+			}
+
+			to_copy = dst_gl->cellsize - dx;
+			if (to_copy > src_gl->cellsize - sx)
+				to_copy = src_gl->cellsize - sx;
+			grid_copy_cells(dst_gl, dx, src_gl, sx, to_copy);
+			dx += to_copy;
+		}
+	}
+	if (dst_gl != NULL && py + GRID_HOT_LINES <= dst->hsize)
+		grid_pack_line(dst_gl);
 }
 
 /*
  * Reflow lines from src grid into dst grid of width new_x. Returns number of
  * lines fewer in the visible area. The source grid is destroyed.
+ *
+ * This is done in two passes: the first works out how many lines are needed
+ * so the destination can be sized once, the second fills them in. Lines which
+ * do not need to change are moved, even if packed; any empty wrapped lines
+ * after them are dropped.
  */
 u_int
 grid_reflow(struct grid *dst, struct grid *src, u_int new_x)
 {
-	u_int			 py, sy, line;
-	int			 previous_wrapped;
 	struct grid_line	*src_gl;
+	u_int			 py, sy, line, end, cells, ny;
+
+	/* Spilled lines are not reflowed, the new grid takes them as is. */
+	dst->spill = src->spill;
+	src->spill = NULL;
+	dst->ssize = dst->hsize = src->ssize;
 
-	py = 0;
 	sy = src->sy;
 
-	previous_wrapped = 0;
-	for (line = 0; line < sy + src->hsize; line++) {
-		src_gl = src->linedata + line;
-		if (!previous_wrapped) {
-			/* Wasn't wrapped. If smaller, move to destination. */
-			if (src_gl->cellsize <= new_x)
-				grid_reflow_move(dst, &py, src_gl);
-			else
-				grid_reflow_split(dst, &py, src_gl, new_x, 0);
-		} else {
-			/* Previous was wrapped. Try to join. */
-			grid_reflow_join(dst, &py, src_gl, new_x);
+	/* Count the lines needed and make space for them. */
+	ny = 0;
+	for (line = src->ssize; line < sy + src->hsize; line = end) {
+		end = grid_reflow_count(src, line, &cells);
+		if (cells == 0)
+			ny++;
+		else
+			ny += (cells + new_x - 1) / new_x;
+	}
+	if (ny > sy) {
+		grid_reserve_lines(dst, dst->ssize + ny);
+		dst->hsize += ny - sy;
+	}
+
+	/* Fill in the lines. */
+	py = dst->ssize;
+	for (line = src->ssize; line < sy + src->hsize; line = end) {
+		end = grid_reflow_count(src, line, &cells);
+		src_gl = grid_ring_line(src, line);
+		if (src_gl->cellsize == cells && cells <= new_x) {
+			grid_reflow_move(dst, py++, src_gl);
+			continue;
 		}
-		previous_wrapped = src_gl->flags & GRID_LINE_WRAPPED;
+		grid_reflow_copy(dst, py, src, line, end, cells, new_x);
+		py += (cells + new_x - 1) / new_x;
 	}
 
+	/* Count the size of the history. */
+	for (line = dst->ssize; line < dst->hsize; line++)
+		dst->hbytes += grid_line_bytes(grid_ring_line(dst, line));
+
 	grid_destroy(src);
 
+	py -= dst->ssize;
 	if (py > sy)
 		return (0);
 	return (sy - py);
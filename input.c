@@ -52,6 +52,8 @@ int	input_split(struct input_ctx *);
 int	input_get(struct input_ctx *, u_int, int, int);
 void	input_reply(struct input_ctx *, const char *, ...);
 void	input_set_state(struct window_pane *, const struct input_transition *);
+void	input_build_dispatch(void);
+size_t	input_ground_span(const u_char *, size_t);
 
 /* Transition entry/exit handlers. */
 void	input_clear(struct input_ctx *);
@@ -202,6 +204,9 @@ struct input_state {
 	void				(*enter)(struct input_ctx *);
 	void				(*exit)(struct input_ctx *);
 	const struct input_transition	*transitions;
+
+	/* Index into transitions for each byte, see input_build_dispatch. */
+	u_char				*dispatch;
 };
 
 /* State transitions available from all states. */
@@ -232,144 +237,210 @@ const struct input_transition input_state_utf8_three_table[];
 const struct input_transition input_state_utf8_two_table[];
 const struct input_transition input_state_utf8_one_table[];
 
+/* Per-state dispatch tables, built from the transition tables. */
+u_char input_state_ground_dispatch[256];
+u_char input_state_esc_enter_dispatch[256];
+u_char input_state_esc_intermediate_dispatch[256];
+u_char input_state_csi_enter_dispatch[256];
+u_char input_state_csi_parameter_dispatch[256];
+u_char input_state_csi_intermediate_dispatch[256];
+u_char input_state_csi_ignore_dispatch[256];
+u_char input_state_dcs_enter_dispatch[256];
+u_char input_state_dcs_parameter_dispatch[256];
+u_char input_state_dcs_intermediate_dispatch[256];
+u_char input_state_dcs_handler_dispatch[256];
+u_char input_state_dcs_escape_dispatch[256];
+u_char input_state_dcs_ignore_dispatch[256];
+u_char input_state_osc_string_dispatch[256];
+u_char input_state_apc_string_dispatch[256];
+u_char input_state_rename_string_dispatch[256];
+u_char input_state_consume_st_dispatch[256];
+u_char input_state_utf8_three_dispatch[256];
+u_char input_state_utf8_two_dispatch[256];
+u_char input_state_utf8_one_dispatch[256];
+
 /* ground state definition. */
 const struct input_state input_state_ground = {
 	"ground",
 	NULL, NULL,
-	input_state_ground_table
+	input_state_ground_table,
+	input_state_ground_dispatch
 };
 
 /* esc_enter state definition. */
 const struct input_state input_state_esc_enter = {
 	"esc_enter",
 	input_clear, NULL,
-	input_state_esc_enter_table
+	input_state_esc_enter_table,
+	input_state_esc_enter_dispatch
 };
 
 /* esc_intermediate state definition. */
 const struct input_state input_state_esc_intermediate = {
 	"esc_intermediate",
 	NULL, NULL,
-	input_state_esc_intermediate_table
+	input_state_esc_intermediate_table,
+	input_state_esc_intermediate_dispatch
 };
 
 /* csi_enter state definition. */
 const struct input_state input_state_csi_enter = {
 	"csi_enter",
 	input_clear, NULL,
-	input_state_csi_enter_table
+	input_state_csi_enter_table,
+	input_state_csi_enter_dispatch
 };
 
 /* csi_parameter state definition. */
 const struct input_state input_state_csi_parameter = {
 	"csi_parameter",
 	NULL, NULL,
-	input_state_csi_parameter_table
+	input_state_csi_parameter_table,
+	input_state_csi_parameter_dispatch
 };
 
 /* csi_intermediate state definition. */
 const struct input_state input_state_csi_intermediate = {
 	"csi_intermediate",
 	NULL, NULL,
-	input_state_csi_intermediate_table
+	input_state_csi_intermediate_table,
+	input_state_csi_intermediate_dispatch
 };
 
 /* csi_ignore state definition. */
 const struct input_state input_state_csi_ignore = {
 	"csi_ignore",
 	NULL, NULL,
-	input_state_csi_ignore_table
+	input_state_csi_ignore_table,
+	input_state_csi_ignore_dispatch
 };
 
 /* dcs_enter state definition. */
 const struct input_state input_state_dcs_enter = {
 	"dcs_enter",
 	input_clear, NULL,
-	input_state_dcs_enter_table
+	input_state_dcs_enter_table,
+	input_state_dcs_enter_dispatch
 };
 
 /* dcs_parameter state definition. */
 const struct input_state input_state_dcs_parameter = {
 	"dcs_parameter",
 	NULL, NULL,
-	input_state_dcs_parameter_table
+	input_state_dcs_parameter_table,
+	input_state_dcs_parameter_dispatch
 };
 
 /* dcs_intermediate state definition. */
 const struct input_state input_state_dcs_intermediate = {
 	"dcs_intermediate",
 	NULL, NULL,
-	input_state_dcs_intermediate_table
+	input_state_dcs_intermediate_table,
+	input_state_dcs_intermediate_dispatch
 };
 
 /* dcs_handler state definition. */
 const struct input_state input_state_dcs_handler = {
 	"dcs_handler",
 	NULL, NULL,
-	input_state_dcs_handler_table
+	input_state_dcs_handler_table,
+	input_state_dcs_handler_dispatch
 };
 
 /* dcs_escape state definition. */
 const struct input_state input_state_dcs_escape = {
 	"dcs_escape",
 	NULL, NULL,
-	input_state_dcs_escape_table
+	input_state_dcs_escape_table,
+	input_state_dcs_escape_dispatch
 };
 
 /* dcs_ignore state definition. */
 const struct input_state input_state_dcs_ignore = {
 	"dcs_ignore",
 	NULL, NULL,
-	input_state_dcs_ignore_table
+	input_state_dcs_ignore_table,
+	input_state_dcs_ignore_dispatch
 };
 
 /* osc_string state definition. */
 const struct input_state input_state_osc_string = {
 	"osc_string",
 	input_enter_osc, input_exit_osc,
-	input_state_osc_string_table
+	input_state_osc_string_table,
+	input_state_osc_string_dispatch
 };
 
 /* apc_string state definition. */
 const struct input_state input_state_apc_string = {
 	"apc_string",
 	input_enter_apc, input_exit_apc,
-	input_state_apc_string_table
+	input_state_apc_string_table,
+	input_state_apc_string_dispatch
 };
 
 /* rename_string state definition. */
 const struct input_state input_state_rename_string = {
 	"rename_string",
 	input_enter_rename, input_exit_rename,
-	input_state_rename_string_table
+	input_state_rename_string_table,
+	input_state_rename_string_dispatch
 };
 
 /* consume_st state definition. */
 const struct input_state input_state_consume_st = {
 	"consume_st",
 	NULL, NULL,
-	input_state_consume_st_table
+	input_state_consume_st_table,
+	input_state_consume_st_dispatch
 };
 
 /* utf8_three state definition. */
 const struct input_state input_state_utf8_three = {
 	"utf8_three",
 	NULL, NULL,
-	input_state_utf8_three_table
+	input_state_utf8_three_table,
+	input_state_utf8_three_dispatch
 };
 
 /* utf8_two state definition. */
 const struct input_state input_state_utf8_two = {
 	"utf8_two",
 	NULL, NULL,
-	input_state_utf8_two_table
+	input_state_utf8_two_table,
+	input_state_utf8_two_dispatch
 };
 
 /* utf8_one state definition. */
 const struct input_state input_state_utf8_one = {
 	"utf8_one",
 	NULL, NULL,
-	input_state_utf8_one_table
+	input_state_utf8_one_table,
+	input_state_utf8_one_dispatch
+};
+
+/* All states, used to build the dispatch tables. */
+const struct input_state *input_states[] = {
+	&input_state_ground,
+	&input_state_esc_enter,
+	&input_state_esc_intermediate,
+	&input_state_csi_enter,
+	&input_state_csi_parameter,
+	&input_state_csi_intermediate,
+	&input_state_csi_ignore,
+	&input_state_dcs_enter,
+	&input_state_dcs_parameter,
+	&input_state_dcs_intermediate,
+	&input_state_dcs_handler,
+	&input_state_dcs_escape,
+	&input_state_dcs_ignore,
+	&input_state_osc_string,
+	&input_state_apc_string,
+	&input_state_rename_string,
+	&input_state_consume_st,
+	&input_state_utf8_three,
+	&input_state_utf8_two,
+	&input_state_utf8_one,
 };
 
 /* ground state table. */
@@ -676,12 +747,77 @@ input_table_compare(const void *key, const void *value)
 	return (strcmp(ictx->interm_buf, entry->interm));
 }
 
+/*
+ * Build the dispatch tables. Walking the transition list for every byte is
+ * slow, so do it once for each possible byte and store the index of the
+ * matching transition.
+ */
+void
+input_build_dispatch(void)
+{
+	static int			 built;
+	const struct input_state	*state;
+	const struct input_transition	*itr;
+	u_int				 i;
+	int				 ch;
+
+	if (built)
+		return;
+	built = 1;
+
+	for (i = 0; i < nitems(input_states); i++) {
+		state = input_states[i];
+		for (ch = 0; ch <= UCHAR_MAX; ch++) {
+			itr = state->transitions;
+			while (itr->first != -1 && itr->last != -1) {
+				if (ch >= itr->first && ch <= itr->last)
+					break;
+				itr++;
+			}
+			if (itr->first == -1 || itr->last == -1) {
+				/* No transition? Eh? */
+				fatalx("No transition from state!");
+			}
+			state->dispatch[ch] = itr - state->transitions;
+		}
+	}
+}
+
+/*
+ * Find the length of the run of printable ASCII at the start of a buffer.
+ * Check a word at a time and only drop to looking at single bytes when a word
+ * contains something else.
+ */
+size_t
+input_ground_span(const u_char *buf, size_t len)
+{
+	const u_long	ones = ~0UL / UCHAR_MAX, highs = ones * 0x80;
+	u_long		w;
+	size_t		off = 0;
+
+	while (len - off >= sizeof w) {
+		memcpy(&w, buf + off, sizeof w);
+
+		/* Any byte with top bit set, below 0x20 or equal to 0x7f. */
+		if ((w & highs) != 0 ||
+		    ((w - ones * 0x20) & ~w & highs) != 0 ||
+		    (((w ^ (ones * 0x7f)) - ones) & ~(w ^ (ones * 0x7f)) & highs))
+			break;
+		off += sizeof w;
+	}
+	while (off < len && buf[off] >= 0x20 && buf[off] <= 0x7e)
+		off++;
+	return (off);
+}
+
 /* Initialise input parser. */
 void
 input_init(struct window_pane *wp)
 {
 	struct input_ctx	*ictx = &wp->ictx;
 
+	input_build_dispatch();
+
 	memcpy(&ictx->cell, &grid_default_cell, sizeof ictx->cell);
 
 	memcpy(&ictx->old_cell, &grid_default_cell, sizeof ictx->old_cell);
@@ -732,11 +868,11 @@ input_parse(struct window_pane *wp)
 {
 	struct input_ctx		*ictx = &wp->ictx;
 	const struct input_transition	*itr;
-	struct evbuffer			*evb = wp->event->input;
 	u_char				*buf;
-	size_t				 len, off;
+	size_t				 len, off, n, save_off, save_len;
 
-	if (EVBUFFER_LENGTH(evb) == 0)
+	buf = window_pane_get_new_data(wp, &wp->offset, &len);
+	if (len == 0)
 		return;
 
 	wp->window->flags |= WINDOW_ACTIVITY;
@@ -752,27 +888,40 @@ input_parse(struct window_pane *wp)
 		screen_write_start(&ictx->ctx, NULL, &wp->base);
 	ictx->wp = wp;
 
-	buf = EVBUFFER_DATA(evb);
-	len = EVBUFFER_LENGTH(evb);
-	notify_input(wp, evb);
+	notify_input(wp, buf, len);
 	off = 0;
 
+	/*
+	 * Input outside the ground state is saved in since_ground. It is
+	 * always contiguous so is collected here and added in one go.
+	 */
+	save_off = save_len = 0;
+
 	/* Parse the input. */
 	while (off < len) {
+		/*
+		 * In the ground state, write runs of printable characters
+		 * straight to the screen rather than going through the state
+		 * machine for each.
+		 */
+		if (ictx->state == &input_state_ground) {
+			n = input_ground_span(buf + off, len - off);
+			if (n != 0) {
+				screen_write_cells(&ictx->ctx, &ictx->cell,
+				    buf + off, n);
+				off += n;
+				continue;
+			}
+		}
+
 		ictx->ch = buf[off++];
-		log_debug("%s: '%c' %s", __func__, ictx->ch, ictx->state->name);
+		if (debug_level > 1) {
+			log_debug2("%s: '%c' %s", __func__, ictx->ch,
+			    ictx->state->name);
+		}
 
 		/* Find the transition. */
-		itr = ictx->state->transitions;
-		while (itr->first != -1 && itr->last != -1) {
-			if (ictx->ch >= itr->first && ictx->ch <= itr->last)
-				break;
-			itr++;
-		}
-		if (itr->first == -1 || itr->last == -1) {
-			/* No transition? Eh? */
-			fatalx("No transition from state!");
-		}
+		itr = &ictx->state->transitions[ictx->state->dispatch[ictx->ch]];
 
 		/*
 		 * Execute the handler, if any. Don't switch state if it
@@ -782,18 +931,34 @@ input_parse(struct window_pane *wp)
 			continue;
 
 		/* And switch state, if necessary. */
-		if (itr->state != NULL)
+		if (itr->state != NULL) {
+			if (save_len != 0) {
+				evbuffer_add(ictx->since_ground, buf + save_off,
+				    save_len);
+				save_len = 0;
+			}
 			input_set_state(wp, itr);
+		}
 
 		/* If not in ground state, save input. */
-		if (ictx->state != &input_state_ground)
-			evbuffer_add(ictx->since_ground, &ictx->ch, 1);
+		if (ictx->state != &input_state_ground) {
+			if (save_len != 0 && save_off + save_len != off - 1) {
+				evbuffer_add(ictx->since_ground, buf + save_off,
+				    save_len);
+				save_len = 0;
+			}
+			if (save_len == 0)
+				save_off = off - 1;
+			save_len++;
+		}
 	}
+	if (save_len != 0)
+		evbuffer_add(ictx->since_ground, buf + save_off, save_len);
 
 	/* Close the screen. */
 	screen_write_stop(&ictx->ctx);
 
-	evbuffer_drain(evb, len);
+	window_pane_update_used_data(wp, &wp->offset, len);
 }
 
 /* Split the parameter list (if any). */
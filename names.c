@@ -26,39 +26,97 @@
 
 #include "tmux.h"
 
-void window_pane_name_callback(unused int fd, unused short events, void *data);
+void	name_timer_callback(int, short, void *);
+int	name_update_pane(struct window_pane *);
 char	*parse_window_name(const char *);
 
+/*
+ * The names of all panes are checked from a single timer. A pane whose
+ * foreground process group has not changed is checked less often, backing off
+ * to every 1 << NAME_IDLE_MAX intervals, until it produces output again.
+ */
+struct event	name_timer;
+
+/* Start checking the name of a pane. */
 void
 queue_window_pane_name(struct window_pane *wp)
 {
 	struct timeval	tv;
 
+	wp->name_pgrp = 0;
+	wp->name_idle = 0;
+	wp->name_skip = 0;
+
+	if (event_initialized(&name_timer) &&
+	    evtimer_pending(&name_timer, NULL))
+		return;
+
 	tv.tv_sec = 0;
 	tv.tv_usec = NAME_INTERVAL * 1000L;
 
-	if (event_initialized(&wp->name_timer))
-		evtimer_del(&wp->name_timer);
-	evtimer_set(&wp->name_timer, window_pane_name_callback, wp);
-	evtimer_add(&wp->name_timer, &tv);
+	evtimer_set(&name_timer, name_timer_callback, NULL);
+	evtimer_add(&name_timer, &tv);
 }
 
+/* Name timer fired, check every pane. Stop when no panes need checking. */
 void
-window_pane_name_callback(unused int fd, unused short events, void *data)
+name_timer_callback(unused int fd, unused short events, unused void *data)
 {
-	struct window_pane	*wp = data;
-	struct window *w = wp->window;
-	char		*name, *wpname;
+	struct window_pane	*wp;
+	struct timeval		 tv;
+	int			 active = 0;
 
-	/* If a name has been set, or automatic-rename is off for the whole window, cancel timer. */
-	if (!wp->automatic_rename || !options_get_number(&w->options, "automatic-rename")) {
-		if (event_initialized(&wp->name_timer))
-			event_del(&wp->name_timer);
+	RB_FOREACH(wp, window_pane_tree, &all_window_panes) {
+		if (name_update_pane(wp))
+			active = 1;
+	}
+	if (!active)
 		return;
+
+	tv.tv_sec = 0;
+	tv.tv_usec = NAME_INTERVAL * 1000L;
+	evtimer_add(&name_timer, &tv);
+}
+
+/*
+ * Update the name of a pane if its foreground process group has changed.
+ * Returns 0 if the pane no longer needs to be checked.
+ */
+int
+name_update_pane(struct window_pane *wp)
+{
+	struct window	*w = wp->window;
+	char		*name, *wpname;
+	pid_t		 pgrp;
+
+	/* If a name has been set, or automatic-rename is off for the whole window, stop. */
+	if (!wp->automatic_rename || !options_get_number(&w->options, "automatic-rename"))
+		return (0);
+
+	if (wp->name_skip != 0) {
+		wp->name_skip--;
+		return (1);
+	}
+
+	/*
+	 * Only look for a new name if the process group has changed, or once
+	 * fully backed off in case the process was replaced with exec.
+	 */
+	if (wp->fd == -1 || (pgrp = tcgetpgrp(wp->fd)) == -1)
+		pgrp = -1;
+	if (pgrp == wp->name_pgrp) {
+		if (wp->name_idle < NAME_IDLE_MAX) {
+			wp->name_idle++;
+			wp->name_skip = (1 << wp->name_idle) - 1;
+			return (1);
+		}
+		wp->name_skip = (1 << NAME_IDLE_MAX) - 1;
 	}
-	queue_window_pane_name(wp);
+	wp->name_pgrp = pgrp;
 
-	name = osdep_get_name(wp->fd, wp->tty);
+	name = NULL;
+	if (wp->fd != -1)
+		name = osdep_get_name(wp->fd, wp->tty);
 
 	if (name == NULL)
 		wpname = default_window_pane_name(wp);
@@ -84,6 +142,7 @@ window_pane_name_callback(unused int fd, unused short events, void *data)
 	if (wp->name == NULL || strcmp(wpname, wp->name))
 		window_pane_set_name(wp, wpname);
 	free(wpname);
+	return (1);
 }
 
 char *
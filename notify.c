@@ -132,7 +132,7 @@ notify_drain(void)
 }
 
 void
-notify_input(struct window_pane *wp, struct evbuffer *input)
+notify_input(struct window_pane *wp, const u_char *buf, size_t len)
 {
 	struct client	*c;
 	u_int		 i;
@@ -147,7 +147,7 @@ notify_input(struct window_pane *wp, struct evbuffer *input)
 	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
 		c = ARRAY_ITEM(&clients, i);
 		if (c != NULL && (c->flags & CLIENT_CONTROL))
-			control_notify_input(c, wp, input);
+			control_notify_input(c, wp, buf, len);
 	}
 }
 
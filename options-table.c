@@ -53,6 +53,9 @@ const char *options_table_status_position_list[] = {
 const char *options_table_bell_action_list[] = {
 	"none", "any", "current", NULL
 };
+const char *options_table_pipe_pane_overflow_list[] = {
+	"block", "drop", "gap", NULL
+};
 
 /* Server options. */
 const struct options_table_entry server_options_table[] = {
@@ -169,6 +172,13 @@ const struct options_table_entry session_options_table[] = {
 	  .default_num = 750
 	},
 
+	{ .name = "history-file-limit",
+	  .type = OPTIONS_TABLE_NUMBER,
+	  .minimum = 0,
+	  .maximum = INT_MAX,
+	  .default_num = 0
+	},
+
 	{ .name = "history-limit",
 	  .type = OPTIONS_TABLE_NUMBER,
 	  .minimum = 0,
@@ -334,6 +344,13 @@ const struct options_table_entry session_options_table[] = {
 	  .default_num = 15
 	},
 
+	{ .name = "status-job-ttl",
+	  .type = OPTIONS_TABLE_NUMBER,
+	  .minimum = 0,
+	  .maximum = INT_MAX,
+	  .default_num = 0
+	},
+
 	{ .name = "status-justify",
 	  .type = OPTIONS_TABLE_CHOICE,
 	  .choices = options_table_status_justify_list,
@@ -550,6 +567,21 @@ const struct options_table_entry window_options_table[] = {
 	  .default_num = MODEKEY_EMACS
 	},
 
+	{ .name = "mode-match-attr",
+	  .type = OPTIONS_TABLE_ATTRIBUTES,
+	  .default_num = 0
+	},
+
+	{ .name = "mode-match-bg",
+	  .type = OPTIONS_TABLE_COLOUR,
+	  .default_num = 6
+	},
+
+	{ .name = "mode-match-fg",
+	  .type = OPTIONS_TABLE_COLOUR,
+	  .default_num = 0
+	},
+
 	{ .name = "mode-mouse",
 	  .type = OPTIONS_TABLE_CHOICE,
 	  .choices = options_table_mode_mouse_list,
@@ -645,11 +677,34 @@ const struct options_table_entry window_options_table[] = {
 	  .default_num = 0
 	},
 
+	{ .name = "pipe-pane-limit",
+	  .type = OPTIONS_TABLE_NUMBER,
+	  .minimum = 0,
+	  .maximum = INT_MAX,
+	  .default_num = 1048576
+	},
+
+	{ .name = "pipe-pane-overflow",
+	  .type = OPTIONS_TABLE_CHOICE,
+	  .choices = options_table_pipe_pane_overflow_list,
+	  .default_num = PIPE_GAP
+	},
+
 	{ .name = "remain-on-exit",
 	  .type = OPTIONS_TABLE_FLAG,
 	  .default_num = 0
 	},
 
+	{ .name = "search-regex",
+	  .type = OPTIONS_TABLE_FLAG,
+	  .default_num = 0
+	},
+
+	{ .name = "search-smart-case",
+	  .type = OPTIONS_TABLE_FLAG,
+	  .default_num = 0
+	},
+
 	{ .name = "synchronize-panes",
 	  .type = OPTIONS_TABLE_FLAG,
 	  .default_num = 0
@@ -20,8 +20,10 @@
 #include <sys/stat.h>
 
 #include <event.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "tmux.h"
@@ -29,34 +31,45 @@
 char *
 osdep_get_name(int fd, unused char *tty)
 {
-	FILE	*f;
 	char	*path, *buf;
-	size_t	 len;
-	int	 ch;
+	size_t	 len, size;
+	ssize_t	 n;
 	pid_t	 pgrp;
+	int	 f;
 
 	if ((pgrp = tcgetpgrp(fd)) == -1)
 		return (NULL);
 
 	xasprintf(&path, "/proc/%lld/cmdline", (long long) pgrp);
-	if ((f = fopen(path, "r")) == NULL) {
+	if ((f = open(path, O_RDONLY)) == -1) {
 		free(path);
 		return (NULL);
 	}
 	free(path);
 
+	/* Only the first argument is wanted, so stop at the first NUL. */
 	len = 0;
-	buf = NULL;
-	while ((ch = fgetc(f)) != EOF) {
-		if (ch == '\0')
+	size = 128;
+	buf = xmalloc(size);
+	for (;;) {
+		n = read(f, buf + len, size - len - 1);
+		if (n <= 0)
 			break;
-		buf = xrealloc(buf, 1, len + 2);
-		buf[len++] = ch;
+		len += n;
+		if (memchr(buf + len - n, '\0', n) != NULL)
+			break;
+		if (len == size - 1) {
+			size *= 2;
+			buf = xrealloc(buf, 1, size);
+		}
 	}
-	if (buf != NULL)
-		buf[len] = '\0';
+	close(f);
 
-	fclose(f);
+	buf[len] = '\0';
+	if (*buf == '\0') {
+		free(buf);
+		return (NULL);
+	}
 	return (buf);
 }
 
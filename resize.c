@@ -29,13 +29,14 @@
  * every window the size of the smallest session it is attached to.
  *
  * So, when a client is resized or a session attached to or detached from a
- * client, the window sizes must be recalculated. For each session, find the
- * smallest client it is attached to, and resize it to that size. Then for
- * every window, find the smallest session it is attached to, resize it to that
- * size and clear and redraw every client with it as the current window.
+ * client, the window sizes must be recalculated. For each client, find the
+ * smallest client attached to the same session, and resize the session to
+ * that size. Then for every window, find the smallest session it is attached
+ * to from its list of winlinks, resize it to that size and clear and redraw
+ * every client with it as the current window.
  *
- * This is quite inefficient - better/additional data structures are needed
- * to make it better.
+ * Each session, client, window and winlink is only looked at once or twice,
+ * so this stays cheap with many sessions and windows.
  *
  * As a side effect, this function updates the SESSION_UNATTACHED flag. This
  * flag is necessary to make sure unattached sessions do not limit the size of
@@ -48,15 +49,29 @@ recalculate_sizes(void)
 	struct session		*s;
 	struct client		*c;
 	struct window		*w;
+	struct winlink		*wl;
 	struct window_pane	*wp;
-	u_int			 i, j, ssx, ssy, has, limit;
-	int			 flag, has_status, is_zoomed;
+	u_int			 i, j, ssx, ssy, csx, csy, limit;
+	int			 has_status, is_zoomed;
 
-	RB_FOREACH(s, sessions, &sessions) {
+	/* Sessions are unattached until a client is found for them. */
+	RB_FOREACH(s, sessions, &sessions)
+		s->flags |= SESSION_UNATTACHED;
+
+	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
+		c = ARRAY_ITEM(&clients, i);
+		if (c == NULL || c->flags & CLIENT_SUSPENDED)
+			continue;
+		s = c->session;
+		if (s == NULL || !(s->flags & SESSION_UNATTACHED))
+			continue;
+		s->flags &= ~SESSION_UNATTACHED;
+
+		/* No earlier client has this session, so start from here. */
 		has_status = options_get_number(&s->options, "status");
 
 		ssx = ssy = UINT_MAX;
-		for (j = 0; j < ARRAY_LENGTH(&clients); j++) {
+		for (j = i; j < ARRAY_LENGTH(&clients); j++) {
 			c = ARRAY_ITEM(&clients, j);
 			if (c == NULL || c->flags & CLIENT_SUSPENDED)
 				continue;
@@ -71,11 +86,6 @@ recalculate_sizes(void)
 					ssy = c->tty.sy;
 			}
 		}
-		if (ssx == UINT_MAX || ssy == UINT_MAX) {
-			s->flags |= SESSION_UNATTACHED;
-			continue;
-		}
-		s->flags &= ~SESSION_UNATTACHED;
 
 		if (has_status && ssy == 0)
 			ssy = 1;
@@ -94,26 +104,37 @@ recalculate_sizes(void)
 		w = ARRAY_ITEM(&windows, i);
 		if (w == NULL)
 			continue;
-		flag = options_get_number(&w->options, "aggressive-resize");
 
-		ssx = ssy = UINT_MAX;
-		RB_FOREACH(s, sessions, &sessions) {
+		/*
+		 * Find the smallest attached session with this window, and
+		 * the smallest with it as the current window.
+		 */
+		ssx = ssy = csx = csy = UINT_MAX;
+		TAILQ_FOREACH(wl, &w->winlinks, wentry) {
+			s = wl->session;
 			if (s->flags & SESSION_UNATTACHED)
 				continue;
-			if (flag)
-				has = s->curw->window == w;
-			else
-				has = session_has(s, w) != NULL;
-			if (has) {
-				if (s->sx < ssx)
-					ssx = s->sx;
-				if (s->sy < ssy)
-					ssy = s->sy;
-			}
+			if (s->sx < ssx)
+				ssx = s->sx;
+			if (s->sy < ssy)
+				ssy = s->sy;
+			if (s->curw == NULL || s->curw->window != w)
+				continue;
+			if (s->sx < csx)
+				csx = s->sx;
+			if (s->sy < csy)
+				csy = s->sy;
 		}
 		if (ssx == UINT_MAX || ssy == UINT_MAX)
 			continue;
 
+		if (options_get_number(&w->options, "aggressive-resize")) {
+			if (csx == UINT_MAX || csy == UINT_MAX)
+				continue;
+			ssx = csx;
+			ssy = csy;
+		}
+
 		limit = options_get_number(&w->options, "force-width");
 		if (limit != 0 && ssx > limit)
 			ssx = limit;
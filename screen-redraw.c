@@ -353,7 +353,7 @@ screen_redraw_screen(struct client *c, int status_only, int borders_only)
 	struct options		*woo = &w->options;
 	struct tty		*tty = &c->tty;
 	struct window_pane	*wp;
-	struct grid_cell	 active_gc, other_gc;
+	struct grid_cell	 active_gc, other_gc, *gc;
 	u_int		 	 i, j, type, top;
 	int		 	 status, pane_status, pane_status_at_top, spos, fg, bg, attr;
 
@@ -412,9 +412,13 @@ screen_redraw_screen(struct client *c, int status_only, int borders_only)
 			if (type == CELL_INSIDE)
 				continue;
 			if (screen_redraw_check_active(i, j, type, w, wp))
-				tty_attributes(tty, &active_gc);
+				gc = &active_gc;
 			else
-				tty_attributes(tty, &other_gc);
+				gc = &other_gc;
+			grid_cell_one(gc, CELL_BORDERS[type]);
+			if (tty_frame_same(tty, i, top + j, gc))
+				continue;
+			tty_attributes(tty, gc);
 			tty_cursor(tty, i, top + j);
 			tty_putc(tty, CELL_BORDERS[type]);
 		}
@@ -542,7 +546,8 @@ draw_text:
 	else
 		colour_set_fg(&gc, colour);
 	tty_attributes(tty, &gc);
-	tty_puts(tty, buf);
+	for (ptr = buf; *ptr != '\0'; ptr++)
+		tty_putc(tty, *ptr);
 
 	tty_cursor(tty, 0, 0);
 }
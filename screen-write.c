@@ -71,6 +71,67 @@ screen_write_putc(struct screen_write_ctx *ctx, struct grid_cell *gc, u_char ch)
 	screen_write_cell(ctx, gc);
 }
 
+/*
+ * Write a run of printable ASCII characters, all with the same attributes. As
+ * much of the run as fits on the current line is put into the grid and sent
+ * to the tty in one go. The cell is left holding the last character.
+ */
+void
+screen_write_cells(struct screen_write_ctx *ctx, struct grid_cell *gc,
+    const u_char *buf, u_int len)
+{
+	struct screen	*s = ctx->s;
+	struct grid	*gd = s->grid;
+	struct tty_ctx	 ttyctx;
+	u_int		 n, last;
+
+	if (len == 0)
+		return;
+
+	last = !(s->mode & MODE_WRAP);
+	while (len != 0) {
+		/*
+		 * Insert mode, selection and the last column when not
+		 * wrapping are rare, so just write a cell at a time.
+		 */
+		if ((s->mode & MODE_INSERT) || s->sel.flag ||
+		    s->cy > screen_size_y(s) - 1 ||
+		    (last && s->cx >= screen_size_x(s) - 1)) {
+			grid_cell_one(gc, *buf);
+			screen_write_cell(ctx, gc);
+			buf++;
+			len--;
+			continue;
+		}
+
+		/* Initialise the redraw context, saving the last cell. */
+		screen_write_initctx(ctx, &ttyctx, 1);
+
+		/* Wrap if at the end of the line. */
+		if (s->cx > screen_size_x(s) - 1) {
+			screen_write_linefeed(ctx, 1);
+			s->cx = 0;	/* carriage return */
+		}
+
+		/* Fill as much of the line as possible. */
+		n = screen_size_x(s) - last - s->cx;
+		if (n > len)
+			n = len;
+		screen_write_overwrite(ctx, n);
+		grid_view_set_cells(gd, s->cx, s->cy, gc, buf, n);
+		s->cx += n;
+
+		ttyctx.cell = gc;
+		ttyctx.ptr = (void *) buf;
+		ttyctx.num = n;
+		tty_write(tty_cmd_cells, &ttyctx);
+
+		buf += n;
+		len -= n;
+	}
+	grid_cell_one(gc, buf[-1]);
+}
+
 /* Calculate string length, with embedded formatting. */
 size_t printflike2
 screen_write_cstrlen(int utf8flag, const char *fmt, ...)
@@ -403,14 +464,13 @@ screen_write_copy(struct screen_write_ctx *ctx,
 	struct screen		*s = ctx->s;
 	struct grid		*gd = src->grid;
 	struct grid_line	*gl;
-	const struct grid_cell	*gc;
-	struct utf8_data	 ud;
+	struct grid_cell	 gc;
 	u_int		 	 xx, yy, cx, cy, ax, bx;
 
 	cx = s->cx;
 	cy = s->cy;
 	for (yy = py; yy < py + ny; yy++) {
-		gl = &gd->linedata[yy];
+		gl = grid_get_line(gd, yy);
 		if (yy < gd->hsize + gd->sy) {
 			/*
 			 * Find start and end position and copy between
@@ -428,12 +488,8 @@ screen_write_copy(struct screen_write_ctx *ctx,
 				bx = px + nx;
 
 			for (xx = ax; xx < bx; xx++) {
-				if (xx >= gl->cellsize)
-					gc = &grid_default_cell;
-				else
-					gc = &gl->celldata[xx];
-				grid_cell_get(gc, &ud);
-				screen_write_cell(ctx, gc);
+				grid_get_cell(gd, xx, yy, &gc);
+				screen_write_cell(ctx, &gc);
 			}
 			if (px + nx == gd->sx && px + nx > gl->cellsize)
 				screen_write_clearendofline(ctx);
@@ -451,7 +507,7 @@ screen_write_initctx(
 {
 	struct screen		*s = ctx->s;
 	struct grid		*gd = s->grid;
-	const struct grid_cell	*gc;
+	struct grid_cell	 gc;
 	u_int			 xx;
 
 	ttyctx->wp = ctx->wp;
@@ -466,14 +522,14 @@ screen_write_initctx(
 		return;
 
 	/* Save the last cell on the screen. */
-	gc = &grid_default_cell;
+	memcpy(&gc, &grid_default_cell, sizeof gc);
 	for (xx = 1; xx <= screen_size_x(s); xx++) {
-		gc = grid_view_peek_cell(gd, screen_size_x(s) - xx, s->cy);
-		if (!(gc->flags & GRID_FLAG_PADDING))
+		grid_view_get_cell(gd, screen_size_x(s) - xx, s->cy, &gc);
+		if (!(gc.flags & GRID_FLAG_PADDING))
 			break;
 	}
 	ttyctx->last_width = xx;
-	memcpy(&ttyctx->last_cell, gc, sizeof ttyctx->last_cell);
+	memcpy(&ttyctx->last_cell, &gc, sizeof ttyctx->last_cell);
 }
 
 /* Set a mode. */
@@ -586,7 +642,7 @@ screen_write_backspace(struct screen_write_ctx *ctx)
 	if (s->cx == 0) {
 		if (s->cy == 0)
 			return;
-		gl = &s->grid->linedata[s->grid->hsize + s->cy - 1];
+		gl = grid_get_line(s->grid, s->grid->hsize + s->cy - 1);
 		if (gl->flags & GRID_LINE_WRAPPED) {
 			s->cy--;
 			s->cx = screen_size_x(s) - 1;
@@ -894,7 +950,7 @@ screen_write_linefeed(struct screen_write_ctx *ctx, int wrapped)
 
 	screen_write_initctx(ctx, &ttyctx, 0);
 
-	gl = &s->grid->linedata[s->grid->hsize + s->cy];
+	gl = grid_get_line(s->grid, s->grid->hsize + s->cy);
 	if (wrapped)
 		gl->flags |= GRID_LINE_WRAPPED;
 	else
@@ -989,11 +1045,7 @@ screen_write_clearscreen(struct screen_write_ctx *ctx)
 void
 screen_write_clearhistory(struct screen_write_ctx *ctx)
 {
-	struct screen	*s = ctx->s;
-	struct grid	*gd = s->grid;
-
-	grid_move_lines(gd, 0, gd->hsize, gd->sy);
-	gd->hsize = 0;
+	grid_clear_history(ctx->s->grid);
 }
 
 /* Write cell data. */
@@ -1004,7 +1056,7 @@ screen_write_cell(struct screen_write_ctx *ctx, const struct grid_cell *gc)
 	struct grid		*gd = s->grid;
 	struct tty_ctx		 ttyctx;
 	u_int		 	 width, xx, last;
-	struct grid_cell 	 tmp_gc, *tmp_gcp;
+	struct grid_cell 	 tmp_gc;
 	struct utf8_data	 ud;
 	int			 insert;
 
@@ -1065,9 +1117,9 @@ screen_write_cell(struct screen_write_ctx *ctx, const struct grid_cell *gc)
 	 * already ensured there is enough room.
 	 */
 	for (xx = s->cx + 1; xx < s->cx + width; xx++) {
-		tmp_gcp = grid_view_get_cell(gd, xx, s->cy);
-		if (tmp_gcp != NULL)
-			tmp_gcp->flags |= GRID_FLAG_PADDING;
+		grid_view_get_cell(gd, xx, s->cy, &tmp_gc);
+		tmp_gc.flags |= GRID_FLAG_PADDING;
+		grid_view_set_cell(gd, xx, s->cy, &tmp_gc);
 	}
 
 	/* Set the cell. */
@@ -1109,7 +1161,7 @@ screen_write_combine(struct screen_write_ctx *ctx, const struct utf8_data *ud)
 {
 	struct screen		*s = ctx->s;
 	struct grid		*gd = s->grid;
-	struct grid_cell	*gc;
+	struct grid_cell	 gc;
 	struct utf8_data	 ud1;
 
 	/* Can't combine if at 0. */
@@ -1121,8 +1173,8 @@ screen_write_combine(struct screen_write_ctx *ctx, const struct utf8_data *ud)
 		fatalx("UTF-8 data empty");
 
 	/* Retrieve the previous cell. */
-	gc = grid_view_get_cell(gd, s->cx - 1, s->cy);
-	grid_cell_get(gc, &ud1);
+	grid_view_get_cell(gd, s->cx - 1, s->cy, &gc);
+	grid_cell_get(&gc, &ud1);
 
 	/* Check there is enough space. */
 	if (ud1.size + ud->size > sizeof ud1.data)
@@ -1131,7 +1183,8 @@ screen_write_combine(struct screen_write_ctx *ctx, const struct utf8_data *ud)
 	/* Append the data and set the cell. */
 	memcpy(ud1.data + ud1.size, ud->data, ud->size);
 	ud1.size += ud->size;
-	grid_cell_set(gc, &ud1);
+	grid_cell_set(&gc, &ud1);
+	grid_view_set_cell(gd, s->cx - 1, s->cy, &gc);
 
 	return (0);
 }
@@ -1150,11 +1203,11 @@ screen_write_overwrite(struct screen_write_ctx *ctx, u_int width)
 {
 	struct screen		*s = ctx->s;
 	struct grid		*gd = s->grid;
-	const struct grid_cell	*gc;
+	struct grid_cell	 gc;
 	u_int			 xx;
 
-	gc = grid_view_peek_cell(gd, s->cx, s->cy);
-	if (gc->flags & GRID_FLAG_PADDING) {
+	grid_view_get_cell(gd, s->cx, s->cy, &gc);
+	if (gc.flags & GRID_FLAG_PADDING) {
 		/*
 		 * A padding cell, so clear any following and leading padding
 		 * cells back to the character. Don't overwrite the current
@@ -1162,8 +1215,8 @@ screen_write_overwrite(struct screen_write_ctx *ctx, u_int width)
 		 */
 		xx = s->cx + 1;
 		while (--xx > 0) {
-			gc = grid_view_peek_cell(gd, xx, s->cy);
-			if (!(gc->flags & GRID_FLAG_PADDING))
+			grid_view_get_cell(gd, xx, s->cy, &gc);
+			if (!(gc.flags & GRID_FLAG_PADDING))
 				break;
 			grid_view_set_cell(gd, xx, s->cy, &grid_default_cell);
 		}
@@ -1178,8 +1231,8 @@ screen_write_overwrite(struct screen_write_ctx *ctx, u_int width)
 	 */
 	xx = s->cx + width - 1;
 	while (++xx < screen_size_x(s)) {
-		gc = grid_view_peek_cell(gd, xx, s->cy);
-		if (!(gc->flags & GRID_FLAG_PADDING))
+		grid_view_get_cell(gd, xx, s->cy, &gc);
+		if (!(gc.flags & GRID_FLAG_PADDING))
 			break;
 		grid_view_set_cell(gd, xx, s->cy, &grid_default_cell);
 	}
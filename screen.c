@@ -210,7 +210,7 @@ screen_resize_y(struct screen *s, u_int sy)
 		 */
 		available = s->cy;
 		if (gd->flags & GRID_HISTORY)
-			gd->hsize += needed;
+			grid_grow_history(gd, needed);
 		else if (needed > 0 && available > 0) {
 			if (available > needed)
 				available = needed;
@@ -220,8 +220,7 @@ screen_resize_y(struct screen *s, u_int sy)
 	}
 
 	/* Resize line arrays. */
-	gd->linedata = xrealloc(
-	    gd->linedata, gd->hsize + sy, sizeof *gd->linedata);
+	grid_reserve_lines(gd, gd->hsize + sy);
 
 	/* Size increasing. */
 	if (sy > oldy) {
@@ -231,11 +230,11 @@ screen_resize_y(struct screen *s, u_int sy)
 		 * Try to pull as much as possible out of the history, if is
 		 * is enabled.
 		 */
-		available = gd->hsize;
+		available = gd->hsize - gd->ssize;
 		if (gd->flags & GRID_HISTORY && available > 0) {
 			if (available > needed)
 				available = needed;
-			gd->hsize -= available;
+			grid_shrink_history(gd, available);
 			s->cy += available;
 		} else
 			available = 0;
@@ -243,7 +242,7 @@ screen_resize_y(struct screen *s, u_int sy)
 
 		/* Then fill the rest in with blanks. */
 		for (i = gd->hsize + sy - needed; i < gd->hsize + sy; i++)
-			memset(&gd->linedata[i], 0, sizeof gd->linedata[i]);
+			memset(grid_get_line(gd, i), 0, sizeof *gd->linedata);
 	}
 
 	/* Set the new size, and reset the scroll region. */
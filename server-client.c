@@ -18,6 +18,7 @@
 
 #include <sys/types.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 
 #include <event.h>
 #include <fcntl.h>
@@ -37,6 +38,12 @@ void	server_client_check_redraw(struct client *);
 void	server_client_set_title(struct client *);
 void	server_client_reset_state(struct client *);
 int	server_client_assume_paste(struct session *);
+void	server_client_update_activity(struct client *, struct session *);
+void	server_client_stdin_callback(struct bufferevent *, void *);
+void	server_client_stdin_error(struct bufferevent *, short, void *);
+void	server_client_stdout_error(struct bufferevent *, short, void *);
+int	server_client_direct(int, int);
+void	server_client_open_stdout(struct client *, int);
 
 int	server_client_msg_dispatch(struct client *);
 void	server_client_msg_command(struct client *, struct msg_command_data *);
@@ -69,6 +76,11 @@ server_client_create(int fd)
 	c->stdout_data = evbuffer_new ();
 	c->stderr_data = evbuffer_new ();
 
+	c->stdin_fd = -1;
+	c->stdin_event = NULL;
+	c->stdout_fd = -1;
+	c->stdout_event = NULL;
+
 	c->tty.fd = -1;
 	c->title = NULL;
 
@@ -78,8 +90,11 @@ server_client_create(int fd)
 	c->tty.sy = 24;
 
 	screen_init(&c->status, c->tty.sx, 1, 0);
-	RB_INIT(&c->status_new);
-	RB_INIT(&c->status_old);
+	ARRAY_INIT(&c->status_entries);
+
+	c->control_flags = 0;
+	c->control_high_water = 0;
+	RB_INIT(&c->control_panes);
 
 	c->message_string = NULL;
 	ARRAY_INIT(&c->message_log);
@@ -142,6 +157,8 @@ server_client_lost(struct client *c)
 		if (ARRAY_ITEM(&clients, i) == c)
 			ARRAY_SET(&clients, i, NULL);
 	}
+	if (c->session != NULL)
+		TAILQ_REMOVE(&c->session->clients, c, sentry);
 	log_debug("lost client %d", c->ibuf.fd);
 
 	/*
@@ -156,9 +173,23 @@ server_client_lost(struct client *c)
 	if (c->stderr_data != c->stdout_data)
 		evbuffer_free (c->stderr_data);
 
-	status_free_jobs(&c->status_new);
-	status_free_jobs(&c->status_old);
+	if (c->stdin_event != NULL)
+		bufferevent_free(c->stdin_event);
+	if (c->stdin_fd != -1) {
+		setblocking(c->stdin_fd, 1);
+		close(c->stdin_fd);
+	}
+	if (c->stdout_event != NULL)
+		bufferevent_free(c->stdout_event);
+	if (c->stdout_fd != -1) {
+		setblocking(c->stdout_fd, 1);
+		close(c->stdout_fd);
+	}
+
 	screen_free(&c->status);
+	status_free_entries(c);
+
+	control_free_panes(c);
 
 	free(c->title);
 
@@ -208,6 +239,20 @@ server_client_lost(struct client *c)
 	server_update_socket();
 }
 
+/*
+ * Change the session a client is attached to, keeping the session's list of
+ * clients up to date. Dead clients are no longer on any list.
+ */
+void
+server_client_set_session(struct client *c, struct session *s)
+{
+	if (!(c->flags & CLIENT_DEAD) && c->session != NULL)
+		TAILQ_REMOVE(&c->session->clients, c, sentry);
+	c->session = s;
+	if (!(c->flags & CLIENT_DEAD) && s != NULL)
+		TAILQ_INSERT_TAIL(&s->clients, c, sentry);
+}
+
 /* Process a single client event. */
 void
 server_client_callback(int fd, short events, void *data)
@@ -241,6 +286,111 @@ client_lost:
 	server_client_lost(c);
 }
 
+/*
+ * Can a client's stdin or stdout be used directly? Pipes and sockets can, and
+ * so can the terminal of a control client. Anything else either cannot be
+ * polled (files) or is left to the client (normal terminals).
+ */
+int
+server_client_direct(int fd, int flags)
+{
+	struct stat	sb;
+
+	if (fstat(fd, &sb) != 0)
+		return (0);
+	if (S_ISFIFO(sb.st_mode) || S_ISSOCK(sb.st_mode))
+		return (1);
+	return ((flags & IDENTIFY_CONTROL) && isatty(fd));
+}
+
+/*
+ * Start reading stdin for a client: from its stdin directly if the server has
+ * it, otherwise by asking the client to send it.
+ */
+void
+server_client_read_stdin(struct client *c)
+{
+	if (c->stdin_fd == -1) {
+		server_write_client(c, MSG_STDIN, NULL, 0);
+		return;
+	}
+
+	if (c->stdin_event == NULL) {
+		setblocking(c->stdin_fd, 0);
+		c->stdin_event = bufferevent_new(c->stdin_fd,
+		    server_client_stdin_callback, NULL,
+		    server_client_stdin_error, c);
+	}
+	bufferevent_enable(c->stdin_event, EV_READ);
+}
+
+/* Client stdin has data. */
+void
+server_client_stdin_callback(unused struct bufferevent *bufev, void *data)
+{
+	struct client	*c = data;
+
+	if (c->stdin_callback == NULL) {
+		bufferevent_disable(c->stdin_event, EV_READ);
+		return;
+	}
+
+	evbuffer_add_buffer(c->stdin_data, c->stdin_event->input);
+	c->stdin_callback(c, c->stdin_closed, c->stdin_callback_data);
+}
+
+/* Client stdin is closed or there is an error reading it. */
+void
+server_client_stdin_error(
+    unused struct bufferevent *bufev, unused short what, void *data)
+{
+	struct client	*c = data;
+
+	bufferevent_disable(c->stdin_event, EV_READ);
+
+	c->stdin_closed = 1;
+	if (c->stdin_callback != NULL)
+		c->stdin_callback(c, 1, c->stdin_callback_data);
+}
+
+/*
+ * Write to a client's stdout directly. If it fails, anything further is sent
+ * to the client instead.
+ */
+void
+server_client_open_stdout(struct client *c, int fd)
+{
+	c->stdout_fd = fd;
+
+	setblocking(fd, 0);
+	c->stdout_event = bufferevent_new(fd, NULL, NULL,
+	    server_client_stdout_error, c);
+	bufferevent_enable(c->stdout_event, EV_WRITE);
+}
+
+/*
+ * Error writing to client stdout. Anything not yet written is handed back to
+ * be sent through the client instead.
+ */
+void
+server_client_stdout_error(
+    unused struct bufferevent *bufev, unused short what, void *data)
+{
+	struct client	*c = data;
+	struct evbuffer	*output = c->stdout_event->output;
+
+	evbuffer_add_buffer(output, c->stdout_data);
+	evbuffer_add_buffer(c->stdout_data, output);
+
+	bufferevent_free(c->stdout_event);
+	c->stdout_event = NULL;
+	setblocking(c->stdout_fd, 1);
+	close(c->stdout_fd);
+	c->stdout_fd = -1;
+
+	server_push_stdout(c);
+}
+
 /* Handle client status timer. */
 void
 server_client_status_timer(void)
@@ -274,11 +424,11 @@ server_client_status_timer(void)
 		interval = options_get_number(&s->options, "status-interval");
 
 		difference = tv.tv_sec - c->status_timer.tv_sec;
-		if (difference >= interval) {
-			status_update_jobs(c);
-			c->flags |= CLIENT_STATUS;
-		}
+		if (difference >= interval)
+			c->flags |= CLIENT_STATUSUPDATE;
 	}
+
+	status_expire_jobs();
 }
 
 /* Check for mouse keys. */
@@ -350,6 +500,78 @@ server_client_assume_paste(struct session *s)
 	return (0);
 }
 
+/* Update client and session activity times when a key is pressed. */
+void
+server_client_update_activity(struct client *c, struct session *s)
+{
+	if (gettimeofday(&c->activity_time, NULL) != 0)
+		fatal("gettimeofday failed");
+
+	memcpy(&s->last_activity_time, &s->activity_time,
+	    sizeof s->last_activity_time);
+	memcpy(&s->activity_time, &c->activity_time, sizeof s->activity_time);
+}
+
+/*
+ * Handle a run of plain bytes from the client, as when text is pasted. As many
+ * as would each be written unchanged to the active pane by
+ * server_client_handle_key are written in one go, stopping at the first which
+ * is a prefix or bound key. Returns the number of bytes used, or zero if the
+ * client is in any state where keys need more than writing to the pane.
+ */
+size_t
+server_client_handle_text(struct client *c, const u_char *buf, size_t len)
+{
+	struct session		*s;
+	struct window		*w;
+	struct window_pane	*wp, *wp2;
+	u_char			 special[256];
+	int			 prefix, prefix2;
+	size_t			 n;
+
+	if (c->flags & (CLIENT_DEAD|CLIENT_SUSPENDED|CLIENT_IDENTIFY|
+	    CLIENT_READONLY|CLIENT_PREFIX))
+		return (0);
+	if ((s = c->session) == NULL || c->prompt_string != NULL)
+		return (0);
+	w = s->curw->window;
+	wp = w->active;
+	if (wp->mode != NULL || wp->fd == -1 || !window_pane_visible(wp))
+		return (0);
+
+	/* Find how many bytes are neither prefix nor bound, once per byte. */
+	prefix = options_get_number(&s->options, "prefix");
+	prefix2 = options_get_number(&s->options, "prefix2");
+	memset(special, 0xff, sizeof special);
+	for (n = 0; n < len; n++) {
+		if (special[buf[n]] == 0xff) {
+			special[buf[n]] = buf[n] == prefix ||
+			    buf[n] == prefix2 ||
+			    key_bindings_lookup(buf[n]) != NULL;
+		}
+		if (special[buf[n]])
+			break;
+	}
+	if (n == 0)
+		return (0);
+	log_debug("text %zu of %zu bytes to %%%u", n, len, wp->id);
+
+	server_client_update_activity(c, s);
+	status_message_clear(c);
+	server_clear_identify(c);
+
+	bufferevent_write(wp->event, buf, n);
+	if (options_get_number(&w->options, "synchronize-panes")) {
+		TAILQ_FOREACH(wp2, &w->panes, entry) {
+			if (wp2 == wp || wp2->mode != NULL)
+				continue;
+			if (wp2->fd != -1 && window_pane_visible(wp2))
+				bufferevent_write(wp2->event, buf, n);
+		}
+	}
+	return (n);
+}
+
 /* Handle data key input from client. */
 void
 server_client_handle_key(struct client *c, int key)
@@ -370,12 +592,7 @@ server_client_handle_key(struct client *c, int key)
 	s = c->session;
 
 	/* Update the activity timer. */
-	if (gettimeofday(&c->activity_time, NULL) != 0)
-		fatal("gettimeofday failed");
-
-	memcpy(&s->last_activity_time, &s->activity_time,
-	    sizeof s->last_activity_time);
-	memcpy(&s->activity_time, &c->activity_time, sizeof s->activity_time);
+	server_client_update_activity(c, s);
 
 	w = c->session->curw->window;
 	wp = w->active;
@@ -500,6 +717,10 @@ server_client_loop(void)
 			server_client_check_redraw(c);
 			server_client_reset_state(c);
 		}
+
+		/* Write all output to the terminal at once. */
+		if (c->tty.flags & TTY_STARTED)
+			tty_flush(&c->tty);
 	}
 
 	/*
@@ -553,7 +774,7 @@ server_client_check_resize(struct window_pane *wp)
 void
 server_client_check_focus(struct window_pane *wp)
 {
-	u_int		 i;
+	struct winlink	*wl;
 	struct client	*c;
 
 	/* If we don't care about focus, forget it. */
@@ -572,18 +793,15 @@ server_client_check_focus(struct window_pane *wp)
 	 * If our window is the current window in any focused clients with an
 	 * attached session, we're focused.
 	 */
-	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
-		c = ARRAY_ITEM(&clients, i);
-		if (c == NULL || c->session == NULL)
-			continue;
-
-		if (!(c->flags & CLIENT_FOCUSED))
+	TAILQ_FOREACH(wl, &wp->window->winlinks, wentry) {
+		if (wl->session->curw != wl)
 			continue;
-		if (c->session->flags & SESSION_UNATTACHED)
+		if (wl->session->flags & SESSION_UNATTACHED)
 			continue;
-
-		if (c->session->curw->window == wp->window)
-			goto focused;
+		TAILQ_FOREACH(c, &wl->session->clients, sentry) {
+			if (c->flags & CLIENT_FOCUSED)
+				goto focused;
+		}
 	}
 
 not_focused:
@@ -704,6 +922,9 @@ server_client_check_exit(struct client *c)
 		return;
 	if (EVBUFFER_LENGTH(c->stderr_data) != 0)
 		return;
+	if (c->stdout_event != NULL &&
+	    EVBUFFER_LENGTH(c->stdout_event->output) != 0)
+		return;
 
 	exitdata.retcode = c->retcode;
 	server_write_client(c, MSG_EXIT, &exitdata, sizeof exitdata);
@@ -727,7 +948,7 @@ server_client_check_redraw(struct client *c)
 	c->tty.flags &= ~TTY_FREEZE;
 
 	pane_status = 0;
-	if (c->flags & (CLIENT_REDRAW|CLIENT_STATUS)) {
+	if (c->flags & (CLIENT_REDRAW|CLIENT_STATUS|CLIENT_STATUSUPDATE)) {
 		if (options_get_number(&s->options, "set-titles"))
 			server_client_set_title(c);
 
@@ -741,7 +962,9 @@ server_client_check_redraw(struct client *c)
 			redraw = status_prompt_redraw(c);
 		else
 			redraw = status_redraw(c);
-		if (!redraw)
+		if (redraw)
+			c->flags |= CLIENT_STATUS;
+		else
 			c->flags &= ~CLIENT_STATUS;
 	}
 
@@ -770,7 +993,8 @@ server_client_check_redraw(struct client *c)
 
 	c->tty.flags |= flags;
 
-	c->flags &= ~(CLIENT_REDRAW|CLIENT_STATUS|CLIENT_BORDERS);
+	c->flags &= ~(CLIENT_REDRAW|CLIENT_STATUS|CLIENT_STATUSUPDATE|
+	    CLIENT_BORDERS);
 }
 
 /* Set client title. */
@@ -800,7 +1024,6 @@ server_client_msg_dispatch(struct client *c)
 	struct msg_command_data	 commanddata;
 	struct msg_identify_data identifydata;
 	struct msg_environ_data	 environdata;
-	struct msg_stdin_data	 stdindata;
 	ssize_t			 n, datalen;
 
 	if ((n = imsg_read(&c->ibuf)) == -1 || n == 0)
@@ -828,6 +1051,15 @@ server_client_msg_dispatch(struct client *c)
 			memcpy(&commanddata, imsg.data, sizeof commanddata);
 
 			server_client_msg_command(c, &commanddata);
+
+			/*
+			 * Control clients read stdin directly only once the
+			 * first command has run, so it cannot get ahead.
+			 */
+			if (c->flags & CLIENT_CONTROL &&
+			    c->stdin_fd != -1 &&
+			    c->stdin_event == NULL)
+				server_client_read_stdin(c);
 			break;
 		case MSG_IDENTIFY:
 			if (datalen != sizeof identifydata)
@@ -838,19 +1070,26 @@ server_client_msg_dispatch(struct client *c)
 
 			server_client_msg_identify(c, &identifydata, imsg.fd);
 			break;
+		case MSG_IDENTIFY_STDOUT:
+			if (datalen != 0)
+				fatalx("bad MSG_IDENTIFY_STDOUT size");
+			if (imsg.fd == -1)
+				fatalx("MSG_IDENTIFY_STDOUT missing fd");
+
+			if (c->stdout_fd != -1)
+				close(c->stdout_fd);
+			c->stdout_fd = imsg.fd;
+			break;
 		case MSG_STDIN:
-			if (datalen != sizeof stdindata)
+			if ((size_t)datalen > STDIO_DATA_SIZE)
 				fatalx("bad MSG_STDIN size");
-			memcpy(&stdindata, imsg.data, sizeof stdindata);
 
 			if (c->stdin_callback == NULL)
 				break;
-			if (stdindata.size <= 0)
+			if (datalen == 0)
 				c->stdin_closed = 1;
-			else {
-				evbuffer_add(c->stdin_data, stdindata.data,
-				    stdindata.size);
-			}
+			else
+				evbuffer_add(c->stdin_data, imsg.data, datalen);
 			c->stdin_callback(c, c->stdin_closed,
 			    c->stdin_callback_data);
 			break;
@@ -869,7 +1108,7 @@ server_client_msg_dispatch(struct client *c)
 			if (datalen != 0)
 				fatalx("bad MSG_EXITING size");
 
-			c->session = NULL;
+			server_client_set_session(c, NULL);
 			tty_close(&c->tty);
 			server_write_client(c, MSG_EXITED, NULL, 0);
 			break;
@@ -958,11 +1197,23 @@ void
 server_client_msg_identify(
     struct client *c, struct msg_identify_data *data, int fd)
 {
+	int	stdout_fd;
+
 	c->cwd = NULL;
 	data->cwd[(sizeof data->cwd) - 1] = '\0';
 	if (*data->cwd != '\0')
 		c->cwd = xstrdup(data->cwd);
 
+	/* Write straight to stdout if possible rather than via the client. */
+	stdout_fd = c->stdout_fd;
+	c->stdout_fd = -1;
+	if (stdout_fd != -1) {
+		if (server_client_direct(stdout_fd, data->flags))
+			server_client_open_stdout(c, stdout_fd);
+		else
+			close(stdout_fd);
+	}
+
 	if (data->flags & IDENTIFY_CONTROL) {
 		c->stdin_callback = control_callback;
 		evbuffer_free(c->stderr_data);
@@ -970,17 +1221,24 @@ server_client_msg_identify(
 		c->flags |= CLIENT_CONTROL;
 		if (data->flags & IDENTIFY_TERMIOS)
 			evbuffer_add_printf(c->stdout_data, "\033P1000p");
-		server_write_client(c, MSG_STDIN, NULL, 0);
 
 		c->tty.fd = -1;
 		c->tty.log_fd = -1;
 
-		close(fd);
+		if (server_client_direct(fd, data->flags))
+			c->stdin_fd = fd;
+		else {
+			close(fd);
+			server_client_read_stdin(c);
+		}
 		return;
 	}
 
 	if (!isatty(fd)) {
-		close(fd);
+		if (server_client_direct(fd, data->flags))
+			c->stdin_fd = fd;
+		else
+			close(fd);
 		return;
 	}
 	data->term[(sizeof data->term) - 1] = '\0';
@@ -159,14 +159,13 @@ server_status_session_group(struct session *s)
 void
 server_redraw_window(struct window *w)
 {
+	struct winlink	*wl;
 	struct client	*c;
-	u_int		 i;
 
-	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
-		c = ARRAY_ITEM(&clients, i);
-		if (c == NULL || c->session == NULL)
+	TAILQ_FOREACH(wl, &w->winlinks, wentry) {
+		if (wl->session->curw != wl)
 			continue;
-		if (c->session->curw->window == w)
+		TAILQ_FOREACH(c, &wl->session->clients, sentry)
 			server_redraw_client(c);
 	}
 	w->flags |= WINDOW_REDRAW;
@@ -175,14 +174,13 @@ server_redraw_window(struct window *w)
 void
 server_redraw_window_borders(struct window *w)
 {
+	struct winlink	*wl;
 	struct client	*c;
-	u_int		 i;
 
-	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
-		c = ARRAY_ITEM(&clients, i);
-		if (c == NULL || c->session == NULL)
+	TAILQ_FOREACH(wl, &w->winlinks, wentry) {
+		if (wl->session->curw != wl)
 			continue;
-		if (c->session->curw->window == w)
+		TAILQ_FOREACH(c, &wl->session->clients, sentry)
 			c->flags |= CLIENT_BORDERS;
 	}
 }
@@ -190,17 +188,20 @@ server_redraw_window_borders(struct window *w)
 void
 server_status_window(struct window *w)
 {
-	struct session	*s;
+	struct winlink	*wl;
+	struct client	*c;
 
 	/*
 	 * This is slightly different. We want to redraw the status line of any
 	 * clients containing this window rather than anywhere it is the
-	 * current window.
+	 * current window. Only the entries for this window need to be
+	 * expanded again.
 	 */
+	w->status_generation++;
 
-	RB_FOREACH(s, sessions, &sessions) {
-		if (session_has(s, w) != NULL)
-			server_status_session(s);
+	TAILQ_FOREACH(wl, &w->winlinks, wentry) {
+		TAILQ_FOREACH(c, &wl->session->clients, sentry)
+			c->flags |= CLIENT_STATUSUPDATE;
 	}
 }
 
@@ -357,9 +358,13 @@ server_destroy_pane(struct window_pane *wp)
 
 	old_fd = wp->fd;
 	if (wp->fd != -1) {
+		window_pane_pipe_save(wp);
 		bufferevent_free(wp->event);
 		close(wp->fd);
 		wp->fd = -1;
+
+		/* Mark the name as dead at the next check. */
+		wp->name_skip = 0;
 	}
 
 	if (options_get_number(&w->options, "remain-on-exit")) {
@@ -435,11 +440,11 @@ server_destroy_session(struct session *s)
 		if (c == NULL || c->session != s)
 			continue;
 		if (s_new == NULL) {
-			c->session = NULL;
+			server_client_set_session(c, NULL);
 			c->flags |= CLIENT_EXIT;
 		} else {
 			c->last_session = NULL;
-			c->session = s_new;
+			server_client_set_session(c, s_new);
 			notify_attached_session_changed(c);
 			session_update_activity(s_new);
 			server_redraw_client(c);
@@ -519,23 +524,28 @@ server_update_event(struct client *c)
 	event_add(&c->event, NULL);
 }
 
-/* Push stdout to client if possible. */
+/*
+ * Push stdout to client if possible. If the server has the client's stdout it
+ * is all written there directly, otherwise one message worth is sent.
+ */
 void
 server_push_stdout(struct client *c)
 {
-	struct msg_stdout_data data;
-	size_t                 size;
+	size_t	size;
 
 	size = EVBUFFER_LENGTH(c->stdout_data);
 	if (size == 0)
 		return;
-	if (size > sizeof data.data)
-		size = sizeof data.data;
 
-	memcpy(data.data, EVBUFFER_DATA(c->stdout_data), size);
-	data.size = size;
+	if (c->stdout_event != NULL) {
+		bufferevent_write_buffer(c->stdout_event, c->stdout_data);
+		return;
+	}
 
-	if (server_write_client(c, MSG_STDOUT, &data, sizeof data) == 0)
+	if (size > STDIO_DATA_SIZE)
+		size = STDIO_DATA_SIZE;
+	if (server_write_client(c, MSG_STDOUT, EVBUFFER_DATA(c->stdout_data),
+	    size) == 0)
 		evbuffer_drain(c->stdout_data, size);
 }
 
@@ -543,8 +553,7 @@ server_push_stdout(struct client *c)
 void
 server_push_stderr(struct client *c)
 {
-	struct msg_stderr_data data;
-	size_t                 size;
+	size_t	size;
 
 	if (c->stderr_data == c->stdout_data) {
 		server_push_stdout(c);
@@ -553,13 +562,11 @@ server_push_stderr(struct client *c)
 	size = EVBUFFER_LENGTH(c->stderr_data);
 	if (size == 0)
 		return;
-	if (size > sizeof data.data)
-		size = sizeof data.data;
-
-	memcpy(data.data, EVBUFFER_DATA(c->stderr_data), size);
-	data.size = size;
+	if (size > STDIO_DATA_SIZE)
+		size = STDIO_DATA_SIZE;
 
-	if (server_write_client(c, MSG_STDERR, &data, sizeof data) == 0)
+	if (server_write_client(c, MSG_STDERR, EVBUFFER_DATA(c->stderr_data),
+	    size) == 0)
 		evbuffer_drain(c->stderr_data, size);
 }
 
@@ -589,7 +596,7 @@ server_set_stdin_callback(struct client *c, void (*cb)(struct client *, int,
 	if (c->stdin_closed)
 		c->stdin_callback (c, 1, c->stdin_callback_data);
 
-	server_write_client(c, MSG_STDIN, NULL, 0);
+	server_client_read_stdin(c);
 
 	return (0);
 }
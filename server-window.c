@@ -55,8 +55,10 @@ server_window_loop(void)
 			    server_window_check_activity(s, wl) ||
 			    server_window_check_silence(s, wl))
 				server_status_session(s);
-			TAILQ_FOREACH(wp, &w->panes, entry)
-				server_window_check_content(s, wl, wp);
+			TAILQ_FOREACH(wp, &w->panes, entry) {
+				if (server_window_check_content(s, wl, wp))
+					server_status_session(s);
+			}
 		}
 	}
 }
@@ -212,7 +214,7 @@ server_window_check_content(
 	ptr = options_get_string(&w->options, "monitor-content");
 	if (ptr == NULL || *ptr == '\0')
 		return (0);
-	if ((found = window_pane_search(wp, ptr, NULL)) == NULL)
+	if ((found = window_pane_search(wp, ptr, NULL, NULL)) == NULL)
 		return (0);
 	free(found);
 
@@ -140,11 +140,13 @@ server_start(int lockfd, char *lockfile)
 	log_debug("server started, pid %ld", (long) getpid());
 
 	ARRAY_INIT(&windows);
+	RB_INIT(&all_windows);
 	RB_INIT(&all_window_panes);
 	ARRAY_INIT(&clients);
 	ARRAY_INIT(&dead_clients);
 	RB_INIT(&sessions);
 	RB_INIT(&dead_sessions);
+	RB_INIT(&session_ids);
 	TAILQ_INIT(&session_groups);
 	ARRAY_INIT(&global_buffers);
 	mode_key_init_trees();
@@ -246,7 +248,7 @@ server_send_shutdown(void)
 				server_client_lost(c);
 			else
 				server_write_client(c, MSG_SHUTDOWN, NULL, 0);
-			c->session = NULL;
+			server_client_set_session(c, NULL);
 		}
 	}
 
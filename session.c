@@ -29,6 +29,7 @@
 /* Global session list. */
 struct sessions	sessions;
 struct sessions dead_sessions;
+struct session_ids session_ids;
 u_int		next_session_id;
 struct session_groups session_groups;
 
@@ -43,6 +44,18 @@ session_cmp(struct session *s1, struct session *s2)
 	return (strcmp(s1->name, s2->name));
 }
 
+RB_GENERATE(session_ids, session, id_entry, session_id_cmp);
+
+int
+session_id_cmp(struct session *s1, struct session *s2)
+{
+	if (s1->id < s2->id)
+		return (-1);
+	if (s1->id > s2->id)
+		return (1);
+	return (0);
+}
+
 /*
  * Find if session is still alive. This is true if it is still on the global
  * sessions list.
@@ -73,13 +86,10 @@ session_find(const char *name)
 struct session *
 session_find_by_id(u_int id)
 {
-	struct session	*s;
+	struct session	s;
 
-	RB_FOREACH(s, sessions, &sessions) {
-		if (s->id == id)
-			return (s);
-	}
-	return (NULL);
+	s.id = id;
+	return (RB_FIND(session_ids, &session_ids, &s));
 }
 
 /* Create a new session. */
@@ -103,6 +113,7 @@ session_create(const char *name, const char *cmd, const char *cwd,
 	s->curw = NULL;
 	TAILQ_INIT(&s->lastw);
 	RB_INIT(&s->windows);
+	TAILQ_INIT(&s->clients);
 
 	options_init(&s->options, &global_s_options);
 	environ_init(&s->environ);
@@ -130,6 +141,7 @@ session_create(const char *name, const char *cmd, const char *cwd,
 		} while (RB_FIND(sessions, &sessions, s) != NULL);
 	}
 	RB_INSERT(sessions, &sessions, s);
+	RB_INSERT(session_ids, &session_ids, s);
 
 	if (cmd != NULL) {
 		if (session_new(s, NULL, cmd, cwd, idx, cause) == NULL) {
@@ -153,6 +165,7 @@ session_destroy(struct session *s)
 	log_debug("session %s destroyed", s->name);
 
 	RB_REMOVE(sessions, &sessions, s);
+	RB_REMOVE(session_ids, &session_ids, s);
 	notify_session_closed(s);
 
 	free(s->tio);
@@ -238,6 +251,7 @@ session_new(struct session *s,
 		xasprintf(cause, "index in use: %d", idx);
 		return (NULL);
 	}
+	wl->session = s;
 
 	environ_init(&env);
 	environ_copy(&global_environ, &env);
@@ -256,6 +270,8 @@ session_new(struct session *s,
 		environ_free(&env);
 		return (NULL);
 	}
+	window_pane_spill_history(w->active,
+	    options_get_number(&s->options, "history-file-limit"));
 	winlink_set_window(wl, w);
 	notify_window_linked(s, w);
 	environ_free(&env);
@@ -277,6 +293,7 @@ session_attach(struct session *s, struct window *w, int idx, char **cause)
 		xasprintf(cause, "index in use: %d", idx);
 		return (NULL);
 	}
+	wl->session = s;
 	winlink_set_window(wl, w);
 	notify_window_linked(s, w);
 
@@ -308,13 +325,15 @@ session_detach(struct session *s, struct winlink *wl)
 struct winlink *
 session_has(struct session *s, struct window *w)
 {
-	struct winlink	*wl;
+	struct winlink	*wl, *found = NULL;
 
-	RB_FOREACH(wl, winlinks, &s->windows) {
-		if (wl->window == w)
-			return (wl);
+	TAILQ_FOREACH(wl, &w->winlinks, wentry) {
+		if (wl->session != s)
+			continue;
+		if (found == NULL || wl->idx < found->idx)
+			found = wl;
 	}
-	return (NULL);
+	return (found);
 }
 
 struct winlink *
@@ -552,6 +571,7 @@ session_group_synchronize1(struct session *target, struct session *s)
 	/* Link all the windows from the target. */
 	RB_FOREACH(wl, winlinks, ww) {
 		wl2 = winlink_add(&s->windows, wl->idx);
+		wl2->session = s;
 		winlink_set_window(wl2, wl->window);
 		notify_window_linked(s, wl2->window);
 		wl2->flags |= wl->flags & WINLINK_ALERTFLAGS;
@@ -601,6 +621,7 @@ session_renumber_windows(struct session *s)
 	/* Go through the winlinks and assign new indexes. */
 	RB_FOREACH(wl, winlinks, &old_wins) {
 		wl_new = winlink_add(&s->windows, new_idx);
+		wl_new->session = s;
 		winlink_set_window(wl_new, wl->window);
 		wl_new->flags |= wl->flags & WINLINK_ALERTFLAGS;
 
@@ -41,6 +41,9 @@ char   *status_print(
 void	status_replace1(struct client *, struct session *, struct winlink *,
 	    struct window_pane *, char **, char **, char *, size_t, int);
 void	status_message_callback(int, short, void *);
+int	status_entry_volatile(struct winlink *);
+struct status_entry *status_get_entry(struct client *, u_int, struct winlink *,
+	    time_t, int, struct grid_cell *);
 
 const char *status_prompt_up_history(u_int *);
 const char *status_prompt_down_history(u_int *);
@@ -50,14 +53,22 @@ char   *status_prompt_complete(const char *);
 /* Status prompt history. */
 ARRAY_DECL(, char *) status_prompt_history = ARRAY_INITIALIZER;
 
-/* Status output tree. */
-RB_GENERATE(status_out_tree, status_out, entry, status_out_cmp);
+/*
+ * Status jobs. These are shared by all clients so each command is run only
+ * once however many clients show it. A job's output is kept until it is older
+ * than status-job-ttl (or status-interval) when next asked for, then it is run
+ * again while the old output is still shown. Jobs not asked for in a while are
+ * freed.
+ */
+#define STATUS_JOB_EXPIRE 600
+struct status_jobs status_jobs = RB_INITIALIZER(&status_jobs);
+RB_GENERATE(status_jobs, status_job, entry, status_job_cmp);
 
-/* Output tree comparison function. */
+/* Job tree comparison function. */
 int
-status_out_cmp(struct status_out *so1, struct status_out *so2)
+status_job_cmp(struct status_job *sj1, struct status_job *sj2)
 {
-	return (strcmp(so1->cmd, so2->cmd));
+	return (strcmp(sj1->cmd, sj2->cmd));
 }
 
 /* Get screen line of status line. -1 means off. */
@@ -138,17 +149,100 @@ status_redraw_get_right(struct client *c,
 void
 status_set_window_at(struct client *c, u_int x)
 {
-	struct session	*s = c->session;
-	struct winlink	*wl;
+	struct session		*s = c->session;
+	struct winlink		*wl;
+	struct status_entry	*se;
+	u_int			 i;
 
 	x += c->wlmouse;
+	i = 0;
 	RB_FOREACH(wl, winlinks, &s->windows) {
-		if (x < wl->status_width &&
+		if (i == ARRAY_LENGTH(&c->status_entries))
+			break;
+		se = &ARRAY_ITEM(&c->status_entries, i++);
+		if (x < se->width &&
 			session_select(s, wl->idx) == 0) {
 			server_redraw_session(s);
 		}
-		x -= wl->status_width + 1;
+		x -= se->width + 1;
+	}
+}
+
+/*
+ * Does a window list entry need to be expanded every time? It does if it
+ * includes the time, a job or a format, as these can change without the
+ * window changing.
+ */
+int
+status_entry_volatile(struct winlink *wl)
+{
+	struct options	*oo = &wl->window->options;
+	const char	*fmt;
+
+	fmt = options_get_string(oo, "window-status-format");
+	if (strchr(fmt, '%') != NULL || strstr(fmt, "#(") != NULL ||
+	    strstr(fmt, "#{") != NULL)
+		return (1);
+	fmt = options_get_string(oo, "window-status-current-format");
+	if (strchr(fmt, '%') != NULL || strstr(fmt, "#(") != NULL ||
+	    strstr(fmt, "#{") != NULL)
+		return (1);
+	return (0);
+}
+
+/*
+ * Get the window list entry at a position, expanding it again only if this is
+ * a full redraw or it may have changed. As well as the window, an entry
+ * depends on the winlink's alert flags and on whether it is the current or
+ * last window.
+ */
+struct status_entry *
+status_get_entry(struct client *c, u_int i, struct winlink *wl, time_t t,
+    int utf8flag, struct grid_cell *stdgc)
+{
+	struct session		*s = c->session;
+	struct status_entry	*se;
+	int			 flags, current, last;
+
+	if (i == ARRAY_LENGTH(&c->status_entries)) {
+		ARRAY_EXPAND(&c->status_entries, 1);
+		se = &ARRAY_LAST(&c->status_entries);
+		memset(se, 0, sizeof *se);
 	}
+	se = &ARRAY_ITEM(&c->status_entries, i);
+
+	flags = wl->flags & WINLINK_ALERTFLAGS;
+	current = (wl == s->curw);
+	last = (wl == TAILQ_FIRST(&s->lastw));
+
+	if (!(c->flags & (CLIENT_REDRAW|CLIENT_STATUS)) && se->wl == wl &&
+	    se->generation == wl->window->status_generation &&
+	    se->flags == flags && se->current == current && se->last == last &&
+	    !status_entry_volatile(wl))
+		return (se);
+
+	free(se->text);
+	memcpy(&se->gc, stdgc, sizeof se->gc);
+	se->text = status_print(c, wl, t, &se->gc);
+	se->width = screen_write_cstrlen(utf8flag, "%s", se->text);
+
+	se->wl = wl;
+	se->generation = wl->window->status_generation;
+	se->flags = flags;
+	se->current = current;
+	se->last = last;
+	return (se);
+}
+
+/* Free window list entries. */
+void
+status_free_entries(struct client *c)
+{
+	u_int	i;
+
+	for (i = 0; i < ARRAY_LENGTH(&c->status_entries); i++)
+		free(ARRAY_ITEM(&c->status_entries, i).text);
+	ARRAY_FREE(&c->status_entries);
 }
 
 /* Draw status for client on the last lines of given context. */
@@ -158,12 +252,13 @@ status_redraw(struct client *c)
 	struct screen_write_ctx	ctx;
 	struct session	       *s = c->session;
 	struct winlink	       *wl;
+	struct status_entry    *se;
 	struct screen		old_status, window_list;
 	struct grid_cell	stdgc, lgc, rgc, gc;
 	struct options	       *oo;
 	time_t			t;
 	char		       *left, *right, *sep;
-	u_int			offset, needed;
+	u_int			offset, needed, i, n;
 	u_int			wlstart, wlwidth, wlavailable, wloffset, wlsize;
 	size_t			llen, rlen, seplen;
 	int			larrow, rarrow, utf8flag;
@@ -221,20 +316,25 @@ status_redraw(struct client *c)
 
 	/* Calculate the total size needed for the window list. */
 	wlstart = wloffset = wlwidth = 0;
+	n = 0;
 	RB_FOREACH(wl, winlinks, &s->windows) {
-		free(wl->status_text);
-		memcpy(&wl->status_cell, &stdgc, sizeof wl->status_cell);
-		wl->status_text = status_print(c, wl, t, &wl->status_cell);
-		wl->status_width =
-		    screen_write_cstrlen(utf8flag, "%s", wl->status_text);
+		se = status_get_entry(c, n++, wl, t, utf8flag, &stdgc);
 
-		if (wl == s->curw)
+		if (wl == s->curw) {
 			wloffset = wlwidth;
+			wlsize = se->width;
+		}
 
 		oo = &wl->window->options;
 		sep = options_get_string(oo, "window-status-separator");
 		seplen = screen_write_strlen(utf8flag, "%s", sep);
-		wlwidth += wl->status_width + seplen;
+		wlwidth += se->width + seplen;
+	}
+
+	/* Drop entries for windows no longer there. */
+	while (ARRAY_LENGTH(&c->status_entries) > n) {
+		free(ARRAY_LAST(&c->status_entries).text);
+		ARRAY_TRUNC(&c->status_entries, 1);
 	}
 
 	/* Create a new screen for the window list. */
@@ -242,9 +342,10 @@ status_redraw(struct client *c)
 
 	/* And draw the window list into it. */
 	screen_write_start(&ctx, NULL, &window_list);
+	i = 0;
 	RB_FOREACH(wl, winlinks, &s->windows) {
-		screen_write_cnputs(&ctx,
-		    -1, &wl->status_cell, utf8flag, "%s", wl->status_text);
+		se = &ARRAY_ITEM(&c->status_entries, i++);
+		screen_write_cnputs(&ctx, -1, &se->gc, utf8flag, "%s", se->text);
 
 		oo = &wl->window->options;
 		sep = options_get_string(oo, "window-status-separator");
@@ -256,9 +357,6 @@ status_redraw(struct client *c)
 	if (wlwidth <= wlavailable)
 		goto draw;
 
-	/* Find size of current window text. */
-	wlsize = s->curw->status_width;
-
 	/*
 	 * If the current window is already on screen, good to draw from the
 	 * start and just leave off the end.
@@ -301,12 +399,13 @@ status_redraw(struct client *c)
 	 * right arrows.
 	 */
 	offset = 0;
+	i = 0;
 	RB_FOREACH(wl, winlinks, &s->windows) {
 		if (wl->flags & WINLINK_ALERTFLAGS &&
 		    larrow == 1 && offset < wlstart)
 			larrow = -1;
 
-		offset += wl->status_width;
+		offset += ARRAY_ITEM(&c->status_entries, i++).width;
 
 		if (wl->flags & WINLINK_ALERTFLAGS &&
 		    rarrow == 1 && offset > wlstart + wlwidth)
@@ -554,10 +653,12 @@ status_replace(struct client *c, struct session *s, struct winlink *wl,
 char *
 status_find_job(struct client *c, char **iptr)
 {
-	struct status_out	*so, so_find;
+	struct status_job	*sj, sj_find;
+	struct options		*oo;
 	char   			*cmd;
 	int			 lastesc;
 	size_t			 len;
+	time_t			 now, ttl;
 
 	if (**iptr == '\0')
 		return (NULL);
@@ -587,89 +688,94 @@ status_find_job(struct client *c, char **iptr)
 	(*iptr)++;			/* skip final ) */
 	cmd[len] = '\0';
 
-	/* First try in the new tree. */
-	so_find.cmd = cmd;
-	so = RB_FIND(status_out_tree, &c->status_new, &so_find);
-	if (so != NULL && so->out != NULL) {
+	sj_find.cmd = cmd;
+	sj = RB_FIND(status_jobs, &status_jobs, &sj_find);
+	if (sj == NULL) {
+		sj = xcalloc(1, sizeof *sj);
+		sj->cmd = cmd;
+		RB_INSERT(status_jobs, &status_jobs, sj);
+	} else
 		free(cmd);
-		return (so->out);
-	}
+	now = time(NULL);
+	sj->used = now;
 
-	/* If not found at all, start the job and add to the tree. */
-	if (so == NULL) {
-		job_run(cmd, NULL, status_job_callback, status_job_free, c);
-		c->references++;
-
-		so = xmalloc(sizeof *so);
-		so->cmd = xstrdup(cmd);
-		so->out = NULL;
-		RB_INSERT(status_out_tree, &c->status_new, so);
+	/*
+	 * Start the job if it has not been run or the output is too old, unless
+	 * it is still running. A TTL of zero means to run it only once.
+	 */
+	oo = c->session != NULL ? &c->session->options : &global_s_options;
+	ttl = options_get_number(oo, "status-job-ttl");
+	if (ttl == 0)
+		ttl = options_get_number(oo, "status-interval");
+	if (sj->job != NULL ||
+	    (sj->started != 0 && (ttl == 0 || now - sj->started < ttl))) {
+		sj->hits++;
+		return (sj->out);
 	}
 
-	/* Lookup in the old tree. */
-	so_find.cmd = cmd;
-	so = RB_FIND(status_out_tree, &c->status_old, &so_find);
-	free(cmd);
-	if (so != NULL)
-		return (so->out);
-	return (NULL);
+	sj->job = job_run(sj->cmd, NULL, status_job_callback, status_job_free,
+	    sj);
+	sj->started = now;
+	if (gettimeofday(&sj->start, NULL) != 0)
+		fatal("gettimeofday failed");
+	return (sj->out);
 }
 
-/* Free job tree. */
+/* Free jobs which have not been asked for recently. */
 void
-status_free_jobs(struct status_out_tree *sotree)
+status_expire_jobs(void)
 {
-	struct status_out	*so, *so_next;
-
-	so_next = RB_MIN(status_out_tree, sotree);
-	while (so_next != NULL) {
-		so = so_next;
-		so_next = RB_NEXT(status_out_tree, sotree, so);
+	struct status_job	*sj, *sj_next;
+	time_t			 now;
 
-		RB_REMOVE(status_out_tree, sotree, so);
-		free(so->out);
-		free(so->cmd);
-		free(so);
+	now = time(NULL);
+	RB_FOREACH_SAFE(sj, status_jobs, &status_jobs, sj_next) {
+		if (sj->job != NULL || now - sj->used < STATUS_JOB_EXPIRE)
+			continue;
+		RB_REMOVE(status_jobs, &status_jobs, sj);
+		free(sj->out);
+		free(sj->cmd);
+		free(sj);
 	}
 }
 
-/* Update jobs on status interval. */
+/* Make all jobs run again when they are next asked for. */
 void
-status_update_jobs(struct client *c)
+status_update_jobs(void)
 {
-	/* Free the old tree. */
-	status_free_jobs(&c->status_old);
+	struct status_job	*sj;
 
-	/* Move the new to old. */
-	memcpy(&c->status_old, &c->status_new, sizeof c->status_old);
-	RB_INIT(&c->status_new);
+	RB_FOREACH(sj, status_jobs, &status_jobs)
+		sj->started = 0;
 }
 
 /* Free status job. */
 void
 status_job_free(void *data)
 {
-	struct client	*c = data;
+	struct status_job	*sj = data;
 
-	c->references--;
+	sj->job = NULL;
 }
 
-/* Job has finished: save its result. */
+/* Job has finished: save its result and redraw clients. */
 void
 status_job_callback(struct job *job)
 {
-	struct client		*c = job->data;
-	struct status_out	*so, so_find;
+	struct status_job	*sj = job->data;
+	struct client		*c;
+	struct timeval		 tv;
 	char			*line, *buf;
 	size_t			 len;
+	u_int			 i;
 
-	if (c->flags & CLIENT_DEAD)
-		return;
-
-	so_find.cmd = job->cmd;
-	so = RB_FIND(status_out_tree, &c->status_new, &so_find);
-	if (so == NULL || so->out != NULL)
-		return;
+	if (gettimeofday(&tv, NULL) != 0)
+		fatal("gettimeofday failed");
+	timersub(&tv, &sj->start, &tv);
+	timeradd(&sj->total, &tv, &sj->total);
+	if (timercmp(&tv, &sj->longest, >))
+		memcpy(&sj->longest, &tv, sizeof sj->longest);
+	sj->runs++;
 
 	buf = NULL;
 	if ((line = evbuffer_readline(job->event->input)) == NULL) {
@@ -681,8 +787,14 @@ status_job_callback(struct job *job)
 	} else
 		buf = line;
 
-	so->out = buf;
-	server_status_client(c);
+	free(sj->out);
+	sj->out = buf;
+
+	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
+		c = ARRAY_ITEM(&clients, i);
+		if (c != NULL && c->session != NULL)
+			server_status_client(c);
+	}
 }
 
 /* Return winlink status line entry and adjust gc as necessary. */
@@ -968,7 +1080,7 @@ status_prompt_redraw(struct client *c)
 	struct session		       *s = c->session;
 	struct screen		        old_status;
 	size_t			        i, size, left, len, off;
-	struct grid_cell		gc, *gcp;
+	struct grid_cell		gc;
 	int				utf8flag;
 
 	if (c->tty.sx == 0 || c->tty.sy == 0)
@@ -1020,8 +1132,9 @@ status_prompt_redraw(struct client *c)
 
 	/* Apply fake cursor. */
 	off = len + c->prompt_index - off;
-	gcp = grid_view_get_cell(c->status.grid, off, 0);
-	gcp->attr ^= GRID_ATTR_REVERSE;
+	grid_view_get_cell(c->status.grid, off, 0, &gc);
+	gc.attr ^= GRID_ATTR_REVERSE;
+	grid_view_set_cell(c->status.grid, off, 0, &gc);
 
 	if (grid_compare(c->status.grid, old_status.grid) == 0) {
 		screen_free(&old_status);
@@ -19,7 +19,7 @@
 #ifndef TMUX_H
 #define TMUX_H
 
-#define PROTOCOL_VERSION 7
+#define PROTOCOL_VERSION 8
 
 #include <sys/param.h>
 #include <sys/time.h>
@@ -27,6 +27,7 @@
 
 #include <event.h>
 #include <limits.h>
+#include <regex.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -55,6 +56,9 @@ extern char   **environ;
 /* Automatic name refresh interval, in milliseconds. */
 #define NAME_INTERVAL 500
 
+/* Idle panes are checked at most every 1 << NAME_IDLE_MAX intervals. */
+#define NAME_IDLE_MAX 4
+
 /*
  * Maximum sizes of strings in message data. Don't forget to bump
  * PROTOCOL_VERSION if any of these change!
@@ -164,6 +168,11 @@ extern char   **environ;
 #define BELL_ANY 1
 #define BELL_CURRENT 2
 
+/* What to do when a pipe-pane command is too slow. */
+#define PIPE_BLOCK 0
+#define PIPE_DROP 1
+#define PIPE_GAP 2
+
 /* Special key codes. */
 #define KEYC_NONE 0xfff
 #define KEYC_BASE 0x1000
@@ -454,7 +463,8 @@ enum msgtype {
 	MSG_SHELL,
 	MSG_STDERR,
 	MSG_STDOUT,
-	MSG_DETACHKILL
+	MSG_DETACHKILL,
+	MSG_IDENTIFY_STDOUT
 };
 
 /*
@@ -499,20 +509,13 @@ struct msg_exit_data {
 	int		retcode;
 };
 
-struct msg_stdin_data {
-	ssize_t	size;
-	char	data[BUFSIZ];
-};
-
-struct msg_stdout_data {
-	ssize_t	size;
-	char	data[BUFSIZ];
-};
-
-struct msg_stderr_data {
-	ssize_t	size;
-	char	data[BUFSIZ];
-};
+/*
+ * MSG_STDIN, MSG_STDOUT and MSG_STDERR carry just the data, up to
+ * STDIO_DATA_SIZE bytes. The client sends an empty MSG_STDIN when stdin is
+ * closed and the server sends one to ask the client to start reading stdin.
+ * They are not used when the server has the client's stdin or stdout itself.
+ */
+#define STDIO_DATA_SIZE (MAX_IMSGSIZE - IMSG_HEADER_SIZE)
 
 /* Mode key commands. */
 enum mode_key_cmd {
@@ -713,6 +716,7 @@ struct utf8_data {
 
 /* Grid line flags. */
 #define GRID_LINE_WRAPPED 0x1
+#define GRID_LINE_PACKED 0x2
 
 /* Grid cell data. */
 struct grid_cell {
@@ -725,14 +729,82 @@ struct grid_cell {
 	u_char	xdata[UTF8_SIZE];
 } __packed;
 
+/*
+ * Grid cell as stored in a line. The attributes and colours are an index into
+ * a table shared by all grids (see grid.c) and data is the character. Cells
+ * which don't fit (UTF-8 or if the table is full) have style set to
+ * GRID_STYLE_EXTENDED and data is an offset into the line's extended cells.
+ */
+struct grid_cell_entry {
+	u_short	style;
+	u_short	data;
+} __packed;
+#define GRID_STYLE_EXTENDED 0xffff
+
 /* Grid line. */
 struct grid_line {
 	u_int	cellsize;
-	struct grid_cell *celldata;
+	struct grid_cell_entry *celldata;
+
+	u_int	extdsize;
+	struct grid_cell *extddata;
+
+	/* Compressed cells if GRID_LINE_PACKED, celldata is then NULL. */
+	u_int	packsize;
+	u_char *packdata;
 
 	int	flags;
 } __packed;
 
+/* Text of a grid line with the cell each byte is from, for searching. */
+struct grid_text {
+	char	*text;
+	u_int	*cells;
+	size_t	 len;
+	size_t	 size;
+};
+
+/*
+ * History lines spilled to a file. The data file holds each line packed after
+ * a struct grid_spill_entry; the index file holds the offset of each line in
+ * the data file as a uint64_t. Both are only appended to and are mapped to be
+ * read.
+ */
+struct grid_spill_entry {
+	u_int	cellsize;
+	u_int	packsize;
+	u_int	flags;
+} __packed;
+
+struct grid_spill {
+	char	*path;
+	char	*ipath;
+	int	 fd;
+	int	 ifd;
+	int	 failed;
+
+	u_int	 limit;
+
+	u_int	 first;		/* first line in the files still wanted */
+	u_int	 total;		/* lines in the files */
+	u_int	 dropped;	/* lines ever dropped, to name cached lines */
+	off_t	 size;		/* size of data file */
+
+	u_char	*buf;		/* data and index not yet written */
+	size_t	 buflen;
+	u_char	*ibuf;
+	size_t	 ibuflen;
+
+	u_char	*map;
+	size_t	 mapsize;
+	u_char	*imap;
+	size_t	 imapsize;
+
+	struct grid_line *cache;
+	u_int	*cachekey;
+	u_int	 cachenext;
+};
+
 /* Entire grid of cells. */
 struct grid {
 	int	flags;
@@ -744,7 +816,28 @@ struct grid {
 	u_int	hsize;
 	u_int	hlimit;
 
+	/*
+	 * Lines are kept in a ring so scrolling into and collecting from the
+	 * history doesn't need to move them. linesize is the number of lines
+	 * allocated (always a power of two) and lineoff the index of line 0.
+	 */
 	struct grid_line *linedata;
+	u_int	linesize;
+	u_int	lineoff;
+
+	/* Ring slots of old lines unpacked to be read, to pack again later. */
+	u_int	*unpacked;
+	u_int	 nunpacked;
+
+	/*
+	 * The oldest ssize lines of the history are in the spill file rather
+	 * than the ring, line ssize is at lineoff.
+	 */
+	struct grid_spill *spill;
+	u_int	ssize;
+
+	/* Bytes used by the history lines in the ring, kept as they change. */
+	size_t	hbytes;
 };
 
 /* Option data structures. */
@@ -918,10 +1011,22 @@ struct window_choose_mode_item {
 #define TREE_EXPANDED 0x1
 };
 
+/*
+ * Position of a consumer (the input parser or pipe-pane) in the output of a
+ * pane, counted from when the pane was started. Output stays in the pane's
+ * buffer until every consumer has used it.
+ */
+struct window_pane_offset {
+	size_t		 used;
+};
+
 /* Child window structure. */
 struct window_pane {
 	u_int		 id;
-	struct event	 name_timer;
+
+	pid_t		 name_pgrp;
+	u_int		 name_idle;
+	u_int		 name_skip;
 
 	struct window	*window;
 
@@ -939,6 +1044,7 @@ struct window_pane {
 #define PANE_DROP 0x2
 #define PANE_FOCUSED 0x4
 #define PANE_RESIZE 0x8
+#define PANE_PIPEFULL 0x10
 
 	char		*cmd;
 	char		*shell;
@@ -956,12 +1062,16 @@ struct window_pane {
 
 	int		 fd;
 	struct bufferevent *event;
+	size_t		 base_offset;
+	struct window_pane_offset offset;
 
 	struct input_ctx ictx;
 
 	int		 pipe_fd;
-	struct bufferevent *pipe_event;
-	size_t		 pipe_off;
+	struct event	 pipe_event;
+	struct window_pane_offset pipe_offset;
+	struct evbuffer	*pipe_extra;
+	size_t		 pipe_lost;
 
 	struct screen	*screen;
 	struct screen	 base;
@@ -1012,21 +1122,28 @@ struct window {
 #define WINDOW_SILENCE 0x8
 #define WINDOW_ZOOMED 0x10
 
+	u_int		 status_generation; /* changed when status may change */
+
 	struct options	 options;
 
 	u_int		 references;
+	TAILQ_HEAD(, winlink) winlinks;
+
+	RB_ENTRY(window) entry;
 };
 ARRAY_DECL(windows, struct window *);
+RB_HEAD(window_tree, window);
+
+/* Search options, from search-regex and search-smart-case. */
+#define WINDOW_SEARCH_REGEX 0x1
+#define WINDOW_SEARCH_ICASE 0x2
 
 /* Entry on local window list. */
 struct winlink {
 	int		 idx;
+	struct session	*session;
 	struct window	*window;
 
-	size_t		 status_width;
-	struct grid_cell status_cell;
-	char		*status_text;
-
 	int              flags;
 #define WINLINK_BELL 0x1
 #define WINLINK_ACTIVITY 0x2
@@ -1036,6 +1153,7 @@ struct winlink {
     (WINLINK_BELL|WINLINK_ACTIVITY|WINLINK_CONTENT|WINLINK_SILENCE)
 
 	RB_ENTRY(winlink) entry;
+	TAILQ_ENTRY(winlink) wentry;
 	TAILQ_ENTRY(winlink) sentry;
 };
 RB_HEAD(winlinks, winlink);
@@ -1121,21 +1239,40 @@ struct session {
 
 	int		 references;
 
+	TAILQ_HEAD(, client) clients;
+
 	TAILQ_ENTRY(session) gentry;
 	RB_ENTRY(session)    entry;
+	RB_ENTRY(session)    id_entry;
 };
 RB_HEAD(sessions, session);
+RB_HEAD(session_ids, session);
 ARRAY_DECL(sessionslist, struct session *);
 
 /* TTY information. */
-struct tty_key {
-	char		 ch;
+struct tty_key_string {
 	int		 key;
+	const char	*string;
+};
+
+/*
+ * Key strings compiled into a table of states with the next state for each
+ * byte, zero if there is none. accept is the rank of the key matched on
+ * reaching the state and alive the lowest rank of those which could still
+ * match with more bytes (UINT_MAX for none).
+ */
+struct tty_key_state {
+	u_short		 next[UCHAR_MAX + 1];
 
-	struct tty_key	*left;
-	struct tty_key	*right;
+	int		 key;
+	u_int		 accept;
+	u_int		 alive;
+	u_char		 modifier;
+};
 
-	struct tty_key	*next;
+struct tty_key_table {
+	struct tty_key_state *states;
+	u_int		 nstates;
 };
 
 struct tty_term {
@@ -1151,6 +1288,8 @@ struct tty_term {
 #define TERM_EARLYWRAP 0x4
 	int		 flags;
 
+	struct tty_key_table keys;
+
 	LIST_ENTRY(tty_term) entry;
 };
 LIST_HEAD(tty_terms, tty_term);
@@ -1228,12 +1367,25 @@ struct tty {
 	int		 fd;
 	struct bufferevent *event;
 
+	u_char		*out_buf;
+	size_t		 out_len;
+	size_t		 out_size;
+
 	int		 log_fd;
 
 	struct termios	 tio;
 
 	struct grid_cell cell;
 
+	/*
+	 * What the terminal is showing, used to avoid redrawing cells which
+	 * have not changed. Cells whose content is not known have zero
+	 * xstate. The attributes last asked for by tty_attributes are kept in
+	 * frame_cell.
+	 */
+	struct grid_cell *frame;
+	struct grid_cell frame_cell;
+
 #define TTY_NOCURSOR 0x1
 #define TTY_FREEZE 0x2
 #define TTY_TIMER 0x4
@@ -1247,7 +1399,6 @@ struct tty {
 	struct mouse_event mouse;
 
 	struct event	 key_timer;
-	struct tty_key	*key_tree;
 };
 
 /* TTY command context and function pointer. */
@@ -1284,14 +1435,51 @@ struct message_entry {
 	time_t	msg_time;
 };
 
-/* Status output data from a job. */
-struct status_out {
-	char   *cmd;
-	char   *out;
+/* Status line job and its output, shared by all clients. */
+struct status_job {
+	char		*cmd;
+	char		*out;
+
+	struct job	*job;		/* running, only one at a time */
+	time_t		 started;
+	time_t		 used;
 
-	RB_ENTRY(status_out) entry;
+	u_int		 runs;
+	u_int		 hits;
+	struct timeval	 start;
+	struct timeval	 total;
+	struct timeval	 longest;
+
+	RB_ENTRY(status_job) entry;
+};
+RB_HEAD(status_jobs, status_job);
+
+/*
+ * Window list entry on a client's status line, kept until the window changes
+ * or a full redraw.
+ */
+struct status_entry {
+	struct winlink	*wl;		/* compared only, never followed */
+	u_int		 generation;
+	int		 flags;		/* alert flags */
+	int		 current;
+	int		 last;
+
+	char		*text;
+	struct grid_cell gc;
+	size_t		 width;
 };
-RB_HEAD(status_out_tree, status_out);
+
+/* Control mode output state of a pane for one client. */
+struct control_pane {
+	u_int		 pane;
+
+	int		 flags;
+#define CONTROL_PANE_PAUSED 0x1
+
+	RB_ENTRY(control_pane) entry;
+};
+RB_HEAD(control_panes, control_pane);
 
 /* Client connection. */
 struct client {
@@ -1316,12 +1504,16 @@ struct client {
 	struct evbuffer	*stdout_data;
 	struct evbuffer	*stderr_data;
 
+	int		 stdin_fd;
+	struct bufferevent *stdin_event;
+	int		 stdout_fd;
+	struct bufferevent *stdout_event;
+
 	struct event	 repeat_timer;
 
-	struct status_out_tree status_old;
-	struct status_out_tree status_new;
 	struct timeval	 status_timer;
 	struct screen	 status;
+	ARRAY_DECL(, struct status_entry) status_entries;
 
 #define CLIENT_TERMINAL 0x1
 #define CLIENT_PREFIX 0x2
@@ -1338,8 +1530,15 @@ struct client {
 #define CLIENT_REDRAWWINDOW 0x1000
 #define CLIENT_CONTROL 0x2000
 #define CLIENT_FOCUSED 0x4000
+#define CLIENT_STATUSUPDATE 0x8000 /* redraw only changed status entries */
 	int		 flags;
 
+	/* Control mode extensions asked for with refresh-client -f. */
+	int		 control_flags;
+#define CONTROL_BINARY_OUTPUT 0x1
+	size_t		 control_high_water;
+	struct control_panes control_panes;
+
 	struct event	 identify_timer;
 
 	char		*message_string;
@@ -1361,6 +1560,7 @@ struct client {
 
 	struct session	*session;
 	struct session	*last_session;
+	TAILQ_ENTRY(client) sentry;
 
 	int		 wlmouse;
 
@@ -1495,10 +1695,42 @@ struct format_entry {
 	char		       *key;
 	char		       *value;
 
+	char		     *(*cb)(void *);
+	void		       *arg;
+
 	RB_ENTRY(format_entry)	entry;
 };
 RB_HEAD(format_tree, format_entry);
 
+/* Compiled format template operation. */
+struct format_op {
+	enum {
+		FORMAT_TEXT,
+		FORMAT_KEY,
+		FORMAT_CONDITION
+	} type;
+
+	const char	*key;
+
+	const char	*text;
+	size_t		 textlen;
+	const char	*other;
+	size_t		 otherlen;
+};
+
+/* Compiled format template, cached by the template string. */
+struct format_template {
+	char		*fmt;
+	char		*buf;
+	u_int		 used;
+
+	struct format_op *ops;
+	u_int		 nops;
+
+	RB_ENTRY(format_template) entry;
+};
+RB_HEAD(format_templates, format_template);
+
 /* Common command usages. */
 #define CMD_TARGET_PANE_USAGE "[-t target-pane]"
 #define CMD_TARGET_WINDOW_USAGE "[-t target-window]"
@@ -1545,10 +1777,15 @@ void		 cfg_show_causes(struct session *);
 /* format.c */
 int		 format_cmp(struct format_entry *, struct format_entry *);
 RB_PROTOTYPE(format_tree, format_entry, entry, format_cmp);
+int		 format_template_cmp(
+		     struct format_template *, struct format_template *);
+RB_PROTOTYPE(format_templates, format_template, entry, format_template_cmp);
 struct format_tree *format_create(void);
 void		 format_free(struct format_tree *);
 void printflike3 format_add(
 		     struct format_tree *, const char *, const char *, ...);
+void		 format_add_cb(struct format_tree *, const char *,
+		     char *(*)(void *), void *);
 const char	*format_find(struct format_tree *, const char *);
 char		*format_expand(struct format_tree *, const char *);
 void		 format_session(struct format_tree *, struct session *);
@@ -1580,7 +1817,7 @@ enum mode_key_cmd mode_key_lookup(struct mode_key_data *, int, const char **);
 /* notify.c */
 void	notify_enable(void);
 void	notify_disable(void);
-void	notify_input(struct window_pane *, struct evbuffer *);
+void	notify_input(struct window_pane *, const u_char *, size_t);
 void	notify_window_layout_changed(struct window *);
 void	notify_window_unlinked(struct session *, struct window *);
 void	notify_window_linked(struct session *, struct window *);
@@ -1654,6 +1891,7 @@ void	tty_putcode_ptr2(struct tty *, enum tty_code_code, const void *,
 void	tty_puts(struct tty *, const char *);
 void	tty_putc(struct tty *, u_char);
 void	tty_putn(struct tty *, const void *, size_t, u_int);
+void	tty_flush(struct tty *);
 void	tty_init(struct tty *, struct client *, int, char *);
 int	tty_resize(struct tty *);
 int	tty_set_size(struct tty *, u_int, u_int);
@@ -1664,6 +1902,8 @@ void	tty_set_title(struct tty *, const char *);
 void	tty_update_mode(struct tty *, int, struct screen *);
 void	tty_force_cursor_colour(struct tty *, const char *);
 void	tty_draw_line(struct tty *, struct screen *, u_int, u_int, u_int);
+int	tty_frame_same(struct tty *, u_int, u_int, const struct grid_cell *);
+void	tty_invalidate(struct tty *);
 int	tty_open(struct tty *, const char *, char **);
 void	tty_close(struct tty *);
 void	tty_free(struct tty *);
@@ -1671,6 +1911,7 @@ void	tty_write(
 	    void (*)(struct tty *, const struct tty_ctx *), struct tty_ctx *);
 void	tty_cmd_alignmenttest(struct tty *, const struct tty_ctx *);
 void	tty_cmd_cell(struct tty *, const struct tty_ctx *);
+void	tty_cmd_cells(struct tty *, const struct tty_ctx *);
 void	tty_cmd_clearendofline(struct tty *, const struct tty_ctx *);
 void	tty_cmd_clearendofscreen(struct tty *, const struct tty_ctx *);
 void	tty_cmd_clearline(struct tty *, const struct tty_ctx *);
@@ -1711,8 +1952,12 @@ int		 tty_term_flag(struct tty_term *, enum tty_code_code);
 const char	*tty_acs_get(struct tty *, u_char);
 
 /* tty-keys.c */
-void	tty_keys_build(struct tty *);
-void	tty_keys_free(struct tty *);
+void	tty_keys_compile(struct tty_key_table *,
+	    const struct tty_key_string *, u_int, int);
+int	tty_keys_match(struct tty_key_table *, const char *, size_t, size_t *,
+	    const struct tty_key_state **);
+void	tty_keys_build(struct tty_term *);
+void	tty_keys_free(struct tty_term *);
 int	tty_keys_next(struct tty *);
 
 /* paste.c */
@@ -1903,10 +2148,13 @@ void	 server_add_accept(int);
 
 /* server-client.c */
 void	 server_client_handle_key(struct client *, int);
+size_t	 server_client_handle_text(struct client *, const u_char *, size_t);
 void	 server_client_create(int);
 int      server_client_open(struct client *, struct session *, char **);
 void	 server_client_lost(struct client *);
+void	 server_client_set_session(struct client *, struct session *);
 void	 server_client_callback(int, short, void *);
+void	 server_client_read_stdin(struct client *);
 void	 server_client_status_timer(void);
 void	 server_client_loop(void);
 
@@ -1951,12 +2199,14 @@ int	 server_set_stdin_callback(struct client *, void (*)(struct client *,
 void	 server_unzoom_window(struct window *);
 
 /* status.c */
-int	 status_out_cmp(struct status_out *, struct status_out *);
-RB_PROTOTYPE(status_out_tree, status_out, entry, status_out_cmp);
+extern struct status_jobs status_jobs;
+int	 status_job_cmp(struct status_job *, struct status_job *);
+RB_PROTOTYPE(status_jobs, status_job, entry, status_job_cmp);
 int	 status_at_line(struct client *);
-void	 status_free_jobs(struct status_out_tree *);
-void	 status_update_jobs(struct client *);
+void	 status_expire_jobs(void);
+void	 status_update_jobs(void);
 void	 status_set_window_at(struct client *, u_int);
+void	 status_free_entries(struct client *);
 int	 status_redraw(struct client *);
 char	*status_replace(struct client *, struct session *,
 	     struct winlink *, struct window_pane *, const char *, time_t, int);
@@ -2006,13 +2256,20 @@ struct grid *grid_create(u_int, u_int, u_int);
 void	 grid_destroy(struct grid *);
 int	 grid_compare(struct grid *, struct grid *);
 void	 grid_collect_history(struct grid *);
+void	 grid_clear_history(struct grid *);
+void	 grid_set_spill(struct grid *, const char *, u_int);
 void	 grid_scroll_history(struct grid *);
 void	 grid_scroll_history_region(struct grid *, u_int, u_int);
+void	 grid_grow_history(struct grid *, u_int);
+void	 grid_shrink_history(struct grid *, u_int);
 void	 grid_expand_line(struct grid *, u_int, u_int);
-const struct grid_cell *grid_peek_cell(struct grid *, u_int, u_int);
+void	 grid_reserve_lines(struct grid *, u_int);
+struct grid_line *grid_get_line(struct grid *, u_int);
 const struct grid_line *grid_peek_line(struct grid *, u_int);
-struct grid_cell *grid_get_cell(struct grid *, u_int, u_int);
+void	 grid_get_cell(struct grid *, u_int, u_int, struct grid_cell *);
 void	 grid_set_cell(struct grid *, u_int, u_int, const struct grid_cell *);
+void	 grid_set_cells(struct grid *, u_int, u_int, const struct grid_cell *,
+	     const u_char *, u_int);
 void	 grid_clear(struct grid *, u_int, u_int, u_int, u_int);
 void	 grid_clear_lines(struct grid *, u_int, u_int);
 void	 grid_move_lines(struct grid *, u_int, u_int, u_int);
@@ -2022,6 +2279,16 @@ char	*grid_string_cells(struct grid *, u_int, u_int, u_int,
 void	 grid_duplicate_lines(
 	     struct grid *, u_int, struct grid *, u_int, u_int);
 u_int	 grid_reflow(struct grid *, struct grid *, u_int);
+void	 grid_pack_line(struct grid_line *);
+void	 grid_get_text(struct grid *, u_int, struct grid_text *);
+void	 grid_unpack_line(struct grid_line *);
+
+/* grid-spill.c */
+struct grid_spill *grid_spill_create(const char *, u_int);
+void	 grid_spill_destroy(struct grid_spill *);
+int	 grid_spill_add(struct grid_spill *, struct grid_line *);
+void	 grid_spill_drop(struct grid_spill *);
+struct grid_line *grid_spill_get(struct grid_spill *, u_int);
 
 /* grid-cell.c */
 u_int	 grid_cell_width(const struct grid_cell *);
@@ -2030,10 +2297,11 @@ void	 grid_cell_set(struct grid_cell *, const struct utf8_data *);
 void	 grid_cell_one(struct grid_cell *, u_char);
 
 /* grid-view.c */
-const struct grid_cell *grid_view_peek_cell(struct grid *, u_int, u_int);
-struct grid_cell *grid_view_get_cell(struct grid *, u_int, u_int);
+void	 grid_view_get_cell(struct grid *, u_int, u_int, struct grid_cell *);
 void	 grid_view_set_cell(
 	     struct grid *, u_int, u_int, const struct grid_cell *);
+void	 grid_view_set_cells(struct grid *, u_int, u_int,
+	     const struct grid_cell *, const u_char *, u_int);
 void	 grid_view_clear_history(struct grid *);
 void	 grid_view_clear(struct grid *, u_int, u_int, u_int, u_int);
 void	 grid_view_scroll_region_up(struct grid *, u_int, u_int);
@@ -2068,6 +2336,8 @@ void	 screen_write_parsestyle(
 	     struct grid_cell *, struct grid_cell *, const char *, int*);
 void	 screen_write_putc(
 	     struct screen_write_ctx *, struct grid_cell *, u_char);
+void	 screen_write_cells(struct screen_write_ctx *, struct grid_cell *,
+	     const u_char *, u_int);
 void	 screen_write_copy(struct screen_write_ctx *,
 	     struct screen *, u_int, u_int, u_int, u_int);
 void	 screen_write_backspace(struct screen_write_ctx *);
@@ -2121,9 +2391,12 @@ void	 screen_reflow(struct screen *, u_int);
 
 /* window.c */
 extern struct windows windows;
+extern struct window_tree all_windows;
 extern struct window_pane_tree all_window_panes;
 int		 winlink_cmp(struct winlink *, struct winlink *);
 RB_PROTOTYPE(winlinks, winlink, entry, winlink_cmp);
+int		 window_cmp(struct window *, struct window *);
+RB_PROTOTYPE(window_tree, window, entry, window_cmp);
 int		 window_pane_cmp(struct window_pane *, struct window_pane *);
 RB_PROTOTYPE(window_pane_tree, window_pane, tree_entry, window_pane_cmp);
 struct winlink	*winlink_find_by_index(struct winlinks *, int);
@@ -2169,7 +2442,15 @@ void		 window_destroy_panes(struct window *);
 struct window_pane *window_pane_find_by_id(u_int);
 struct window_pane *window_pane_create(struct window *, u_int, u_int, u_int);
 void		 window_pane_destroy(struct window_pane *);
+void		 window_pane_spill_history(struct window_pane *, u_int);
 void		 window_pane_timer_start(struct window_pane *);
+u_char		*window_pane_get_new_data(struct window_pane *,
+		     struct window_pane_offset *, size_t *);
+void		 window_pane_update_used_data(struct window_pane *,
+		     struct window_pane_offset *, size_t);
+void		 window_pane_pipe_open(struct window_pane *, int);
+void		 window_pane_pipe_close(struct window_pane *);
+void		 window_pane_pipe_save(struct window_pane *);
 int		 window_pane_spawn(struct window_pane *, const char *,
 		     const char *, const char *, struct environ *,
 		     struct termios *, char **);
@@ -2185,8 +2466,10 @@ void		 window_pane_key(struct window_pane *, struct session *, int);
 void		 window_pane_mouse(struct window_pane *,
 		     struct session *, struct mouse_event *);
 int		 window_pane_visible(struct window_pane *);
+int		 window_search_flags(struct window *, const char *);
+int		 window_search_compile(regex_t *, const char *, int);
 char		*window_pane_search(
-		     struct window_pane *, const char *, u_int *);
+		     struct window_pane *, const char *, regex_t *, u_int *);
 char		*window_printable_flags(struct session *, struct winlink *);
 struct window_pane *window_pane_find_up(struct window_pane *);
 struct window_pane *window_pane_find_down(struct window_pane *);
@@ -2280,13 +2563,20 @@ void	set_signals(void(*)(int, short, void *));
 void	clear_signals(int);
 
 /* control.c */
+int	control_pane_cmp(struct control_pane *, struct control_pane *);
+RB_PROTOTYPE(control_panes, control_pane, entry, control_pane_cmp);
 void	control_callback(struct client *, int, void*);
 void printflike2 control_write(struct client *, const char *, ...);
 void	control_write_buffer(struct client *, struct evbuffer *);
+int	control_set_flags(struct client *, const char *, char **);
+struct control_pane *control_get_pane(struct client *, struct window_pane *);
+void	control_pause_pane(struct client *, struct window_pane *);
+void	control_continue_pane(struct client *, struct window_pane *);
+void	control_free_panes(struct client *);
 
 /* control-notify.c */
 void	control_notify_input(struct client *, struct window_pane *,
-	    struct evbuffer *);
+	    const u_char *, size_t);
 void	control_notify_window_layout_changed(struct window *);
 void	control_notify_window_unlinked(struct session *, struct window *);
 void	control_notify_window_linked(struct session *, struct window *);
@@ -2299,9 +2589,12 @@ void	control_notify_session_close(struct session *);
 /* session.c */
 extern struct sessions sessions;
 extern struct sessions dead_sessions;
+extern struct session_ids session_ids;
 extern struct session_groups session_groups;
 int	session_cmp(struct session *, struct session *);
 RB_PROTOTYPE(sessions, session, entry, session_cmp);
+int	session_id_cmp(struct session *, struct session *);
+RB_PROTOTYPE(session_ids, session, id_entry, session_id_cmp);
 int		 session_alive(struct session *);
 struct session	*session_find(const char *);
 struct session	*session_find_by_id(u_int);
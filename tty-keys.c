@@ -29,16 +29,12 @@
 
 /*
  * Handle keys input from the outside terminal. tty_default_*_keys[] are a base
- * table of supported keys which are looked up in terminfo(5) and translated
- * into a ternary tree.
+ * table of supported keys which are looked up in terminfo(5) and compiled into
+ * a table of states for each terminal type, shared by every client using it.
  */
 
-void		tty_keys_add1(struct tty_key **, const char *, int);
-void		tty_keys_add(struct tty *, const char *, int);
-void		tty_keys_free1(struct tty_key *);
-struct tty_key *tty_keys_find1(
-		    struct tty_key *, const char *, size_t, size_t *);
-struct tty_key *tty_keys_find(struct tty *, const char *, size_t, size_t *);
+u_int		tty_keys_state(struct tty_key_table *, u_int ***, u_int *);
+int		tty_keys_plain(struct tty *, u_char);
 void		tty_keys_callback(int, short, void *);
 int		tty_keys_mouse(struct tty *, const char *, size_t, size_t *);
 int		tty_keys_device(struct tty *, const char *, size_t, size_t *);
@@ -291,149 +287,235 @@ const struct tty_default_key_code tty_default_code_keys[] = {
 	{ TTYC_KUP7, KEYC_UP|KEYC_ESCAPE|KEYC_CTRL },
 };
 
-/* Add key to tree. */
-void
-tty_keys_add(struct tty *tty, const char *s, int key)
+/*
+ * Find the state for a set of strings and offsets, adding it if it is new.
+ * Sets are stored with their size first.
+ */
+u_int
+tty_keys_state(struct tty_key_table *table, u_int ***sets, u_int *set)
 {
-	struct tty_key	*tk;
-	size_t		 size;
-	const char     	*keystr;
-
-	keystr = key_string_lookup_key(key);
-	if ((tk = tty_keys_find(tty, s, strlen(s), &size)) == NULL) {
-		log_debug("new key %s: 0x%x (%s)", s, key, keystr);
-		tty_keys_add1(&tty->key_tree, s, key);
-	} else {
-		log_debug("replacing key %s: 0x%x (%s)", s, key, keystr);
-		tk->key = key;
+	size_t	size;
+	u_int	i;
+
+	size = (set[0] + 1) * sizeof *set;
+	for (i = 1; i < table->nstates; i++) {
+		if ((*sets)[i][0] == set[0] &&
+		    memcmp((*sets)[i], set, size) == 0)
+			return (i);
 	}
+
+	table->states = xrealloc(table->states,
+	    table->nstates + 1, sizeof *table->states);
+	memset(&table->states[table->nstates], 0, sizeof *table->states);
+
+	*sets = xrealloc(*sets, table->nstates + 1, sizeof **sets);
+	(*sets)[table->nstates] = xmalloc(size);
+	memcpy((*sets)[table->nstates], set, size);
+
+	return (table->nstates++);
 }
 
-/* Add next node to the tree. */
+/*
+ * Compile key strings into a table. Each state stands for the set of strings
+ * (as index and offset) which match the bytes so far, so finding a key takes
+ * one step per byte.
+ *
+ * If xterm is set, an _ in a string matches any byte (the xterm modifier) and
+ * the earliest string in the list to match is taken. If not, strings must be
+ * exact, a later duplicate replaces an earlier one and a key is only matched
+ * when no longer string could follow it.
+ */
 void
-tty_keys_add1(struct tty_key **tkp, const char *s, int key)
+tty_keys_compile(struct tty_key_table *table,
+    const struct tty_key_string *strings, u_int n, int xterm)
 {
-	struct tty_key	*tk;
-
-	/* Allocate a tree entry if there isn't one already. */
-	tk = *tkp;
-	if (tk == NULL) {
-		tk = *tkp = xcalloc(1, sizeof *tk);
-		tk->ch = *s;
-		tk->key = KEYC_NONE;
+	struct tty_key_state	*tks;
+	u_int		       **sets, *set, *next, *length, state, i, j;
+	u_int			 pos, c;
+	const char		*s;
+
+	table->states = NULL;
+	table->nstates = 0;
+	sets = NULL;
+
+	length = xcalloc(n, sizeof *length);
+	next = xcalloc(n + 1, sizeof *next);
+	for (i = 0; i < n; i++) {
+		length[i] = strlen(strings[i].string);
+		if (length[i] > UCHAR_MAX)
+			length[i] = 0;
+		if (length[i] != 0)
+			next[1 + next[0]++] = i << 8;
 	}
-
-	/* Find the next entry. */
-	if (*s == tk->ch) {
-		/* Move forward in string. */
-		s++;
-
-		/* If this is the end of the string, no more is necessary. */
-		if (*s == '\0') {
-			tk->key = key;
-			return;
+	if (next[0] != 0)
+		tty_keys_state(table, &sets, next);
+
+	for (state = 0; state < table->nstates; state++) {
+		set = sets[state];
+
+		/* Find the state for the next set after every byte. */
+		for (c = 0; c <= UCHAR_MAX; c++) {
+			next[0] = 0;
+			for (j = 1; j <= set[0]; j++) {
+				i = set[j] >> 8;
+				pos = set[j] & 0xff;
+				if (pos == length[i])
+					continue;
+				s = strings[i].string;
+				if ((u_char) s[pos] != c &&
+				    (!xterm || s[pos] != '_'))
+					continue;
+				next[1 + next[0]++] = (i << 8)|(pos + 1);
+			}
+			if (next[0] != 0) {
+				i = tty_keys_state(table, &sets, next);
+				table->states[state].next[c] = i;
+			}
 		}
 
-		/* Use the child tree for the next character. */
-		tkp = &tk->next;
-	} else {
-		if (*s < tk->ch)
-			tkp = &tk->left;
-		else if (*s > tk->ch)
-			tkp = &tk->right;
+		/* Work out which key, if any, has matched. */
+		tks = &table->states[state];
+		tks->key = KEYC_NONE;
+		tks->accept = tks->alive = UINT_MAX;
+		for (j = 1; j <= set[0]; j++) {
+			i = set[j] >> 8;
+			pos = set[j] & 0xff;
+			s = strings[i].string;
+			if (pos != length[i]) {
+				if (i < tks->alive)
+					tks->alive = xterm ? i : 0;
+			} else if (!xterm) {
+				tks->accept = 0;
+				tks->key = strings[i].key;
+			} else if (i < tks->accept) {
+				tks->accept = i;
+				tks->key = strings[i].key;
+				tks->modifier = 0;
+				if (strchr(s, '_') != NULL)
+					tks->modifier = strcspn(s, "_");
+			}
+		}
+		if (!xterm && tks->alive != UINT_MAX) {
+			tks->accept = UINT_MAX;
+			tks->key = KEYC_NONE;
+		}
 	}
 
-	/* And recurse to add it. */
-	tty_keys_add1(tkp, s, key);
+	for (state = 0; state < table->nstates; state++)
+		free(sets[state]);
+	free(sets);
+	free(next);
+	free(length);
 }
 
-/* Initialise a key tree from the table. */
+/* Compile the keys for a terminal from the built-in and terminfo strings. */
 void
-tty_keys_build(struct tty *tty)
+tty_keys_build(struct tty_term *term)
 {
 	const struct tty_default_key_raw	*tdkr;
 	const struct tty_default_key_code	*tdkc;
-	u_int		 			 i;
+	struct tty_key_string			*strings;
+	u_int		 			 i, n;
 	const char				*s;
 
-	if (tty->key_tree != NULL)
-		tty_keys_free (tty);
-	tty->key_tree = NULL;
+	strings = xcalloc(nitems(tty_default_raw_keys) +
+	    nitems(tty_default_code_keys), sizeof *strings);
+	n = 0;
 
 	for (i = 0; i < nitems(tty_default_raw_keys); i++) {
 		tdkr = &tty_default_raw_keys[i];
 
 		s = tdkr->string;
-		if (*s != '\0')
-			tty_keys_add(tty, s, tdkr->key);
+		if (*s != '\0') {
+			strings[n].key = tdkr->key;
+			strings[n++].string = s;
+		}
 	}
 	for (i = 0; i < nitems(tty_default_code_keys); i++) {
 		tdkc = &tty_default_code_keys[i];
 
-		s = tty_term_string(tty->term, tdkc->code);
-		if (*s != '\0')
-			tty_keys_add(tty, s, tdkc->key);
-
+		s = tty_term_string(term, tdkc->code);
+		if (*s != '\0') {
+			strings[n].key = tdkc->key;
+			strings[n++].string = s;
+		}
 	}
-}
 
-/* Free the entire key tree. */
-void
-tty_keys_free(struct tty *tty)
-{
-	tty_keys_free1(tty->key_tree);
+	tty_keys_compile(&term->keys, strings, n, 0);
+	log_debug("%s: %u keys, %u states", term->name, n, term->keys.nstates);
+
+	free(strings);
 }
 
-/* Free a single key. */
+/* Free the compiled keys for a terminal. */
 void
-tty_keys_free1(struct tty_key *tk)
+tty_keys_free(struct tty_term *term)
 {
-	if (tk->next != NULL)
-		tty_keys_free1(tk->next);
-	if (tk->left != NULL)
-		tty_keys_free1(tk->left);
-	if (tk->right != NULL)
-		tty_keys_free1(tk->right);
-	free(tk);
+	free(term->keys.states);
+	term->keys.states = NULL;
+	term->keys.nstates = 0;
 }
 
-/* Lookup a key in the tree. */
-struct tty_key *
-tty_keys_find(struct tty *tty, const char *buf, size_t len, size_t *size)
+/*
+ * Look for a key at the start of the buffer. Returns 0 for found (and the
+ * state with the key), -1 for not found, 1 for partial match.
+ */
+int
+tty_keys_match(struct tty_key_table *table, const char *buf, size_t len,
+    size_t *size, const struct tty_key_state **found)
 {
+	struct tty_key_state	*tks;
+	u_int			 state, best;
+	size_t			 i;
+
+	*found = NULL;
 	*size = 0;
-	return (tty_keys_find1(tty->key_tree, buf, len, size));
+	if (table->nstates == 0)
+		return (-1);
+
+	state = 0;
+	best = UINT_MAX;
+	for (i = 0;; i++) {
+		tks = &table->states[state];
+		if (tks->accept < best) {
+			best = tks->accept;
+			*found = tks;
+			*size = i;
+		}
+		if (tks->alive == UINT_MAX || tks->alive > best)
+			break;
+		if (i == len)
+			return (1);
+		if ((state = tks->next[(u_char) buf[i]]) == 0)
+			break;
+	}
+	if (*found == NULL)
+		return (-1);
+	return (0);
 }
 
-/* Find the next node. */
-struct tty_key *
-tty_keys_find1(struct tty_key *tk, const char *buf, size_t len, size_t *size)
+/*
+ * Is this byte plain text? That is, it is not escape or backspace and cannot
+ * start any key sequence, so on its own it is always the key with that value.
+ * Tab, newline and carriage return count as text since pastes are full of
+ * them; they are still checked for bindings like any other key.
+ */
+int
+tty_keys_plain(struct tty *tty, u_char ch)
 {
-	/* If the node is NULL, this is the end of the tree. No match. */
-	if (tk == NULL)
-		return (NULL);
-
-	/* Pick the next in the sequence. */
-	if (tk->ch == *buf) {
-		/* Move forward in the string. */
-		buf++; len--;
-		(*size)++;
-
-		/* At the end of the string, return the current node. */
-		if (len == 0 || (tk->next == NULL && tk->key != KEYC_NONE))
-			return (tk);
-
-		/* Move into the next tree for the following character. */
-		tk = tk->next;
-	} else {
-		if (*buf < tk->ch)
-			tk = tk->left;
-		else if (*buf > tk->ch)
-			tk = tk->right;
-	}
+	struct tty_key_table	*keys;
+	cc_t			 bspace;
+
+	if (ch < ' ' && ch != '\t' && ch != '\n' && ch != '\r')
+		return (0);
+	if (ch == '\177')
+		return (0);
+	bspace = tty->tio.c_cc[VERASE];
+	if (bspace != _POSIX_VDISABLE && ch == bspace)
+		return (0);
 
-	/* Move to the next in the tree. */
-	return (tty_keys_find1(tk, buf, len, size));
+	keys = &tty->term->keys;
+	return (keys->nstates == 0 || keys->states[0].next[ch] == 0);
 }
 
 /*
@@ -443,12 +525,12 @@ tty_keys_find1(struct tty_key *tk, const char *buf, size_t len, size_t *size)
 int
 tty_keys_next(struct tty *tty)
 {
-	struct tty_key	*tk;
-	struct timeval	 tv;
-	const char	*buf;
-	size_t		 len, size;
-	cc_t		 bspace;
-	int		 key, delay, expired = 0;
+	const struct tty_key_state	*tks;
+	struct timeval			 tv;
+	const char			*buf;
+	size_t				 len, size;
+	cc_t				 bspace;
+	int				 key, delay, expired = 0;
 
 	/* Get key buffer. */
 	buf = EVBUFFER_DATA(tty->event->input);
@@ -457,6 +539,26 @@ tty_keys_next(struct tty *tty)
 		return (0);
 	log_debug("keys are %zu (%.*s)", len, (int) len, buf);
 
+	/*
+	 * If there is a run of plain text, try to write it all to the pane at
+	 * once rather than a key at a time.
+	 */
+	for (size = 0; size < len; size++) {
+		if (!tty_keys_plain(tty, buf[size]))
+			break;
+	}
+	if (size != 0) {
+		size = server_client_handle_text(tty->client,
+		    (const u_char *) buf, size);
+		if (size != 0) {
+			evbuffer_drain(tty->event->input, size);
+			if (event_initialized(&tty->key_timer))
+				evtimer_del(&tty->key_timer);
+			tty->flags &= ~TTY_TIMER;
+			return (1);
+		}
+	}
+
 	/* Is this device attributes response? */
 	switch (tty_keys_device(tty, buf, len, &size)) {
 	case 0:		/* yes */
@@ -490,12 +592,14 @@ tty_keys_next(struct tty *tty)
 	}
 
 	/* Look for matching key string and return if found. */
-	tk = tty_keys_find(tty, buf, len, &size);
-	if (tk != NULL) {
-		if (tk->next != NULL)
-			goto partial_key;
-		key = tk->key;
+	switch (tty_keys_match(&tty->term->keys, buf, len, &size, &tks)) {
+	case 0:		/* found */
+		key = tks->key;
 		goto complete_key;
+	case -1:	/* not found */
+		break;
+	case 1:
+		goto partial_key;
 	}
 
 first_key:
@@ -507,15 +611,20 @@ first_key:
 			goto complete_key;
 		}
 
-		tk = tty_keys_find(tty, buf + 1, len - 1, &size);
-		if (tk != NULL && (!expired || tk->next == NULL)) {
+		switch (tty_keys_match(&tty->term->keys, buf + 1, len - 1,
+		    &size, &tks)) {
+		case 0:		/* found */
 			size++;	/* include escape */
-			if (tk->next != NULL)
-				goto partial_key;
-			key = tk->key;
+			key = tks->key;
 			if (key != KEYC_NONE)
 				key |= KEYC_ESCAPE;
 			goto complete_key;
+		case -1:	/* not found */
+			break;
+		case 1:		/* partial, unless timer has expired */
+			if (!expired)
+				goto partial_key;
+			break;
 		}
 	}
 
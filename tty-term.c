@@ -331,6 +331,8 @@ tty_term_find(char *name, int fd, const char *overrides, char **cause)
 	term->references = 1;
 	term->flags = 0;
 	memset(term->codes, 0, sizeof term->codes);
+	term->keys.states = NULL;
+	term->keys.nstates = 0;
 	LIST_INSERT_HEAD(&tty_terms, term, entry);
 
 	/* Set up curses terminal. */
@@ -450,6 +452,9 @@ tty_term_find(char *name, int fd, const char *overrides, char **cause)
 		code->type = TTYCODE_STRING;
 	}
 
+	/* Compile the keys once here for every client using this terminal. */
+	tty_keys_build(term);
+
 	return (term);
 
 error:
@@ -467,6 +472,7 @@ tty_term_free(struct tty_term *term)
 
 	LIST_REMOVE(term, entry);
 
+	tty_keys_free(term);
 	for (i = 0; i < NTTYCODE; i++) {
 		if (term->codes[i].type == TTYCODE_STRING)
 			free(term->codes[i].value.string);
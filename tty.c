@@ -31,6 +31,19 @@
 
 #include "tmux.h"
 
+/*
+ * Output is collected in a buffer and given to the bufferevent once each time
+ * round the server loop. If it gets larger than this, it is flushed early.
+ */
+#define TTY_OUT_MAX 65536
+
+/*
+ * When redrawing a line with the cursor already in place, cells the terminal
+ * already has are only skipped if there are at least this many in a row,
+ * otherwise moving the cursor costs more than writing them again.
+ */
+#define TTY_FRAME_SKIP 6
+
 void	tty_read_callback(struct bufferevent *, void *);
 void	tty_error_callback(struct bufferevent *, short, void *);
 
@@ -49,6 +62,16 @@ void	tty_emulate_repeat(
 	    struct tty *, enum tty_code_code, enum tty_code_code, u_int);
 void	tty_repeat_space(struct tty *, u_int);
 void	tty_cell(struct tty *, const struct grid_cell *);
+void	tty_add(struct tty *, const void *, size_t);
+
+void	tty_frame_alloc(struct tty *);
+void	tty_frame_invalidate(struct tty *, u_int, u_int);
+void	tty_frame_clear(struct tty *, u_int, u_int, u_int);
+void	tty_frame_scroll(struct tty *);
+void	tty_frame_set(struct tty *, u_int, u_int, const u_char *, u_int, u_int);
+void	tty_frame_put(struct tty *, u_char);
+void	tty_frame_code(struct tty *, enum tty_code_code, u_int);
+void	tty_draw_get_cell(struct screen *, u_int, u_int, struct grid_cell *);
 
 #define tty_use_acs(tty) \
 	(tty_term_has((tty)->term, TTYC_ACSC) && !((tty)->flags & TTY_UTF8))
@@ -125,6 +148,8 @@ tty_set_size(struct tty *tty, u_int sx, u_int sy) {
 		return (0);
 	tty->sx = sx;
 	tty->sy = sy;
+	if (tty->frame != NULL)
+		tty_frame_alloc(tty);
 	return (1);
 }
 
@@ -156,8 +181,6 @@ tty_open(struct tty *tty, const char *overrides, char **cause)
 
 	tty_start_tty(tty);
 
-	tty_keys_build(tty);
-
 	return (0);
 }
 
@@ -210,6 +233,9 @@ tty_start_tty(struct tty *tty)
 
 	tty_putcode(tty, TTYC_SGR0);
 	memcpy(&tty->cell, &grid_default_cell, sizeof tty->cell);
+	memcpy(&tty->frame_cell, &grid_default_cell, sizeof tty->frame_cell);
+
+	tty_frame_alloc(tty);
 
 	tty_putcode(tty, TTYC_RMKX);
 	if (tty_use_acs(tty))
@@ -253,6 +279,7 @@ tty_stop_tty(struct tty *tty)
 		return;
 	tty->flags &= ~TTY_STARTED;
 
+	tty_flush(tty);
 	bufferevent_disable(tty->event, EV_READ|EV_WRITE);
 
 	/*
@@ -302,12 +329,15 @@ tty_close(struct tty *tty)
 	if (event_initialized(&tty->key_timer))
 		evtimer_del(&tty->key_timer);
 	tty_stop_tty(tty);
+	tty->out_len = 0;
+
+	free(tty->frame);
+	tty->frame = NULL;
 
 	if (tty->flags & TTY_OPENED) {
 		bufferevent_free(tty->event);
 
 		tty_term_free(tty->term);
-		tty_keys_free(tty);
 
 		tty->flags &= ~TTY_OPENED;
 	}
@@ -324,6 +354,7 @@ tty_free(struct tty *tty)
 	tty_close(tty);
 
 	free(tty->ccolour);
+	free(tty->out_buf);
 	if (tty->path != NULL)
 		free(tty->path);
 	if (tty->termname != NULL)
@@ -353,6 +384,7 @@ tty_raw(struct tty *tty, const char *s)
 void
 tty_putcode(struct tty *tty, enum tty_code_code code)
 {
+	tty_frame_code(tty, code, 1);
 	tty_puts(tty, tty_term_string(tty->term, code));
 }
 
@@ -361,6 +393,7 @@ tty_putcode1(struct tty *tty, enum tty_code_code code, int a)
 {
 	if (a < 0)
 		return;
+	tty_frame_code(tty, code, a);
 	tty_puts(tty, tty_term_string1(tty->term, code, a));
 }
 
@@ -386,15 +419,43 @@ tty_putcode_ptr2(struct tty *tty, enum tty_code_code code, const void *a, const
 		tty_puts(tty, tty_term_ptr2(tty->term, code, a, b));
 }
 
+/* Add data to the output buffer. */
 void
-tty_puts(struct tty *tty, const char *s)
+tty_add(struct tty *tty, const void *buf, size_t len)
 {
-	if (*s == '\0')
+	if (tty->out_len + len > TTY_OUT_MAX)
+		tty_flush(tty);
+
+	if (tty->out_len + len > tty->out_size) {
+		if (tty->out_size == 0)
+			tty->out_size = BUFSIZ;
+		while (tty->out_len + len > tty->out_size)
+			tty->out_size *= 2;
+		tty->out_buf = xrealloc(tty->out_buf, 1, tty->out_size);
+	}
+	memcpy(tty->out_buf + tty->out_len, buf, len);
+	tty->out_len += len;
+}
+
+/* Pass any buffered output to the bufferevent and the log. */
+void
+tty_flush(struct tty *tty)
+{
+	if (tty->out_len == 0)
 		return;
-	bufferevent_write(tty->event, s, strlen(s));
 
+	bufferevent_write(tty->event, tty->out_buf, tty->out_len);
 	if (tty->log_fd != -1)
-		write(tty->log_fd, s, strlen(s));
+		write(tty->log_fd, tty->out_buf, tty->out_len);
+	tty->out_len = 0;
+}
+
+void
+tty_puts(struct tty *tty, const char *s)
+{
+	if (*s == '\0')
+		return;
+	tty_add(tty, s, strlen(s));
 }
 
 void
@@ -406,13 +467,22 @@ tty_putc(struct tty *tty, u_char ch)
 	if (tty->cell.attr & GRID_ATTR_CHARSET) {
 		acs = tty_acs_get(tty, ch);
 		if (acs != NULL)
-			bufferevent_write(tty->event, acs, strlen(acs));
+			tty_add(tty, acs, strlen(acs));
 		else
-			bufferevent_write(tty->event, &ch, 1);
+			tty_add(tty, &ch, 1);
 	} else
-		bufferevent_write(tty->event, &ch, 1);
+		tty_add(tty, &ch, 1);
+
+	if (ch == '\n' && tty->frame != NULL) {
+		if (tty->cy >= tty->sy)
+			tty_frame_invalidate(tty, 0, tty->sy);
+		else if (tty->cy == tty->rlower)
+			tty_frame_scroll(tty);
+	}
 
 	if (ch >= 0x20 && ch != 0x7f) {
+		tty_frame_put(tty, ch);
+
 		sx = tty->sx;
 		if (tty->term->flags & TERM_EARLYWRAP)
 			sx--;
@@ -424,20 +494,273 @@ tty_putc(struct tty *tty, u_char ch)
 		} else
 			tty->cx++;
 	}
-
-	if (tty->log_fd != -1)
-		write(tty->log_fd, &ch, 1);
 }
 
 void
 tty_putn(struct tty *tty, const void *buf, size_t len, u_int width)
 {
-	bufferevent_write(tty->event, buf, len);
-	if (tty->log_fd != -1)
-		write(tty->log_fd, buf, len);
+	const u_char	*cp = buf;
+	u_int		 i;
+
+	tty_add(tty, buf, len);
+
+	if (tty->frame != NULL) {
+		if (tty->cy >= tty->sy || tty->cx + width > tty->sx)
+			tty_frame_invalidate(tty, 0, tty->sy);
+		else if (len == width) {
+			for (i = 0; i < width; i++)
+				tty_frame_set(tty, tty->cx + i, tty->cy, cp + i, 1, 1);
+		} else
+			tty_frame_set(tty, tty->cx, tty->cy, cp, len, width);
+	}
+
 	tty->cx += width;
 }
 
+/* Allocate the frame for the current size, with every cell unknown. */
+void
+tty_frame_alloc(struct tty *tty)
+{
+	free(tty->frame);
+	tty->frame = NULL;
+
+	/* Don't bother if the terminal wraps too early to track. */
+	if (tty->term == NULL || tty->term->flags & TERM_EARLYWRAP)
+		return;
+	if (tty->sx == 0 || tty->sy == 0)
+		return;
+	tty->frame = xcalloc(tty->sx * tty->sy, sizeof *tty->frame);
+}
+
+/* Forget what is on a set of lines. */
+void
+tty_frame_invalidate(struct tty *tty, u_int py, u_int ny)
+{
+	if (tty->frame == NULL || py >= tty->sy)
+		return;
+	if (ny > tty->sy - py)
+		ny = tty->sy - py;
+	memset(&tty->frame[py * tty->sx], 0, ny * tty->sx * sizeof *tty->frame);
+}
+
+/* Forget everything the terminal is showing. */
+void
+tty_invalidate(struct tty *tty)
+{
+	tty_frame_invalidate(tty, 0, tty->sy);
+}
+
+/* Record that part of a line has been cleared with the current attributes. */
+void
+tty_frame_clear(struct tty *tty, u_int px, u_int py, u_int nx)
+{
+	struct grid_cell	*fc;
+	u_int			 i;
+
+	if (tty->frame == NULL || py >= tty->sy || px >= tty->sx)
+		return;
+	if (nx > tty->sx - px)
+		nx = tty->sx - px;
+
+	/*
+	 * Terminals may clear with the current background, so only default
+	 * cells are known to be blank.
+	 */
+	fc = &tty->frame[py * tty->sx + px];
+
+	/* The other half of a wide character may be left behind. */
+	if (px != 0 && fc[0].flags & GRID_FLAG_PADDING)
+		fc[-1].xstate = 0;
+	if (px + nx < tty->sx && fc[nx].flags & GRID_FLAG_PADDING)
+		fc[nx].xstate = 0;
+
+	if (tty->cell.attr != 0 || tty->cell.fg != 8 || tty->cell.bg != 8 ||
+	    tty->cell.flags & (GRID_FLAG_FG256|GRID_FLAG_BG256)) {
+		memset(fc, 0, nx * sizeof *fc);
+		return;
+	}
+	for (i = 0; i < nx; i++)
+		memcpy(&fc[i], &grid_default_cell, sizeof fc[i]);
+}
+
+/* Record that the scroll region has scrolled up by one line. */
+void
+tty_frame_scroll(struct tty *tty)
+{
+	u_int	rupper = tty->rupper, rlower = tty->rlower;
+
+	if (tty->frame == NULL)
+		return;
+	if (rupper >= tty->sy || rlower >= tty->sy || rupper > rlower) {
+		tty_frame_invalidate(tty, 0, tty->sy);
+		return;
+	}
+
+	memmove(&tty->frame[rupper * tty->sx],
+	    &tty->frame[(rupper + 1) * tty->sx],
+	    (rlower - rupper) * tty->sx * sizeof *tty->frame);
+	tty_frame_clear(tty, 0, rlower, tty->sx);
+}
+
+/* Record a character written at a position with the current attributes. */
+void
+tty_frame_set(struct tty *tty, u_int px, u_int py, const u_char *data,
+    u_int size, u_int width)
+{
+	struct grid_cell	*fc;
+	struct utf8_data	 ud;
+	u_int			 i;
+
+	if (size > UTF8_SIZE || width == 0) {
+		tty_frame_invalidate(tty, py, 1);
+		return;
+	}
+	fc = &tty->frame[py * tty->sx];
+
+	/* Overwriting either half of a wide character loses the other. */
+	if (px != 0 && fc[px].flags & GRID_FLAG_PADDING)
+		fc[px - 1].xstate = 0;
+	if (px + width < tty->sx && fc[px + width].flags & GRID_FLAG_PADDING)
+		fc[px + width].xstate = 0;
+
+	memcpy(&fc[px], &tty->frame_cell, sizeof fc[px]);
+	fc[px].flags &= ~GRID_FLAG_PADDING;
+	memcpy(ud.data, data, size);
+	ud.size = size;
+	ud.width = width;
+	grid_cell_set(&fc[px], &ud);
+
+	for (i = 1; i < width; i++) {
+		memcpy(&fc[px + i], &tty->frame_cell, sizeof fc[px + i]);
+		fc[px + i].flags |= GRID_FLAG_PADDING;
+		grid_cell_one(&fc[px + i], ' ');
+	}
+}
+
+/* Record a single character written by tty_putc. */
+void
+tty_frame_put(struct tty *tty, u_char ch)
+{
+	u_int	px = tty->cx, py = tty->cy;
+
+	if (tty->frame == NULL)
+		return;
+	if (py >= tty->sy || px > tty->sx) {
+		tty_frame_invalidate(tty, 0, tty->sy);
+		return;
+	}
+
+	/* At the end of the line, the character wraps onto the next. */
+	if (px == tty->sx) {
+		px = 0;
+		if (py == tty->rlower)
+			tty_frame_scroll(tty);
+		else if (++py == tty->sy) {
+			tty_frame_invalidate(tty, 0, tty->sy);
+			return;
+		}
+	}
+	tty_frame_set(tty, px, py, &ch, 1, 1);
+}
+
+/* Record the effect of a terminal capability on the screen. */
+void
+tty_frame_code(struct tty *tty, enum tty_code_code code, u_int n)
+{
+	u_int	px = tty->cx, py = tty->cy, py2;
+
+	if (tty->frame == NULL)
+		return;
+
+	switch (code) {
+	case TTYC_CLEAR:
+		for (py = 0; py < tty->sy; py++)
+			tty_frame_clear(tty, 0, py, tty->sx);
+		return;
+	case TTYC_EL:
+	case TTYC_EL1:
+	case TTYC_ECH:
+	case TTYC_ICH:
+	case TTYC_ICH1:
+	case TTYC_DCH:
+	case TTYC_DCH1:
+	case TTYC_IL:
+	case TTYC_IL1:
+	case TTYC_DL:
+	case TTYC_DL1:
+	case TTYC_RI:
+		break;
+	default:
+		return;
+	}
+
+	if (py >= tty->sy) {
+		tty_frame_invalidate(tty, 0, tty->sy);
+		return;
+	}
+	if (px >= tty->sx) {
+		tty_frame_invalidate(tty, py, 1);
+		return;
+	}
+
+	switch (code) {
+	case TTYC_EL:
+		tty_frame_clear(tty, px, py, tty->sx - px);
+		break;
+	case TTYC_EL1:
+		tty_frame_clear(tty, 0, py, px + 1);
+		break;
+	case TTYC_ECH:
+		tty_frame_clear(tty, px, py, n);
+		break;
+	case TTYC_ICH:
+	case TTYC_ICH1:
+	case TTYC_DCH:
+	case TTYC_DCH1:
+		/* The rest of the line moves, so just forget it. */
+		tty_frame_clear(tty, px, py, tty->sx - px);
+		memset(&tty->frame[py * tty->sx + px], 0,
+		    (tty->sx - px) * sizeof *tty->frame);
+		break;
+	default:
+		/* Lines inserted, deleted or scrolled down. */
+		py2 = tty->rlower;
+		if (code == TTYC_RI)
+			py = tty->rupper;
+		if (py2 >= tty->sy || py > py2)
+			tty_frame_invalidate(tty, 0, tty->sy);
+		else
+			tty_frame_invalidate(tty, py, py2 - py + 1);
+		break;
+	}
+}
+
+/* Is a cell the same as the one the terminal is already showing? */
+int
+tty_frame_same(struct tty *tty, u_int px, u_int py, const struct grid_cell *gc)
+{
+	const struct grid_cell	*fc;
+
+	if (tty->frame == NULL || px >= tty->sx || py >= tty->sy)
+		return (0);
+	fc = &tty->frame[py * tty->sx + px];
+	if (fc->xstate == 0)
+		return (0);
+
+	if ((fc->flags ^ gc->flags) & GRID_FLAG_PADDING)
+		return (0);
+	if (gc->flags & GRID_FLAG_PADDING)
+		return (1);
+
+	if (fc->attr != gc->attr || fc->fg != gc->fg || fc->bg != gc->bg)
+		return (0);
+	if ((fc->flags ^ gc->flags) & (GRID_FLAG_FG256|GRID_FLAG_BG256))
+		return (0);
+	if (fc->xstate != gc->xstate)
+		return (0);
+	return (memcmp(fc->xdata, gc->xdata, gc->xstate & 0xf) == 0);
+}
+
 void
 tty_set_title(struct tty *tty, const char *title)
 {
@@ -600,54 +923,102 @@ tty_redraw_region(struct tty *tty, const struct tty_ctx *ctx)
 	}
 }
 
+/* Get a cell to draw, with the selection applied. */
+void
+tty_draw_get_cell(struct screen *s, u_int px, u_int py, struct grid_cell *gc)
+{
+	struct utf8_data	ud;
+	u_char			flags;
+
+	grid_view_get_cell(s->grid, px, py, gc);
+	if (!screen_check_selection(s, px, py))
+		return;
+
+	grid_cell_get(gc, &ud);
+	flags = gc->flags;
+	memcpy(gc, &s->sel.cell, sizeof *gc);
+	grid_cell_set(gc, &ud);
+	gc->flags = flags & ~(GRID_FLAG_FG256|GRID_FLAG_BG256);
+	gc->flags |= s->sel.cell.flags & (GRID_FLAG_FG256|GRID_FLAG_BG256);
+}
+
 void
 tty_draw_line(struct tty *tty, struct screen *s, u_int py, u_int ox, u_int oy)
 {
-	const struct grid_cell	*gc;
 	struct grid_line	*gl;
-	struct grid_cell	 tmpgc;
-	struct utf8_data	 ud;
-	u_int			 i, sx;
+	struct grid_cell	 gc;
+	u_int			 i, j, sx, ex;
+	int			 placed;
 
 	tty_update_mode(tty, tty->mode & ~MODE_CURSOR, s);
 
 	sx = screen_size_x(s);
-	if (sx > s->grid->linedata[s->grid->hsize + py].cellsize)
-		sx = s->grid->linedata[s->grid->hsize + py].cellsize;
+	gl = grid_get_line(s->grid, s->grid->hsize + py);
+	if (sx > gl->cellsize)
+		sx = gl->cellsize;
 	if (sx > tty->sx)
 		sx = tty->sx;
 
 	/*
-	 * Don't move the cursor to the start permission if it will wrap there
-	 * itself.
+	 * Don't move the cursor to the start position if it will wrap there
+	 * itself. Otherwise it is moved before the first cell that is drawn.
 	 */
 	gl = NULL;
 	if (py != 0)
-		gl = &s->grid->linedata[s->grid->hsize + py - 1];
+		gl = grid_get_line(s->grid, s->grid->hsize + py - 1);
+	placed = 1;
 	if (oy + py == 0 || gl == NULL || !(gl->flags & GRID_LINE_WRAPPED) ||
 	    tty->cx < tty->sx || ox != 0 ||
 	    (oy + py != tty->cy + 1 && tty->cy != s->rlower + oy))
-		tty_cursor(tty, ox, oy + py);
+		placed = 0;
 
 	for (i = 0; i < sx; i++) {
-		gc = grid_view_peek_cell(s->grid, i, py);
-		if (screen_check_selection(s, i, py)) {
-			memcpy(&tmpgc, &s->sel.cell, sizeof tmpgc);
-			grid_cell_get(gc, &ud);
-			grid_cell_set(&tmpgc, &ud);
-			tmpgc.flags = gc->flags &
-			    ~(GRID_FLAG_FG256|GRID_FLAG_BG256);
-			tmpgc.flags |= s->sel.cell.flags &
-			    (GRID_FLAG_FG256|GRID_FLAG_BG256);
-			tty_cell(tty, &tmpgc);
-		} else
-			tty_cell(tty, gc);
+		tty_draw_get_cell(s, i, py, &gc);
+		if (gc.flags & GRID_FLAG_PADDING)
+			continue;
+
+		/*
+		 * Skip cells the terminal already has, but if the cursor is in
+		 * place only for a long enough run or the rest of the line.
+		 */
+		if (tty_frame_same(tty, ox + i, oy + py, &gc)) {
+			for (j = i + 1; j < sx; j++) {
+				tty_draw_get_cell(s, j, py, &gc);
+				if (!tty_frame_same(tty, ox + j, oy + py, &gc))
+					break;
+			}
+			if (!placed || j == sx || j - i >= TTY_FRAME_SKIP) {
+				placed = 0;
+				i = j - 1;
+				continue;
+			}
+			tty_draw_get_cell(s, i, py, &gc);
+		}
+
+		if (!placed) {
+			tty_cursor(tty, ox + i, oy + py);
+			placed = 1;
+		}
+		tty_cell(tty, &gc);
 	}
 
 	if (sx >= tty->sx) {
 		tty_update_mode(tty, tty->mode, s);
 		return;
 	}
+
+	/* Nothing more to do if the rest of the line is already blank. */
+	ex = ox + screen_size_x(s);
+	if (ex > tty->sx)
+		ex = tty->sx;
+	for (i = ox + sx; i < ex; i++) {
+		if (!tty_frame_same(tty, i, oy + py, &grid_default_cell))
+			break;
+	}
+	if (i == ex) {
+		tty_update_mode(tty, tty->mode, s);
+		return;
+	}
 	tty_reset(tty);
 
 	tty_cursor(tty, ox + sx, oy + py);
@@ -664,8 +1035,8 @@ tty_write(
     void (*cmdfn)(struct tty *, const struct tty_ctx *), struct tty_ctx *ctx)
 {
 	struct window_pane	*wp = ctx->wp;
+	struct winlink		*wl;
 	struct client		*c;
-	u_int		 	 i;
 
 	/* wp can be NULL if updating the screen but not the terminal. */
 	if (wp == NULL)
@@ -676,23 +1047,28 @@ tty_write(
 	if (!window_pane_visible(wp) || wp->flags & PANE_DROP)
 		return;
 
-	for (i = 0; i < ARRAY_LENGTH(&clients); i++) {
-		c = ARRAY_ITEM(&clients, i);
-		if (c == NULL || c->session == NULL || c->tty.term == NULL)
-			continue;
-		if (c->flags & CLIENT_SUSPENDED)
-			continue;
-		if (c->tty.flags & TTY_FREEZE)
-			continue;
-		if (c->session->curw->window != wp->window)
+	/*
+	 * Only clients attached to a session with this window current need
+	 * the update, so find them through the window's links.
+	 */
+	TAILQ_FOREACH(wl, &wp->window->winlinks, wentry) {
+		if (wl->session->curw != wl)
 			continue;
-
-		ctx->xoff = wp->xoff;
-		ctx->yoff = wp->yoff;
-		if (status_at_line(c) == 0)
-			ctx->yoff++;
-
-		cmdfn(&c->tty, ctx);
+		TAILQ_FOREACH(c, &wl->session->clients, sentry) {
+			if (c->tty.term == NULL)
+				continue;
+			if (c->flags & CLIENT_SUSPENDED)
+				continue;
+			if (c->tty.flags & TTY_FREEZE)
+				continue;
+
+			ctx->xoff = wp->xoff;
+			ctx->yoff = wp->yoff;
+			if (status_at_line(c) == 0)
+				ctx->yoff++;
+
+			cmdfn(&c->tty, ctx);
+		}
 	}
 }
 
@@ -1035,6 +1411,40 @@ tty_cmd_cell(struct tty *tty, const struct tty_ctx *ctx)
 	tty_cell(tty, ctx->cell);
 }
 
+void
+tty_cmd_cells(struct tty *tty, const struct tty_ctx *ctx)
+{
+	struct tty_ctx	 ctx1;
+	struct grid_cell gc;
+	const u_char	*buf = ctx->ptr;
+	u_int		 i;
+
+	/*
+	 * Write the first cell as normal, this takes care of moving the
+	 * cursor and of wrapping.
+	 */
+	memcpy(&ctx1, ctx, sizeof ctx1);
+	memcpy(&gc, ctx->cell, sizeof gc);
+	grid_cell_one(&gc, buf[0]);
+	ctx1.cell = &gc;
+	tty_cmd_cell(tty, &ctx1);
+
+	/*
+	 * The rest of the run is on the same line, so unless it needs ACS
+	 * translation or the terminal wraps early it can be written directly.
+	 */
+	if ((gc.attr & GRID_ATTR_CHARSET) ||
+	    (tty->term->flags & TERM_EARLYWRAP)) {
+		for (i = 1; i < ctx->num; i++) {
+			grid_cell_one(&gc, buf[i]);
+			tty_cell(tty, &gc);
+		}
+		return;
+	}
+	if (ctx->num > 1)
+		tty_putn(tty, buf + 1, ctx->num - 1, ctx->num - 1);
+}
+
 void
 tty_cmd_utf8character(struct tty *tty, const struct tty_ctx *ctx)
 {
@@ -1073,6 +1483,7 @@ tty_cmd_rawstring(struct tty *tty, const struct tty_ctx *ctx)
 
 	for (i = 0; i < ctx->num; i++)
 		tty_putc(tty, str[i]);
+	tty_invalidate(tty);
 
 	tty->cx = tty->cy = UINT_MAX;
 	tty->rupper = tty->rlower = UINT_MAX;
@@ -1124,6 +1535,8 @@ tty_reset(struct tty *tty)
 {
 	struct grid_cell	*gc = &tty->cell;
 
+	memcpy(&tty->frame_cell, &grid_default_cell, sizeof tty->frame_cell);
+
 	if (memcmp(gc, &grid_default_cell, sizeof *gc) == 0)
 		return;
 
@@ -1367,6 +1780,8 @@ tty_attributes(struct tty *tty, const struct grid_cell *gc)
 		tty_putcode(tty, TTYC_INVIS);
 	if ((changed & GRID_ATTR_CHARSET) && tty_use_acs(tty))
 		tty_putcode(tty, TTYC_SMACS);
+
+	memcpy(&tty->frame_cell, gc, sizeof tty->frame_cell);
 }
 
 void
@@ -18,6 +18,7 @@
 
 #include <sys/types.h>
 
+#include <regex.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -38,16 +39,33 @@ void	window_copy_write_line(
 	    struct window_pane *, struct screen_write_ctx *, u_int);
 void	window_copy_write_lines(
 	    struct window_pane *, struct screen_write_ctx *, u_int, u_int);
+void	window_copy_write_matches(struct window_pane *,
+	    struct screen_write_ctx *, u_int, u_int, u_int);
 
 void	window_copy_scroll_to(struct window_pane *, u_int, u_int);
-int	window_copy_search_compare(
-	    struct grid *, u_int, u_int, struct grid *, u_int);
+int	window_copy_search_find(
+	    struct grid_text *, struct grid_text *, size_t *);
+int	window_copy_search_compile(struct window_pane *, const char *);
+void	window_copy_search_free(struct window_pane *);
+void	window_copy_search_text(struct window_pane *, u_int, struct grid_text *);
+int	window_copy_search_match(
+	    struct window_pane *, struct grid_text *, size_t *, size_t *);
+size_t	window_copy_search_skip(struct window_pane *, size_t, size_t);
 int	window_copy_search_lr(
-	    struct grid *, struct grid *, u_int *, u_int, u_int, u_int);
+	    struct window_pane *, struct grid_text *, u_int *, u_int, u_int);
 int	window_copy_search_rl(
-	    struct grid *, struct grid *, u_int *, u_int, u_int, u_int);
-void	window_copy_search_up(struct window_pane *, const char *);
-void	window_copy_search_down(struct window_pane *, const char *);
+	    struct window_pane *, struct grid_text *, u_int *, u_int, u_int);
+void	window_copy_search_start(
+	    struct window_pane *, const char *, int, u_int);
+int	window_copy_search_next(struct window_pane *);
+int	window_copy_search_line(struct window_pane *, u_int, u_int *);
+void	window_copy_search_run(struct window_pane *);
+void	window_copy_search_timer(struct window_pane *);
+void	window_copy_search_callback(int, short, void *);
+void	window_copy_search_cancel(struct window_pane *);
+u_int	window_copy_search_percent(struct window_pane *);
+void	window_copy_count_start(struct window_pane *);
+void	window_copy_count_run(struct window_pane *);
 void	window_copy_goto_line(struct window_pane *, const char *);
 void	window_copy_update_cursor(struct window_pane *, u_int, u_int);
 void	window_copy_start_selection(struct window_pane *);
@@ -80,6 +98,9 @@ void	window_copy_scroll_up(struct window_pane *, u_int);
 void	window_copy_scroll_down(struct window_pane *, u_int);
 void	window_copy_rectangle_toggle(struct window_pane *);
 
+/* Lines searched before returning to the event loop. */
+#define WINDOW_COPY_SEARCH_LINES 2000
+
 const struct window_mode window_copy_mode = {
 	window_copy_init,
 	window_copy_free,
@@ -101,6 +122,12 @@ enum window_copy_input_type {
 	WINDOW_COPY_GOTOLINE,
 };
 
+/* A key pressed while a search is running. */
+struct window_copy_key {
+	struct session *sess;
+	int		key;
+};
+
 /*
  * Copy-mode's visible screen (the "screen" field) is filled from one of
  * two sources: the original contents of the pane (used when we
@@ -147,6 +174,32 @@ struct window_copy_mode_data {
 	enum window_copy_input_type searchtype;
 	char	       *searchstr;
 
+	char	       *searchpattern; /* compiled search string */
+	int		searchflags;
+	int		searchisre; /* searchre is used rather than searchtext */
+	int		searchtrim; /* trim trailing spaces from lines */
+	regex_t		searchre;
+	struct grid_text searchtext;
+	u_int		searchsx;
+	struct grid_text searchline;
+	int		searchmark; /* highlight matches */
+
+	int		searching; /* search in progress */
+	int		searchup;
+	u_int		searchcount; /* matches still to find */
+	u_int		searchfx; /* where this pass started */
+	u_int		searchfy;
+	u_int		searchy; /* next line to search */
+	u_int		searchend; /* where a wrapped pass stops */
+	int		searchwrapped;
+	u_int		searchdone; /* lines searched so far */
+	struct event	searchtimer;
+	ARRAY_DECL(, struct window_copy_key) searchkeys; /* keys to replay */
+
+	int		counting; /* match count in progress */
+	u_int		county; /* next line to count */
+	u_int		countmatches;
+
 	enum window_copy_input_type jumptype;
 	char		jumpchar;
 };
@@ -178,6 +231,16 @@ window_copy_init(struct window_pane *wp)
 	data->searchtype = WINDOW_COPY_OFF;
 	data->searchstr = NULL;
 
+	data->searchpattern = NULL;
+	data->searchisre = 0;
+	memset(&data->searchtext, 0, sizeof data->searchtext);
+	memset(&data->searchline, 0, sizeof data->searchline);
+	data->searchmark = 0;
+	data->searching = 0;
+	data->counting = 0;
+	evtimer_set(&data->searchtimer, window_copy_search_callback, wp);
+	ARRAY_INIT(&data->searchkeys);
+
 	if (wp->fd != -1)
 		bufferevent_disable(wp->event, EV_READ|EV_WRITE);
 
@@ -244,6 +307,12 @@ window_copy_free(struct window_pane *wp)
 	if (wp->fd != -1)
 		bufferevent_enable(wp->event, EV_READ|EV_WRITE);
 
+	ARRAY_FREE(&data->searchkeys);
+	data->counting = 0;
+	window_copy_search_cancel(wp);
+	window_copy_search_free(wp);
+	free(data->searchline.text);
+	free(data->searchline.cells);
 	free(data->searchstr);
 	free(data->inputstr);
 
@@ -278,6 +347,9 @@ window_copy_vadd(struct window_pane *wp, const char *fmt, va_list ap)
 
 	if (backing == &wp->base)
 		return;
+	window_copy_search_cancel(wp);
+	if (data->searchpattern != NULL)
+		window_copy_count_start(wp);
 
 	utf8flag = options_get_number(&wp->window->options, "utf8");
 	memcpy(&gc, &grid_default_cell, sizeof gc);
@@ -339,6 +411,10 @@ window_copy_resize(struct window_pane *wp, u_int sx, u_int sy)
 	struct screen			*s = &data->screen;
 	struct screen_write_ctx	 	 ctx;
 
+	window_copy_search_cancel(wp);
+	if (data->searchpattern != NULL)
+		window_copy_count_start(wp);
+
 	screen_resize(s, sx, sy, 0);
 	if (data->backing != &wp->base)
 		screen_resize(data->backing, sx, sy, 0);
@@ -367,6 +443,7 @@ window_copy_key(struct window_pane *wp, struct session *sess, int key)
 	struct screen			*s = &data->screen;
 	u_int				 n;
 	int				 np, keys;
+	struct window_copy_key		 pk;
 	enum mode_key_cmd		 cmd;
 	const char			*arg;
 
@@ -374,6 +451,40 @@ window_copy_key(struct window_pane *wp, struct session *sess, int key)
 	if (np <= 0)
 		np = 1;
 
+	/*
+	 * While a search is running, keys are queued and handled when it
+	 * finishes. Searching again in the same direction adds to the number
+	 * of matches to find and cancel stops the search and drops the queue.
+	 */
+	if (data->searching || ARRAY_LENGTH(&data->searchkeys) != 0) {
+		cmd = mode_key_lookup(&data->mdata, key, NULL);
+		if (cmd == MODEKEYCOPY_CANCEL ||
+		    cmd == MODEKEYCOPY_CLEARSELECTION) {
+			ARRAY_FREE(&data->searchkeys);
+			window_copy_search_cancel(wp);
+			window_copy_redraw_lines(wp, screen_size_y(s) - 1, 1);
+			data->numprefix = -1;
+			return;
+		}
+		if (data->searching &&
+		    ARRAY_LENGTH(&data->searchkeys) == 0 &&
+		    (cmd == MODEKEYCOPY_SEARCHAGAIN ||
+		    cmd == MODEKEYCOPY_SEARCHREVERSE)) {
+			n = (data->searchtype == WINDOW_COPY_SEARCHUP);
+			if (cmd == MODEKEYCOPY_SEARCHREVERSE)
+				n = !n;
+			if ((int) n == data->searchup) {
+				data->searchcount += np;
+				data->numprefix = -1;
+				return;
+			}
+		}
+		pk.sess = sess;
+		pk.key = key;
+		ARRAY_ADD(&data->searchkeys, pk);
+		return;
+	}
+
 	if (data->inputtype == WINDOW_COPY_JUMPFORWARD ||
 	    data->inputtype == WINDOW_COPY_JUMPBACK ||
 	    data->inputtype == WINDOW_COPY_JUMPTOFORWARD ||
@@ -536,6 +647,7 @@ window_copy_key(struct window_pane *wp, struct session *sess, int key)
 		break;
 	case MODEKEYCOPY_CLEARSELECTION:
 		window_copy_clear_selection(wp);
+		data->searchmark = 0;
 		window_copy_redraw_screen(wp);
 		break;
 	case MODEKEYCOPY_COPYPIPE:
@@ -665,30 +777,12 @@ window_copy_key(struct window_pane *wp, struct session *sess, int key)
 		case WINDOW_COPY_NUMERICPREFIX:
 			break;
 		case WINDOW_COPY_SEARCHUP:
-			if (cmd == MODEKEYCOPY_SEARCHAGAIN) {
-				for (; np != 0; np--) {
-					window_copy_search_up(
-					    wp, data->searchstr);
-				}
-			} else {
-				for (; np != 0; np--) {
-					window_copy_search_down(
-					    wp, data->searchstr);
-				}
-			}
+			window_copy_search_start(wp, data->searchstr,
+			    cmd == MODEKEYCOPY_SEARCHAGAIN, np);
 			break;
 		case WINDOW_COPY_SEARCHDOWN:
-			if (cmd == MODEKEYCOPY_SEARCHAGAIN) {
-				for (; np != 0; np--) {
-					window_copy_search_down(
-					    wp, data->searchstr);
-				}
-			} else {
-				for (; np != 0; np--) {
-					window_copy_search_up(
-					    wp, data->searchstr);
-				}
-			}
+			window_copy_search_start(wp, data->searchstr,
+			    cmd != MODEKEYCOPY_SEARCHAGAIN, np);
 			break;
 		}
 		break;
@@ -773,16 +867,12 @@ window_copy_key_input(struct window_pane *wp, int key)
 		case WINDOW_COPY_NUMERICPREFIX:
 			break;
 		case WINDOW_COPY_SEARCHUP:
-			for (; np != 0; np--)
-				window_copy_search_up(wp, data->inputstr);
-			data->searchtype = data->inputtype;
-			data->searchstr = xstrdup(data->inputstr);
-			break;
 		case WINDOW_COPY_SEARCHDOWN:
-			for (; np != 0; np--)
-				window_copy_search_down(wp, data->inputstr);
 			data->searchtype = data->inputtype;
+			free(data->searchstr);
 			data->searchstr = xstrdup(data->inputstr);
+			window_copy_search_start(wp, data->searchstr,
+			    data->searchtype == WINDOW_COPY_SEARCHUP, np);
 			break;
 		case WINDOW_COPY_GOTOLINE:
 			window_copy_goto_line(wp, data->inputstr);
@@ -914,181 +1004,490 @@ window_copy_scroll_to(struct window_pane *wp, u_int px, u_int py)
 	window_copy_redraw_screen(wp);
 }
 
+/*
+ * Find the search text in line text, starting at *off. memchr looks for the
+ * first byte and only there is the rest compared. A match must start and end
+ * on cell boundaries.
+ */
 int
-window_copy_search_compare(
-    struct grid *gd, u_int px, u_int py, struct grid *sgd, u_int spx)
+window_copy_search_find(struct grid_text *gt, struct grid_text *st,
+    size_t *off)
 {
-	const struct grid_cell	*gc, *sgc;
-	struct utf8_data	 ud, sud;
+	const char	*ptr, *end;
+	size_t		 o, e;
+
+	if (st->len == 0)
+		return (0);
+
+	ptr = gt->text + *off;
+	end = gt->text + gt->len;
+	while (ptr < end && (size_t) (end - ptr) >= st->len) {
+		ptr = memchr(ptr, st->text[0], (end - ptr) - st->len + 1);
+		if (ptr == NULL)
+			break;
+		o = ptr - gt->text;
+		e = o + st->len;
+		if (memcmp(ptr + 1, st->text + 1, st->len - 1) == 0 &&
+		    (o == 0 || gt->cells[o - 1] != gt->cells[o]) &&
+		    (e == gt->len || gt->cells[e - 1] != gt->cells[e])) {
+			*off = o;
+			return (1);
+		}
+		ptr++;
+	}
+	return (0);
+}
 
-	gc = grid_peek_cell(gd, px, py);
-	grid_cell_get(gc, &ud);
-	sgc = grid_peek_cell(sgd, spx, 0);
-	grid_cell_get(sgc, &sud);
+/*
+ * Compile a search string, unless it and the search options are the same as
+ * last time in which case return 0. With search-regex the string is an
+ * extended regular expression; if it is not valid it is matched as it is.
+ * With search-smart-case a string with no uppercase letters ignores case.
+ */
+int
+window_copy_search_compile(struct window_pane *wp, const char *searchstr)
+{
+	struct window_copy_mode_data	*data = wp->modedata;
+	struct options			*oo = &wp->window->options;
+	struct screen			 ss;
+	struct screen_write_ctx		 ctx;
+	struct grid_cell	 	 gc;
+	size_t				 searchlen;
+	int				 flags, how, utf8flag;
 
-	if (ud.size != sud.size || ud.width != sud.width)
+	flags = window_search_flags(wp->window, searchstr);
+	if (data->searchpattern != NULL &&
+	    strcmp(data->searchpattern, searchstr) == 0 &&
+	    data->searchflags == flags)
 		return (0);
-	return (memcmp(ud.data, sud.data, ud.size) == 0);
+
+	window_copy_search_free(wp);
+	data->searchpattern = xstrdup(searchstr);
+	data->searchflags = flags;
+
+	how = window_search_compile(&data->searchre, searchstr, flags);
+	if (how != 0) {
+		data->searchisre = 1;
+		data->searchtrim = (how == WINDOW_SEARCH_REGEX);
+		data->searchsx = 0;
+		return (1);
+	}
+
+	utf8flag = options_get_number(oo, "utf8");
+	searchlen = screen_write_strlen(utf8flag, "%s", searchstr);
+
+	screen_init(&ss, searchlen, 1, 0);
+	screen_write_start(&ctx, NULL, &ss);
+	memcpy(&gc, &grid_default_cell, sizeof gc);
+	screen_write_nputs(&ctx, -1, &gc, utf8flag, "%s", searchstr);
+	screen_write_stop(&ctx);
+
+	grid_get_text(ss.grid, 0, &data->searchtext);
+	data->searchsx = ss.grid->sx;
+	screen_free(&ss);
+	return (1);
+}
+
+/* Free the compiled search pattern. */
+void
+window_copy_search_free(struct window_pane *wp)
+{
+	struct window_copy_mode_data	*data = wp->modedata;
+
+	if (data->searchisre)
+		regfree(&data->searchre);
+	data->searchisre = 0;
+	data->searchtrim = 0;
+
+	free(data->searchpattern);
+	data->searchpattern = NULL;
+
+	free(data->searchtext.text);
+	free(data->searchtext.cells);
+	memset(&data->searchtext, 0, sizeof data->searchtext);
 }
 
+/* Get the text of a line to search. */
+void
+window_copy_search_text(struct window_pane *wp, u_int py, struct grid_text *gt)
+{
+	struct window_copy_mode_data	*data = wp->modedata;
+
+	grid_get_text(data->backing->grid, py, gt);
+	if (data->searchtrim) {
+		while (gt->len > 0 && gt->text[gt->len - 1] == ' ')
+			gt->len--;
+		gt->text[gt->len] = '\0';
+	}
+}
+
+/*
+ * Find the next match in line text from *off. On return *off and *end are
+ * the bytes where the match starts and ends. Empty matches are skipped.
+ */
 int
-window_copy_search_lr(struct grid *gd,
-    struct grid *sgd, u_int *ppx, u_int py, u_int first, u_int last)
+window_copy_search_match(struct window_pane *wp, struct grid_text *gt,
+    size_t *off, size_t *end)
 {
-	u_int	ax, bx, px;
+	struct window_copy_mode_data	*data = wp->modedata;
+	regmatch_t			 rm;
+	size_t				 o, e;
 
-	for (ax = first; ax < last; ax++) {
-		if (ax + sgd->sx >= gd->sx)
-			break;
-		for (bx = 0; bx < sgd->sx; bx++) {
-			px = ax + bx;
-			if (!window_copy_search_compare(gd, px, py, sgd, bx))
-				break;
-		}
-		if (bx == sgd->sx) {
-			*ppx = ax;
+	if (!data->searchisre) {
+		if (!window_copy_search_find(gt, &data->searchtext, off))
+			return (0);
+		*end = *off + data->searchtext.len;
+		return (1);
+	}
+
+	while (*off < gt->len) {
+		if (regexec(&data->searchre, gt->text + *off, 1, &rm,
+		    *off != 0 ? REG_NOTBOL : 0) != 0)
+			return (0);
+		o = *off + rm.rm_so;
+		e = *off + rm.rm_eo;
+		if (e > o &&
+		    (o == 0 || gt->cells[o - 1] != gt->cells[o]) &&
+		    gt->cells[e - 1] != gt->cells[e]) {
+			*off = o;
+			*end = e;
 			return (1);
 		}
+		*off = o + 1;
 	}
 	return (0);
 }
 
+/*
+ * Where to look for the match after one from off to end. Plain strings may
+ * overlap but regular expression matches follow each other.
+ */
+size_t
+window_copy_search_skip(struct window_pane *wp, size_t off, size_t end)
+{
+	struct window_copy_mode_data	*data = wp->modedata;
+
+	if (data->searchisre)
+		return (end);
+	return (off + 1);
+}
+
+/* Find the first match starting from first to before last. */
 int
-window_copy_search_rl(struct grid *gd,
-    struct grid *sgd, u_int *ppx, u_int py, u_int first, u_int last)
+window_copy_search_lr(struct window_pane *wp, struct grid_text *gt,
+    u_int *ppx, u_int first, u_int last)
 {
-	u_int	ax, bx, px;
+	struct window_copy_mode_data	*data = wp->modedata;
+	u_int				 sx = data->backing->grid->sx;
+	size_t				 off, end;
+	u_int				 ax;
 
-	for (ax = last + 1; ax > first; ax--) {
-		if (gd->sx - (ax - 1) < sgd->sx)
-			continue;
-		for (bx = 0; bx < sgd->sx; bx++) {
-			px = ax - 1 + bx;
-			if (!window_copy_search_compare(gd, px, py, sgd, bx))
-				break;
-		}
-		if (bx == sgd->sx) {
-			*ppx = ax - 1;
+	off = 0;
+	while (window_copy_search_match(wp, gt, &off, &end)) {
+		ax = gt->cells[off];
+		if (ax >= last || ax + data->searchsx >= sx)
+			break;
+		if (ax >= first) {
+			*ppx = ax;
 			return (1);
 		}
+		off = window_copy_search_skip(wp, off, end);
 	}
 	return (0);
 }
 
+/* Find the last match starting from first to last. */
+int
+window_copy_search_rl(struct window_pane *wp, struct grid_text *gt,
+    u_int *ppx, u_int first, u_int last)
+{
+	struct window_copy_mode_data	*data = wp->modedata;
+	u_int				 sx = data->backing->grid->sx;
+	size_t				 off, end;
+	u_int				 ax;
+	int				 found = 0;
+
+	off = 0;
+	while (window_copy_search_match(wp, gt, &off, &end)) {
+		ax = gt->cells[off];
+		if (ax > last)
+			break;
+		if (ax >= first && sx - ax >= data->searchsx) {
+			*ppx = ax;
+			found = 1;
+		}
+		off = window_copy_search_skip(wp, off, end);
+	}
+	return (found);
+}
+
+/*
+ * Start searching for a string. The search is done a few thousand lines at a
+ * time from a timer so a large history does not stop the server; the cursor
+ * moves to each match as it is found. A new pattern also starts counting its
+ * matches.
+ */
 void
-window_copy_search_up(struct window_pane *wp, const char *searchstr)
+window_copy_search_start(struct window_pane *wp, const char *searchstr,
+    int up, u_int count)
 {
 	struct window_copy_mode_data	*data = wp->modedata;
-	struct screen			*s = data->backing, ss;
-	struct screen_write_ctx		 ctx;
-	struct grid			*gd = s->grid, *sgd;
-	struct grid_cell	 	 gc;
-	size_t				 searchlen;
-	u_int				 i, last, fx, fy, px;
-	int				 utf8flag, n, wrapped, wrapflag;
 
-	if (*searchstr == '\0')
+	window_copy_search_cancel(wp);
+	if (*searchstr == '\0' || count == 0)
 		return;
-	utf8flag = options_get_number(&wp->window->options, "utf8");
-	wrapflag = options_get_number(&wp->window->options, "wrap-search");
-	searchlen = screen_write_strlen(utf8flag, "%s", searchstr);
 
-	screen_init(&ss, searchlen, 1, 0);
-	screen_write_start(&ctx, NULL, &ss);
-	memcpy(&gc, &grid_default_cell, sizeof gc);
-	screen_write_nputs(&ctx, -1, &gc, utf8flag, "%s", searchstr);
-	screen_write_stop(&ctx);
+	if (window_copy_search_compile(wp, searchstr) || !data->searchmark) {
+		data->searchmark = 1;
+		window_copy_count_start(wp);
+		window_copy_redraw_screen(wp);
+	}
+
+	data->searchup = up;
+	data->searchcount = count;
+	if (!window_copy_search_next(wp))
+		return;
+	data->searching = 1;
+	window_copy_search_run(wp);
+}
+
+/* Set up to search for the next match from the cursor. */
+int
+window_copy_search_next(struct window_pane *wp)
+{
+	struct window_copy_mode_data	*data = wp->modedata;
+	struct grid			*gd = data->backing->grid;
+	u_int				 fx, fy;
 
 	fx = data->cx;
 	fy = gd->hsize - data->oy + data->cy;
 
-	if (fx == 0) {
-		if (fy == 0)
-			return;
-		fx = gd->sx - 1;
-		fy--;
-	} else
-		fx--;
-	n = wrapped = 0;
-
-retry:
-	sgd = ss.grid;
-	for (i = fy + 1; i > 0; i--) {
-		last = screen_size_x(s);
-		if (i == fy + 1)
-			last = fx;
-		n = window_copy_search_rl(gd, sgd, &px, i - 1, 0, last);
-		if (n) {
-			window_copy_scroll_to(wp, px, i - 1);
-			break;
-		}
-	}
-	if (wrapflag && !n && !wrapped) {
-		fx = gd->sx - 1;
-		fy = gd->hsize + gd->sy - 1;
-		wrapped = 1;
-		goto retry;
+	if (data->searchup) {
+		if (fx == 0) {
+			if (fy == 0)
+				return (0);
+			fx = gd->sx - 1;
+			fy--;
+		} else
+			fx--;
+	} else {
+		if (fx == gd->sx - 1) {
+			if (fy == gd->hsize + gd->sy)
+				return (0);
+			fx = 0;
+			fy++;
+		} else
+			fx++;
 	}
 
-	screen_free(&ss);
+	data->searchfx = fx;
+	data->searchfy = data->searchy = fy;
+	data->searchwrapped = 0;
+	data->searchdone = 0;
+	return (1);
 }
 
+/* Search one line, limited to before or after the start on the first line. */
+int
+window_copy_search_line(struct window_pane *wp, u_int py, u_int *ppx)
+{
+	struct window_copy_mode_data	*data = wp->modedata;
+	struct grid			*gd = data->backing->grid;
+	struct grid_text		*gt = &data->searchline;
+
+	window_copy_search_text(wp, py, gt);
+	if (data->searchup) {
+		return (window_copy_search_rl(wp, gt, ppx, 0,
+		    py == data->searchfy ? data->searchfx : gd->sx));
+	}
+	return (window_copy_search_lr(wp, gt, ppx,
+	    py == data->searchfy ? data->searchfx : 0, gd->sx));
+}
+
+/*
+ * Search up to WINDOW_COPY_SEARCH_LINES lines. If the search wraps, only the
+ * lines up to and including the starting line are searched again.
+ */
 void
-window_copy_search_down(struct window_pane *wp, const char *searchstr)
+window_copy_search_run(struct window_pane *wp)
 {
 	struct window_copy_mode_data	*data = wp->modedata;
-	struct screen			*s = data->backing, ss;
-	struct screen_write_ctx		 ctx;
-	struct grid			*gd = s->grid, *sgd;
-	struct grid_cell	 	 gc;
-	size_t				 searchlen;
-	u_int				 i, first, fx, fy, px;
-	int				 utf8flag, n, wrapped, wrapflag;
+	struct screen			*s = &data->screen;
+	struct grid			*gd = data->backing->grid;
+	u_int				 n, py, px, total;
+	int				 wrapflag;
 
-	if (*searchstr == '\0')
-		return;
-	utf8flag = options_get_number(&wp->window->options, "utf8");
 	wrapflag = options_get_number(&wp->window->options, "wrap-search");
-	searchlen = screen_write_strlen(utf8flag, "%s", searchstr);
+	total = gd->hsize + gd->sy;
+
+	for (n = 0; n < WINDOW_COPY_SEARCH_LINES; n++) {
+		py = data->searchy;
+		if (py < total) {
+			data->searchdone++;
+			if (window_copy_search_line(wp, py, &px)) {
+				window_copy_scroll_to(wp, px, py);
+				if (--data->searchcount == 0 ||
+				    !window_copy_search_next(wp))
+					goto done;
+				continue;
+			}
+			if (data->searchwrapped && py == data->searchend)
+				goto done;
+		}
 
-	screen_init(&ss, searchlen, 1, 0);
-	screen_write_start(&ctx, NULL, &ss);
-	memcpy(&gc, &grid_default_cell, sizeof gc);
-	screen_write_nputs(&ctx, -1, &gc, utf8flag, "%s", searchstr);
-	screen_write_stop(&ctx);
+		if (data->searchup ? py != 0 : py + 1 < total) {
+			if (data->searchup)
+				data->searchy--;
+			else
+				data->searchy++;
+			continue;
+		}
+		if (!wrapflag || data->searchwrapped)
+			goto done;
+		data->searchend = data->searchfy;
+		if (data->searchup) {
+			data->searchfx = gd->sx - 1;
+			data->searchfy = total - 1;
+		} else {
+			data->searchfx = 0;
+			data->searchfy = 0;
+		}
+		data->searchy = data->searchfy;
+		data->searchwrapped = 1;
+	}
 
-	fx = data->cx;
-	fy = gd->hsize - data->oy + data->cy;
+	window_copy_redraw_lines(wp, screen_size_y(s) - 1, 1);
+	window_copy_search_timer(wp);
+	return;
+
+done:
+	window_copy_search_cancel(wp);
+	window_copy_redraw_lines(wp, screen_size_y(s) - 1, 1);
+}
+
+/* Start the timer if there is a search, queued keys or a count to do. */
+void
+window_copy_search_timer(struct window_pane *wp)
+{
+	struct window_copy_mode_data	*data = wp->modedata;
+	struct timeval			 tv;
+
+	if (data->searching || ARRAY_LENGTH(&data->searchkeys) != 0 ||
+	    data->counting) {
+		memset(&tv, 0, sizeof tv);
+		evtimer_add(&data->searchtimer, &tv);
+	}
+}
+
+/*
+ * Timer callback to search the next part of the history. Once the search is
+ * finished, handle the keys pressed while it was running and then carry on
+ * counting matches.
+ */
+void
+window_copy_search_callback(unused int fd, unused short events, void *arg)
+{
+	struct window_pane		*wp = arg;
+	struct window_copy_mode_data	*data = wp->modedata;
+	struct window_copy_key		*pk;
+	struct session			*sess;
+	ARRAY_DECL(, struct window_copy_key) keys;
+	u_int				 i;
 
-	if (fx == gd->sx - 1) {
-		if (fy == gd->hsize + gd->sy)
+	if (data->searching) {
+		window_copy_search_run(wp);
+		return;
+	}
+
+	if (ARRAY_LENGTH(&data->searchkeys) != 0) {
+		memcpy(&keys, &data->searchkeys, sizeof keys);
+		ARRAY_INIT(&data->searchkeys);
+		for (i = 0; i < ARRAY_LENGTH(&keys); i++) {
+			if (wp->mode != &window_copy_mode)
+				break;
+			pk = &ARRAY_ITEM(&keys, i);
+			sess = pk->sess;
+			if (sess != NULL && !session_alive(sess))
+				sess = NULL;
+			window_copy_key(wp, sess, pk->key);
+		}
+		ARRAY_FREE(&keys);
+		if (wp->mode != &window_copy_mode)
 			return;
-		fx = 0;
-		fy++;
-	} else
-		fx++;
-	n = wrapped = 0;
-
-retry:
-	sgd = ss.grid;
-	for (i = fy + 1; i < gd->hsize + gd->sy + 1; i++) {
-		first = 0;
-		if (i == fy + 1)
-			first = fx;
-		n = window_copy_search_lr(gd, sgd, &px, i - 1, first, gd->sx);
-		if (n) {
-			window_copy_scroll_to(wp, px, i - 1);
-			break;
+		if (data->searching || ARRAY_LENGTH(&data->searchkeys) != 0)
+			return;
+	}
+
+	if (data->counting)
+		window_copy_count_run(wp);
+}
+
+/*
+ * Stop any search in progress. Keys queued while it was running and the match
+ * count are carried on from the timer.
+ */
+void
+window_copy_search_cancel(struct window_pane *wp)
+{
+	struct window_copy_mode_data	*data = wp->modedata;
+
+	evtimer_del(&data->searchtimer);
+	data->searching = 0;
+	window_copy_search_timer(wp);
+}
+
+/* How far through the search is. */
+u_int
+window_copy_search_percent(struct window_pane *wp)
+{
+	struct window_copy_mode_data	*data = wp->modedata;
+	struct grid			*gd = data->backing->grid;
+	u_int				 total;
+
+	total = gd->hsize + gd->sy + 1;
+	if (data->searchdone >= total)
+		return (99);
+	return ((data->searchdone * 100ULL) / total);
+}
+
+/* Start counting the matches for the search pattern. */
+void
+window_copy_count_start(struct window_pane *wp)
+{
+	struct window_copy_mode_data	*data = wp->modedata;
+
+	data->counting = 1;
+	data->county = 0;
+	data->countmatches = 0;
+	window_copy_search_timer(wp);
+}
+
+/* Count matches in the next WINDOW_COPY_SEARCH_LINES lines. */
+void
+window_copy_count_run(struct window_pane *wp)
+{
+	struct window_copy_mode_data	*data = wp->modedata;
+	struct grid			*gd = data->backing->grid;
+	struct grid_text		*gt = &data->searchline;
+	size_t				 off, end;
+	u_int				 n, total;
+
+	total = gd->hsize + gd->sy;
+	for (n = 0; n < WINDOW_COPY_SEARCH_LINES && data->county < total; n++) {
+		window_copy_search_text(wp, data->county++, gt);
+		off = 0;
+		while (window_copy_search_match(wp, gt, &off, &end)) {
+			data->countmatches++;
+			off = window_copy_search_skip(wp, off, end);
 		}
 	}
-	if (wrapflag && !n && !wrapped) {
-		fx = 0;
-		fy = 0;
-		wrapped = 1;
-		goto retry;
+	if (data->county < total) {
+		window_copy_search_timer(wp);
+		return;
 	}
 
-	screen_free(&ss);
+	data->counting = 0;
+	window_copy_redraw_lines(wp, 0, 1);
 }
 
 void
@@ -1115,15 +1514,22 @@ window_copy_write_line(
 	struct screen			*s = &data->screen;
 	struct options			*oo = &wp->window->options;
 	struct grid_cell		 gc;
-	char				 hdr[32];
+	char				 hdr[64];
 	size_t	 			 last, xoff = 0, size = 0;
 
 	window_mode_attrs(&gc, oo);
 
 	last = screen_size_y(s) - 1;
 	if (py == 0) {
-		size = xsnprintf(hdr, sizeof hdr,
-		    "[%u/%u]", data->oy, screen_hsize(data->backing));
+		if (data->searchmark && data->searchpattern != NULL) {
+			size = xsnprintf(hdr, sizeof hdr,
+			    "(%u%s matches) [%u/%u]", data->countmatches,
+			    data->counting ? "+" : "", data->oy,
+			    screen_hsize(data->backing));
+		} else {
+			size = xsnprintf(hdr, sizeof hdr,
+			    "[%u/%u]", data->oy, screen_hsize(data->backing));
+		}
 		if (size > screen_size_x(s))
 			size = screen_size_x(s);
 		screen_write_cursormove(ctx, screen_size_x(s) - size, 0);
@@ -1138,6 +1544,11 @@ window_copy_write_line(
 		}
 		screen_write_cursormove(ctx, 0, last);
 		screen_write_puts(ctx, &gc, "%s", hdr);
+	} else if (py == last && data->searching) {
+		xoff = size = xsnprintf(hdr, sizeof hdr, "Searching... %u%%",
+		    window_copy_search_percent(wp));
+		screen_write_cursormove(ctx, 0, last);
+		screen_write_puts(ctx, &gc, "%s", hdr);
 	} else
 		size = 0;
 
@@ -1145,6 +1556,9 @@ window_copy_write_line(
 	screen_write_copy(ctx, data->backing, xoff,
 	    (screen_hsize(data->backing) - data->oy) + py,
 	    screen_size_x(s) - size, 1);
+	if (data->searchmark && data->searchpattern != NULL)
+		window_copy_write_matches(wp, ctx, py, xoff,
+		    screen_size_x(s) - size);
 
 	if (py == data->cy && data->cx == screen_size_x(s)) {
 		memcpy(&gc, &grid_default_cell, sizeof gc);
@@ -1153,6 +1567,47 @@ window_copy_write_line(
 	}
 }
 
+/* Highlight the matches for the search pattern on a line. */
+void
+window_copy_write_matches(struct window_pane *wp,
+    struct screen_write_ctx *ctx, u_int py, u_int px, u_int nx)
+{
+	struct window_copy_mode_data	*data = wp->modedata;
+	struct options			*oo = &wp->window->options;
+	struct grid			*gd = data->backing->grid;
+	struct grid_text		*gt = &data->searchline;
+	struct grid_cell		 gc;
+	size_t				 off, end;
+	u_int				 xx, yy;
+	int				 fg, bg, attr;
+
+	yy = screen_hsize(data->backing) - data->oy + py;
+	if (yy >= gd->hsize + gd->sy)
+		return;
+	window_copy_search_text(wp, yy, gt);
+
+	fg = options_get_number(oo, "mode-match-fg");
+	bg = options_get_number(oo, "mode-match-bg");
+	attr = options_get_number(oo, "mode-match-attr");
+
+	off = 0;
+	while (window_copy_search_match(wp, gt, &off, &end)) {
+		for (xx = gt->cells[off]; xx < gt->cells[end]; xx++) {
+			if (xx < px || xx >= px + nx)
+				continue;
+			grid_get_cell(gd, xx, yy, &gc);
+			if (gc.flags & GRID_FLAG_PADDING)
+				continue;
+			colour_set_fg(&gc, fg);
+			colour_set_bg(&gc, bg);
+			gc.attr |= attr;
+			screen_write_cursormove(ctx, xx, py);
+			screen_write_cell(ctx, &gc);
+		}
+		off = end;
+	}
+}
+
 void
 window_copy_write_lines(
     struct window_pane *wp, struct screen_write_ctx *ctx, u_int py, u_int ny)
@@ -1439,7 +1894,7 @@ window_copy_copy_line(struct window_pane *wp,
 {
 	struct window_copy_mode_data	*data = wp->modedata;
 	struct grid			*gd = data->backing->grid;
-	const struct grid_cell		*gc;
+	struct grid_cell		 gc;
 	struct grid_line		*gl;
 	struct utf8_data		 ud;
 	u_int				 i, xx, wrapped = 0;
@@ -1451,7 +1906,7 @@ window_copy_copy_line(struct window_pane *wp,
 	 * Work out if the line was wrapped at the screen edge and all of it is
 	 * on screen.
 	 */
-	gl = &gd->linedata[sy];
+	gl = grid_get_line(gd, sy);
 	if (gl->flags & GRID_LINE_WRAPPED && gl->cellsize <= gd->sx)
 		wrapped = 1;
 
@@ -1467,10 +1922,10 @@ window_copy_copy_line(struct window_pane *wp,
 
 	if (sx < ex) {
 		for (i = sx; i < ex; i++) {
-			gc = grid_peek_cell(gd, i, sy);
-			if (gc->flags & GRID_FLAG_PADDING)
+			grid_get_cell(gd, i, sy, &gc);
+			if (gc.flags & GRID_FLAG_PADDING)
 				continue;
-			grid_cell_get(gc, &ud);
+			grid_cell_get(&gc, &ud);
 
 			*buf = xrealloc(*buf, 1, (*off) + ud.size);
 			memcpy(*buf + *off, ud.data, ud.size);
@@ -1503,12 +1958,12 @@ int
 window_copy_in_set(struct window_pane *wp, u_int px, u_int py, const char *set)
 {
 	struct window_copy_mode_data	*data = wp->modedata;
-	const struct grid_cell		*gc;
+	struct grid_cell		 gc;
 	struct utf8_data		 ud;
 
-	gc = grid_peek_cell(data->backing->grid, px, py);
-	grid_cell_get(gc, &ud);
-	if (ud.size != 1 || gc->flags & GRID_FLAG_PADDING)
+	grid_get_cell(data->backing->grid, px, py, &gc);
+	grid_cell_get(&gc, &ud);
+	if (ud.size != 1 || gc.flags & GRID_FLAG_PADDING)
 		return (0);
 	if (*ud.data == 0x00 || *ud.data == 0x7f)
 		return (0);
@@ -1520,22 +1975,22 @@ window_copy_find_length(struct window_pane *wp, u_int py)
 {
 	struct window_copy_mode_data	*data = wp->modedata;
 	struct screen			*s = data->backing;
-	const struct grid_cell		*gc;
+	struct grid_cell		 gc;
 	struct utf8_data		 ud;
 	u_int				 px;
 
 	/*
 	 * If the pane has been resized, its grid can contain old overlong
-	 * lines. grid_peek_cell does not allow accessing cells beyond the
+	 * lines. grid_get_cell does not allow accessing cells beyond the
 	 * width of the grid, and screen_write_copy treats them as spaces, so
 	 * ignore them here too.
 	 */
-	px = s->grid->linedata[py].cellsize;
+	px = grid_get_line(s->grid, py)->cellsize;
 	if (px > screen_size_x(s))
 		px = screen_size_x(s);
 	while (px > 0) {
-		gc = grid_peek_cell(s->grid, px - 1, py);
-		grid_cell_get(gc, &ud);
+		grid_get_cell(s->grid, px - 1, py, &gc);
+		grid_cell_get(&gc, &ud);
 		if (ud.size != 1 || *ud.data != ' ')
 			break;
 		px--;
@@ -1553,7 +2008,8 @@ window_copy_cursor_start_of_line(struct window_pane *wp)
 
 	if (data->cx == 0) {
 		py = screen_hsize(back_s) + data->cy - data->oy;
-		while (py > 0 && gd->linedata[py-1].flags & GRID_LINE_WRAPPED) {
+		while (py > 0 &&
+		    grid_get_line(gd, py - 1)->flags & GRID_LINE_WRAPPED) {
 			window_copy_cursor_up(wp, 0);
 			py = screen_hsize(back_s) + data->cy - data->oy;
 		}
@@ -1568,7 +2024,7 @@ window_copy_cursor_back_to_indentation(struct window_pane *wp)
 {
 	struct window_copy_mode_data	*data = wp->modedata;
 	u_int				 px, py, xx;
-	const struct grid_cell		*gc;
+	struct grid_cell		 gc;
 	struct utf8_data		 ud;
 
 	px = 0;
@@ -1576,8 +2032,8 @@ window_copy_cursor_back_to_indentation(struct window_pane *wp)
 	xx = window_copy_find_length(wp, py);
 
 	while (px < xx) {
-		gc = grid_peek_cell(data->backing->grid, px, py);
-		grid_cell_get(gc, &ud);
+		grid_get_cell(data->backing->grid, px, py, &gc);
+		grid_cell_get(&gc, &ud);
 		if (ud.size != 1 || *ud.data != ' ')
 			break;
 		px++;
@@ -1602,9 +2058,9 @@ window_copy_cursor_end_of_line(struct window_pane *wp)
 	if (data->cx == px) {
 		if (data->screen.sel.flag && data->rectflag)
 			px = screen_size_x(back_s);
-		if (gd->linedata[py].flags & GRID_LINE_WRAPPED) {
+		if (grid_get_line(gd, py)->flags & GRID_LINE_WRAPPED) {
 			while (py < gd->sy + gd->hsize &&
-			    gd->linedata[py].flags & GRID_LINE_WRAPPED) {
+			    grid_get_line(gd, py)->flags & GRID_LINE_WRAPPED) {
 				window_copy_cursor_down(wp, 0);
 				py = screen_hsize(back_s)
 				     + data->cy - data->oy;
@@ -1737,7 +2193,7 @@ window_copy_cursor_jump(struct window_pane *wp)
 {
 	struct window_copy_mode_data	*data = wp->modedata;
 	struct screen			*back_s = data->backing;
-	const struct grid_cell		*gc;
+	struct grid_cell		 gc;
 	struct utf8_data		 ud;
 	u_int				 px, py, xx;
 
@@ -1746,9 +2202,9 @@ window_copy_cursor_jump(struct window_pane *wp)
 	xx = window_copy_find_length(wp, py);
 
 	while (px < xx) {
-		gc = grid_peek_cell(back_s->grid, px, py);
-		grid_cell_get(gc, &ud);
-		if (!(gc->flags & GRID_FLAG_PADDING) &&
+		grid_get_cell(back_s->grid, px, py, &gc);
+		grid_cell_get(&gc, &ud);
+		if (!(gc.flags & GRID_FLAG_PADDING) &&
 		    ud.size == 1 && *ud.data == data->jumpchar) {
 			window_copy_update_cursor(wp, px, data->cy);
 			if (window_copy_update_selection(wp))
@@ -1764,7 +2220,7 @@ window_copy_cursor_jump_back(struct window_pane *wp)
 {
 	struct window_copy_mode_data	*data = wp->modedata;
 	struct screen			*back_s = data->backing;
-	const struct grid_cell		*gc;
+	struct grid_cell		 gc;
 	struct utf8_data		 ud;
 	u_int				 px, py;
 
@@ -1775,9 +2231,9 @@ window_copy_cursor_jump_back(struct window_pane *wp)
 		px--;
 
 	for (;;) {
-		gc = grid_peek_cell(back_s->grid, px, py);
-		grid_cell_get(gc, &ud);
-		if (!(gc->flags & GRID_FLAG_PADDING) &&
+		grid_get_cell(back_s->grid, px, py, &gc);
+		grid_cell_get(&gc, &ud);
+		if (!(gc.flags & GRID_FLAG_PADDING) &&
 		    ud.size == 1 && *ud.data == data->jumpchar) {
 			window_copy_update_cursor(wp, px, data->cy);
 			if (window_copy_update_selection(wp))
@@ -1795,7 +2251,7 @@ window_copy_cursor_jump_to(struct window_pane *wp)
 {
 	struct window_copy_mode_data	*data = wp->modedata;
 	struct screen			*back_s = data->backing;
-	const struct grid_cell		*gc;
+	struct grid_cell		 gc;
 	struct utf8_data		 ud;
 	u_int				 px, py, xx;
 
@@ -1804,9 +2260,9 @@ window_copy_cursor_jump_to(struct window_pane *wp)
 	xx = window_copy_find_length(wp, py);
 
 	while (px < xx) {
-		gc = grid_peek_cell(back_s->grid, px, py);
-		grid_cell_get(gc, &ud);
-		if (!(gc->flags & GRID_FLAG_PADDING) &&
+		grid_get_cell(back_s->grid, px, py, &gc);
+		grid_cell_get(&gc, &ud);
+		if (!(gc.flags & GRID_FLAG_PADDING) &&
 		    ud.size == 1 && *ud.data == data->jumpchar) {
 			window_copy_update_cursor(wp, px - 1, data->cy);
 			if (window_copy_update_selection(wp))
@@ -1822,7 +2278,7 @@ window_copy_cursor_jump_to_back(struct window_pane *wp)
 {
 	struct window_copy_mode_data	*data = wp->modedata;
 	struct screen			*back_s = data->backing;
-	const struct grid_cell		*gc;
+	struct grid_cell		 gc;
 	struct utf8_data		 ud;
 	u_int				 px, py;
 
@@ -1833,9 +2289,9 @@ window_copy_cursor_jump_to_back(struct window_pane *wp)
 		px--;
 
 	for (;;) {
-		gc = grid_peek_cell(back_s->grid, px, py);
-		grid_cell_get(gc, &ud);
-		if (!(gc->flags & GRID_FLAG_PADDING) &&
+		grid_get_cell(back_s->grid, px, py, &gc);
+		grid_cell_get(&gc, &ud);
+		if (!(gc.flags & GRID_FLAG_PADDING) &&
 		    ud.size == 1 && *ud.data == data->jumpchar) {
 			window_copy_update_cursor(wp, px + 1, data->cy);
 			if (window_copy_update_selection(wp))
@@ -19,6 +19,7 @@
 #include <sys/types.h>
 #include <sys/ioctl.h>
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <fnmatch.h>
@@ -41,18 +42,25 @@
  * input_parse (in input.c). Input data is received as key codes and written
  * directly via input_key.
  *
+ * Output is also written from the same buffer to any pipe-pane command. The
+ * parser and the pipe each keep an offset into it and it is only drained once
+ * both have used the data, so nothing is copied for the pipe.
+ *
  * Each pane also has a "virtual" screen (screen.c) which contains the current
  * state and is redisplayed when the window is reattached to a client.
  *
- * Windows are stored directly on a global array and wrapped in any number of
- * winlink structs to be linked onto local session RB trees. A reference count
- * is maintained and a window removed from the global list and destroyed when
- * it reaches zero.
+ * Windows are stored directly on a global array, indexed by id in a global
+ * tree, and wrapped in any number of winlink structs to be linked onto local
+ * session RB trees. A reference count is maintained and a window removed from
+ * the global list and destroyed when it reaches zero.
  */
 
 /* Global window list. */
 struct windows windows;
 
+/* Global windows tree, indexed by id. */
+struct window_tree all_windows;
+
 /* Global panes tree. */
 struct window_pane_tree all_window_panes;
 u_int	next_window_pane_id;
@@ -61,6 +69,11 @@ u_int	next_window_id;
 void	window_pane_timer_callback(int, short, void *);
 void	window_pane_read_callback(struct bufferevent *, void *);
 void	window_pane_error_callback(struct bufferevent *, short, void *);
+void	window_pane_pipe_callback(int, short, void *);
+void	window_pane_pipe_write(struct window_pane *);
+void	window_pane_pipe_overflow(struct window_pane *);
+void	window_pane_pipe_unblock(struct window_pane *);
+void	window_pane_pipe_gap(struct window_pane *);
 
 RB_GENERATE(winlinks, winlink, entry, winlink_cmp);
 
@@ -70,6 +83,18 @@ winlink_cmp(struct winlink *wl1, struct winlink *wl2)
 	return (wl1->idx - wl2->idx);
 }
 
+RB_GENERATE(window_tree, window, entry, window_cmp);
+
+int
+window_cmp(struct window *w1, struct window *w2)
+{
+	if (w1->id < w2->id)
+		return (-1);
+	if (w1->id > w2->id)
+		return (1);
+	return (0);
+}
+
 RB_GENERATE(window_pane_tree, window_pane, tree_entry, window_pane_cmp);
 
 int
@@ -167,6 +192,7 @@ void
 winlink_set_window(struct winlink *wl, struct window *w)
 {
 	wl->window = w;
+	TAILQ_INSERT_TAIL(&w->winlinks, wl, wentry);
 	w->references++;
 }
 
@@ -176,7 +202,8 @@ winlink_remove(struct winlinks *wwl, struct winlink *wl)
 	struct window	*w = wl->window;
 
 	RB_REMOVE(winlinks, wwl, wl);
-	free(wl->status_text);
+	if (w != NULL)
+		TAILQ_REMOVE(&w->winlinks, wl, wentry);
 	free(wl);
 
 	if (w != NULL)
@@ -256,15 +283,10 @@ window_index(struct window *s, u_int *i)
 struct window *
 window_find_by_id(u_int id)
 {
-	struct window	*w;
-	u_int		 i;
+	struct window	w;
 
-	for (i = 0; i < ARRAY_LENGTH(&windows); i++) {
-		w = ARRAY_ITEM(&windows, i);
-		if (w->id == id)
-			return (w);
-	}
-	return (NULL);
+	w.id = id;
+	return (RB_FIND(window_tree, &all_windows, &w));
 }
 
 struct window *
@@ -275,11 +297,14 @@ window_create1(u_int sx, u_int sy)
 
 	w = xcalloc(1, sizeof *w);
 	w->id = next_window_id++;
+	RB_INSERT(window_tree, &all_windows, w);
 	w->name = NULL;
 	w->automatic_rename = 1;
 	w->flags = 0;
+	w->status_generation = 0;
 
 	TAILQ_INIT(&w->panes);
+	TAILQ_INIT(&w->winlinks);
 	w->active = NULL;
 
 	w->lastlayout = -1;
@@ -342,6 +367,7 @@ window_destroy(struct window *w)
 	if (window_index(w, &i) != 0)
 		fatalx("index not found");
 	ARRAY_SET(&windows, i, NULL);
+	RB_REMOVE(window_tree, &all_windows, w);
 	while (!ARRAY_EMPTY(&windows) && ARRAY_LAST(&windows) == NULL)
 		ARRAY_TRUNC(&windows, 1);
 
@@ -692,6 +718,9 @@ window_pane_create(struct window *w, u_int sx, u_int sy, u_int hlimit)
 	wp->cwd = NULL;
 	wp->name = NULL;
 	wp->automatic_rename = 1;
+	wp->name_pgrp = 0;
+	wp->name_idle = 0;
+	wp->name_skip = 0;
 
 	wp->fd = -1;
 	wp->event = NULL;
@@ -706,9 +735,13 @@ window_pane_create(struct window *w, u_int sx, u_int sy, u_int hlimit)
 	wp->sx = sx;
 	wp->sy = sy;
 
+	wp->base_offset = 0;
+	wp->offset.used = 0;
+
 	wp->pipe_fd = -1;
-	wp->pipe_off = 0;
-	wp->pipe_event = NULL;
+	wp->pipe_offset.used = 0;
+	wp->pipe_extra = NULL;
+	wp->pipe_lost = 0;
 
 	wp->saved_grid = NULL;
 
@@ -727,6 +760,7 @@ void
 window_pane_destroy(struct window_pane *wp)
 {
 	window_pane_reset_mode(wp);
+	window_pane_pipe_close(wp);
 
 	if (event_initialized(&wp->changes_timer))
 		evtimer_del(&wp->changes_timer);
@@ -742,23 +776,27 @@ window_pane_destroy(struct window_pane *wp)
 	if (wp->saved_grid != NULL)
 		grid_destroy(wp->saved_grid);
 
-	if (wp->pipe_fd != -1) {
-		bufferevent_free(wp->pipe_event);
-		close(wp->pipe_fd);
-	}
-
 	RB_REMOVE(window_pane_tree, &all_window_panes, wp);
 
-
-	if (event_initialized(&wp->name_timer))
-		evtimer_del(&wp->name_timer);
-
 	free(wp->cwd);
 	free(wp->shell);
 	free(wp->cmd);
 	free(wp);
 }
 
+/* Spill history collected from a pane to a file beside the server socket. */
+void
+window_pane_spill_history(struct window_pane *wp, u_int limit)
+{
+	char	*path;
+
+	if (limit == 0)
+		return;
+	xasprintf(&path, "%s-%u.history", socket_path, wp->id);
+	grid_set_spill(wp->base.grid, path, limit);
+	free(path);
+}
+
 int
 window_pane_spawn(struct window_pane *wp, const char *cmd, const char *shell,
     const char *cwd, struct environ *env, struct termios *tio, char **cause)
@@ -769,6 +807,7 @@ window_pane_spawn(struct window_pane *wp, const char *cmd, const char *shell,
 	struct termios	 tio2;
 
 	if (wp->fd != -1) {
+		window_pane_pipe_save(wp);
 		bufferevent_free(wp->event);
 		close(wp->fd);
 	}
@@ -896,18 +935,23 @@ void
 window_pane_read_callback(unused struct bufferevent *bufev, void *data)
 {
 	struct window_pane     *wp = data;
-	char   		       *new_data;
-	size_t			new_size;
-
-	new_size = EVBUFFER_LENGTH(wp->event->input) - wp->pipe_off;
-	if (wp->pipe_fd != -1 && new_size > 0) {
-		new_data = EVBUFFER_DATA(wp->event->input);
-		bufferevent_write(wp->pipe_event, new_data, new_size);
-	}
 
+	/* If the pipe is full, wait until it is ready. */
+	if (wp->pipe_fd != -1 && !event_pending(&wp->pipe_event, EV_WRITE, NULL))
+		window_pane_pipe_write(wp);
 	input_parse(wp);
+	if (wp->pipe_fd != -1)
+		window_pane_pipe_overflow(wp);
 
-	wp->pipe_off = EVBUFFER_LENGTH(wp->event->input);
+	/*
+	 * Output may mean a new process, perhaps started with exec in the same
+	 * process group, so look for the name again at the next check if none
+	 * has been seen since the last.
+	 */
+	if (wp->name_idle != 0)
+		wp->name_pgrp = 0;
+	wp->name_idle = 0;
+	wp->name_skip = 0;
 
 	/*
 	 * If we get here, we're not outputting anymore, so set the silence
@@ -927,6 +971,207 @@ window_pane_error_callback(
 	server_destroy_pane(wp);
 }
 
+/* Get output from a pane which a consumer has not yet used. */
+u_char *
+window_pane_get_new_data(struct window_pane *wp,
+    struct window_pane_offset *wpo, size_t *size)
+{
+	size_t	used;
+
+	if (wp->fd == -1) {
+		*size = 0;
+		return (NULL);
+	}
+
+	used = wpo->used - wp->base_offset;
+	*size = EVBUFFER_LENGTH(wp->event->input) - used;
+	return (EVBUFFER_DATA(wp->event->input) + used);
+}
+
+/*
+ * Mark output as used by a consumer and drain whatever every consumer has now
+ * finished with.
+ */
+void
+window_pane_update_used_data(struct window_pane *wp,
+    struct window_pane_offset *wpo, size_t size)
+{
+	size_t	used;
+
+	wpo->used += size;
+
+	used = wp->offset.used;
+	if (wp->pipe_fd != -1 && wp->pipe_offset.used < used)
+		used = wp->pipe_offset.used;
+	if (wp->fd != -1 && used > wp->base_offset) {
+		evbuffer_drain(wp->event->input, used - wp->base_offset);
+		wp->base_offset = used;
+	}
+}
+
+/* Start writing output from a pane to a pipe. */
+void
+window_pane_pipe_open(struct window_pane *wp, int fd)
+{
+	wp->pipe_fd = fd;
+	wp->pipe_offset.used = wp->offset.used;
+	wp->pipe_extra = evbuffer_new();
+	wp->pipe_lost = 0;
+
+	setblocking(fd, 0);
+	event_set(&wp->pipe_event, fd, EV_WRITE, window_pane_pipe_callback, wp);
+}
+
+/* Close a pipe. Anything not yet written to it is lost. */
+void
+window_pane_pipe_close(struct window_pane *wp)
+{
+	if (wp->pipe_fd == -1)
+		return;
+
+	event_del(&wp->pipe_event);
+	close(wp->pipe_fd);
+	wp->pipe_fd = -1;
+
+	evbuffer_free(wp->pipe_extra);
+	wp->pipe_extra = NULL;
+
+	window_pane_pipe_unblock(wp);
+	window_pane_update_used_data(wp, &wp->offset, 0);
+}
+
+/*
+ * The pane's buffer is about to be freed, when the program exits or the pane
+ * is respawned, so copy anything the pipe has not used yet.
+ */
+void
+window_pane_pipe_save(struct window_pane *wp)
+{
+	u_char	*data;
+	size_t	 size;
+
+	if (wp->pipe_fd != -1) {
+		window_pane_pipe_gap(wp);
+		data = window_pane_get_new_data(wp, &wp->pipe_offset, &size);
+		evbuffer_add(wp->pipe_extra, data, size);
+		if (EVBUFFER_LENGTH(wp->pipe_extra) != 0)
+			event_add(&wp->pipe_event, NULL);
+	}
+	wp->flags &= ~PANE_PIPEFULL;
+
+	wp->base_offset = 0;
+	wp->offset.used = 0;
+	wp->pipe_offset.used = 0;
+}
+
+/* Pipe is ready for writing. */
+void
+window_pane_pipe_callback(unused int fd, unused short events, void *data)
+{
+	struct window_pane	*wp = data;
+
+	window_pane_pipe_write(wp);
+}
+
+/*
+ * Write as much output as possible to the pipe, straight from the pane's
+ * buffer. If it is not all written, wait until the pipe is ready again.
+ */
+void
+window_pane_pipe_write(struct window_pane *wp)
+{
+	u_char	*data;
+	size_t	 size, limit;
+	ssize_t	 n;
+
+	window_pane_pipe_gap(wp);
+	if (EVBUFFER_LENGTH(wp->pipe_extra) != 0) {
+		n = evbuffer_write(wp->pipe_extra, wp->pipe_fd);
+		if (n == -1 && errno != EAGAIN && errno != EINTR)
+			goto error;
+		if (EVBUFFER_LENGTH(wp->pipe_extra) != 0) {
+			event_add(&wp->pipe_event, NULL);
+			return;
+		}
+	}
+
+	data = window_pane_get_new_data(wp, &wp->pipe_offset, &size);
+	if (size != 0) {
+		n = write(wp->pipe_fd, data, size);
+		if (n == -1) {
+			if (errno != EAGAIN && errno != EINTR)
+				goto error;
+			n = 0;
+		}
+		window_pane_update_used_data(wp, &wp->pipe_offset, n);
+
+		size -= n;
+		if (size != 0)
+			event_add(&wp->pipe_event, NULL);
+	}
+
+	limit = options_get_number(&wp->window->options, "pipe-pane-limit");
+	if (size <= limit / 2)
+		window_pane_pipe_unblock(wp);
+	return;
+
+error:
+	window_pane_pipe_close(wp);
+}
+
+/*
+ * Check if a pipe has fallen too far behind and either stop reading from the
+ * pane until it catches up or throw away what it has not yet written.
+ */
+void
+window_pane_pipe_overflow(struct window_pane *wp)
+{
+	struct options	*oo = &wp->window->options;
+	size_t		 size, limit;
+
+	window_pane_get_new_data(wp, &wp->pipe_offset, &size);
+	limit = options_get_number(oo, "pipe-pane-limit");
+	if (limit == 0 || size <= limit)
+		return;
+
+	switch (options_get_number(oo, "pipe-pane-overflow")) {
+	case PIPE_BLOCK:
+		bufferevent_disable(wp->event, EV_READ);
+		wp->flags |= PANE_PIPEFULL;
+		break;
+	case PIPE_GAP:
+		wp->pipe_lost += size;
+		/* FALLTHROUGH */
+	case PIPE_DROP:
+		window_pane_update_used_data(wp, &wp->pipe_offset, size);
+		break;
+	}
+}
+
+/* Start reading from a pane again after its pipe has caught up. */
+void
+window_pane_pipe_unblock(struct window_pane *wp)
+{
+	if (!(wp->flags & PANE_PIPEFULL))
+		return;
+	wp->flags &= ~PANE_PIPEFULL;
+
+	/* Copy mode stops reading until it exits. */
+	if (wp->fd != -1 && wp->mode != &window_copy_mode)
+		bufferevent_enable(wp->event, EV_READ);
+}
+
+/* Add a mark for output thrown away to what is next written to the pipe. */
+void
+window_pane_pipe_gap(struct window_pane *wp)
+{
+	if (wp->pipe_lost == 0)
+		return;
+	evbuffer_add_printf(wp->pipe_extra, "\r\n[%zu bytes lost]\r\n",
+	    wp->pipe_lost);
+	wp->pipe_lost = 0;
+}
+
 void
 window_pane_resize(struct window_pane *wp, u_int sx, u_int sy)
 {
@@ -1114,19 +1359,96 @@ window_pane_visible(struct window_pane *wp)
 	return (1);
 }
 
+/* Get the search flags for a string from a window's search options. */
+int
+window_search_flags(struct window *w, const char *searchstr)
+{
+	struct options	*oo = &w->options;
+	const char	*cp;
+	int		 flags;
+
+	flags = 0;
+	if (options_get_number(oo, "search-regex"))
+		flags |= WINDOW_SEARCH_REGEX;
+	if (options_get_number(oo, "search-smart-case")) {
+		for (cp = searchstr; *cp != '\0'; cp++) {
+			if (isupper((u_char) *cp))
+				break;
+		}
+		if (*cp == '\0')
+			flags |= WINDOW_SEARCH_ICASE;
+	}
+	return (flags);
+}
+
+/*
+ * Compile a search string with the given flags. With WINDOW_SEARCH_REGEX the
+ * string is an extended regular expression; with WINDOW_SEARCH_ICASE case is
+ * ignored, which for a plain string is done by escaping it. Returns
+ * WINDOW_SEARCH_REGEX if the string was compiled as an expression,
+ * WINDOW_SEARCH_ICASE if it was escaped, or 0 if it should be matched as it
+ * is.
+ */
+int
+window_search_compile(regex_t *re, const char *searchstr, int flags)
+{
+	const char	*cp;
+	char		*pattern;
+	size_t		 len;
+	int		 reflags, retval;
+
+	reflags = REG_EXTENDED;
+	if (flags & WINDOW_SEARCH_ICASE)
+		reflags |= REG_ICASE;
+	if (flags & WINDOW_SEARCH_REGEX) {
+		if (regcomp(re, searchstr, reflags) == 0)
+			return (WINDOW_SEARCH_REGEX);
+	}
+	if (!(flags & WINDOW_SEARCH_ICASE))
+		return (0);
+
+	pattern = xmalloc(strlen(searchstr) * 2 + 1);
+	len = 0;
+	for (cp = searchstr; *cp != '\0'; cp++) {
+		if (strchr(".[]()*+?{}|^$\\", *cp) != NULL)
+			pattern[len++] = '\\';
+		pattern[len++] = *cp;
+	}
+	pattern[len] = '\0';
+	retval = 0;
+	if (regcomp(re, pattern, reflags) == 0)
+		retval = WINDOW_SEARCH_ICASE;
+	free(pattern);
+	return (retval);
+}
+
+/*
+ * Find the first visible line of a pane containing a string. If re is not
+ * NULL, it is used on the line with trailing spaces removed instead.
+ */
 char *
-window_pane_search(struct window_pane *wp, const char *searchstr, u_int *lineno)
+window_pane_search(struct window_pane *wp, const char *searchstr, regex_t *re,
+    u_int *lineno)
 {
 	struct screen	*s = &wp->base;
 	char		*newsearchstr, *line, *msg;
+	size_t		 len;
 	u_int	 	 i;
+	int		 found;
 
 	msg = NULL;
 	xasprintf(&newsearchstr, "*%s*", searchstr);
 
 	for (i = 0; i < screen_size_y(s); i++) {
 		line = grid_view_string_cells(s->grid, 0, i, screen_size_x(s));
-		if (fnmatch(newsearchstr, line, 0) == 0) {
+		if (re != NULL) {
+			len = strlen(line);
+			while (len > 0 && line[len - 1] == ' ')
+				line[--len] = '\0';
+			found = (regexec(re, line, 0, NULL, 0) == 0);
+		} else
+			found = (fnmatch(newsearchstr, line, 0) == 0);
+		if (found) {
 			msg = line;
 			if (lineno != NULL)
 				*lineno = i;
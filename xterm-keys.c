@@ -34,21 +34,16 @@
  * 7 Alt + Ctrl
  * 8 Shift + Alt + Ctrl
  *
- * Rather than parsing them, just match against a table.
+ * Rather than parsing them, just match against a table, which is compiled
+ * with _ matching any byte the first time a key is looked for.
  *
  * There are three forms for F1-F4 (\\033O_P and \\033O1;_P and \\033[1;_P).
  * We accept any but always output the latter (it comes first in the table).
  */
 
-int	xterm_keys_match(const char *, const char *, size_t);
-int	xterm_keys_modifiers(const char *, const char *, size_t);
+int	xterm_keys_modifiers(char);
 
-struct xterm_keys_entry {
-	int		 key;
-	const char	*template;
-};
-
-const struct xterm_keys_entry xterm_keys_table[] = {
+const struct tty_key_string xterm_keys_table[] = {
 	{ KEYC_F1,	"\033[1;_P" },
 	{ KEYC_F1,	"\033O1;_P" },
 	{ KEYC_F1,	"\033O_P" },
@@ -117,41 +112,15 @@ const struct xterm_keys_entry xterm_keys_table[] = {
 	{ '\t',		"\033[27;_;9~" },
 };
 
-/*
- * Match key against buffer, treating _ as a wildcard. Return -1 for no match,
- * 0 for match, 1 if the end of the buffer is reached (need more data).
- */
-int
-xterm_keys_match(const char *template, const char *buf, size_t len)
-{
-	size_t	pos;
-
-	if (len == 0)
-		return (0);
-
-	pos = 0;
-	do {
-		if (*template != '_' && buf[pos] != *template)
-			return (-1);
-	} while (pos++ != len && *++template != '\0');
+struct tty_key_table xterm_keys_compiled;
 
-	if (*template != '\0')	/* partial */
-		return (1);
-
-	return (0);
-}
-
-/* Find modifiers based on template. */
+/* Find modifiers from the byte in place of the _. */
 int
-xterm_keys_modifiers(const char *template, const char *buf, size_t len)
+xterm_keys_modifiers(char ch)
 {
-	size_t	idx;
 	int     param, modifiers;
 
-	idx = strcspn(template, "_");
-	if (idx >= len)
-		return (0);
-	param = buf[idx] - '1';
+	param = ch - '1';
 
 	modifiers = 0;
 	if (param & 1)
@@ -172,29 +141,28 @@ xterm_keys_modifiers(const char *template, const char *buf, size_t len)
 int
 xterm_keys_find(const char *buf, size_t len, size_t *size, int *key)
 {
-	const struct xterm_keys_entry	*entry;
-	u_int				 i;
+	const struct tty_key_state	*tks;
+	int				 retval;
 
-	for (i = 0; i < nitems(xterm_keys_table); i++) {
-		entry = &xterm_keys_table[i];
-		switch (xterm_keys_match(entry->template, buf, len)) {
-		case 0:
-			*size = strlen(entry->template);
-			*key = entry->key;
-			*key |= xterm_keys_modifiers(entry->template, buf, len);
-			return (0);
-		case 1:
-			return (1);
-		}
+	if (xterm_keys_compiled.states == NULL) {
+		tty_keys_compile(&xterm_keys_compiled, xterm_keys_table,
+		    nitems(xterm_keys_table), 1);
+	}
+
+	retval = tty_keys_match(&xterm_keys_compiled, buf, len, size, &tks);
+	if (retval == 0) {
+		*key = tks->key;
+		if (tks->modifier != 0)
+			*key |= xterm_keys_modifiers(buf[tks->modifier]);
 	}
-	return (-1);
+	return (retval);
 }
 
 /* Lookup a key number from the table. */
 char *
 xterm_keys_lookup(int key)
 {
-	const struct xterm_keys_entry	*entry;
+	const struct tty_key_string	*entry;
 	u_int				 i;
 	int				 modifiers;
 	char				*out;
@@ -225,7 +193,7 @@ xterm_keys_lookup(int key)
 		return (NULL);
 
 	/* Copy the template and replace the modifier. */
-	out = xstrdup(entry->template);
+	out = xstrdup(entry->string);
 	out[strcspn(out, "_")] = '0' + modifiers;
 	return (out);
 }